@@ -23,6 +23,12 @@ protected:
 	virtual void Destroy() = 0;
 
 	void showFrameData(bool a_bShowFrameData);
+	//Optional hook for child classes to add their own statistics to the frame data overlay
+	virtual void showFrameStats() {}
+	//Hierarchical CPU scope and GPU pass timings with rolling graphs
+	void showProfiler();
+	//Job system worker counts and the scheduling microbenchmark
+	void showJobSystem();
 
 	GLFWwindow* m_window;
 	unsigned int m_windowWidth;
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+//Culls world space bounding boxes against the camera frustum and rejects boxes that cover too few pixels to matter
+//Bounds are stored structure-of-arrays so each plane test runs on four boxes at a time with SSE, or eight with AVX
+//when the project is built with /arch:AVX. Boxes are added once per frame between Begin and Cull.
+class FrustumCuller
+{
+public:
+	//Per frame counts, every tested box is exactly one of visible, frustum culled or small culled
+	typedef struct Stats
+	{
+		unsigned int tested;
+		unsigned int visible;
+		unsigned int frustumCulled;
+		unsigned int smallCulled;
+	}Stats;
+
+	FrustumCuller();
+
+	//Extract the frustum planes for this frame and clear the boxes from the previous frame
+	void Begin(const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_viewportHeight);
+	//Add a world space box, returns its index into the visibility results
+	unsigned int Add(const glm::vec3& a_centre, const glm::vec3& a_extent);
+	//Test every box added since Begin, afterwards IsVisible reports the result for each index
+	void Cull();
+	bool IsVisible(unsigned int a_index) const { return m_visible[a_index] != 0; }
+	//Pixels across the box's bounding sphere covers, very large when the sphere reaches the camera
+	float GetProjectedSize(unsigned int a_index) const { return m_projectedSize[a_index]; }
+	glm::vec3 GetCentre(unsigned int a_index) const { return glm::vec3(m_centreX[a_index], m_centreY[a_index], m_centreZ[a_index]); }
+	glm::vec3 GetExtent(unsigned int a_index) const { return glm::vec3(m_extentX[a_index], m_extentY[a_index], m_extentZ[a_index]); }
+
+	bool IsEnabled() const { return m_enabled; }
+	void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+	//Boxes whose bounding sphere projects to fewer pixels than this across are culled, 0 disables the test
+	float GetMinPixelSize() const { return m_minPixelSize; }
+	void SetMinPixelSize(float a_pixels) { m_minPixelSize = a_pixels; }
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	//Planes are stored as ax + by + cz + d with the normal pointing into the frustum
+	glm::vec4 m_planes[6];
+	//Row of the projection-view matrix that produces clip space w, the view depth of a point
+	glm::vec4 m_depthRow;
+	//Projected pixel size of a unit radius at a depth of one
+	float m_pixelScale;
+	float m_minPixelSize;
+	bool m_enabled;
+
+	//Box centres and half extents, padded with empty boxes to a whole number of SIMD lanes
+	std::vector<float> m_centreX;
+	std::vector<float> m_centreY;
+	std::vector<float> m_centreZ;
+	std::vector<float> m_extentX;
+	std::vector<float> m_extentY;
+	std::vector<float> m_extentZ;
+	std::vector<unsigned char> m_visible;
+	std::vector<float> m_projectedSize;
+	unsigned int m_count;
+
+	Stats m_stats;
+};
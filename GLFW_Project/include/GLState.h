@@ -0,0 +1,101 @@
+#pragma once
+
+//A thin shadow of the OpenGL binding and enable state with static helper methods
+//Each call compares against the last value set through GLState and only reaches the driver when the value changes.
+//Anything that changes GL state behind GLState's back (the ImGui backend, for one) must be followed by Invalidate so
+//the next call of each kind is issued unconditionally. Objects must be deleted through GLState so a recycled name is
+//never mistaken for one that is still bound.
+class GLState
+{
+public:
+	static void UseProgram(unsigned int a_program);
+	static void BindVertexArray(unsigned int a_vertexArray);
+	static void BindBuffer(unsigned int a_target, unsigned int a_buffer);
+	static void BindBufferBase(unsigned int a_target, unsigned int a_index, unsigned int a_buffer);
+	//Bind a texture to a texture unit (0 based), the active texture unit is only changed when needed
+	static void BindTexture(unsigned int a_unit, unsigned int a_target, unsigned int a_texture);
+	//Bind a texture to the currently active unit, for texture creation and upload code
+	static void BindTexture(unsigned int a_target, unsigned int a_texture);
+	static void Enable(unsigned int a_capability);
+	static void Disable(unsigned int a_capability);
+	static void DepthMask(bool a_write);
+	static void DepthFunc(unsigned int a_func);
+	static void BlendFunc(unsigned int a_source, unsigned int a_destination);
+	static void ColorMask(bool a_write);
+
+	static void DeleteProgram(unsigned int a_program);
+	static void DeleteVertexArray(unsigned int a_vertexArray);
+	static void DeleteBuffer(unsigned int a_buffer);
+	static void DeleteTexture(unsigned int a_texture);
+
+	//Forget all shadowed state, call after anything that bypasses GLState has touched the context
+	static void Invalidate();
+
+	//Counts of state calls passed to the driver and skipped as redundant
+	typedef struct Stats
+	{
+		unsigned int issued;
+		unsigned int elided;
+	}Stats;
+	//Counts for the last completed frame
+	static const Stats& GetFrameStats() { return s_frameStats; }
+	//Publish this frame's counts and start counting the next frame
+	static void EndFrame();
+
+private:
+	static const unsigned int Unknown = 0xFFFFFFFF;
+	static const unsigned int MaxTextureUnits = 16;
+	static const unsigned int MaxBufferBindings = 16;
+
+	enum BufferTarget
+	{
+		ArrayBuffer = 0,
+		ElementArrayBuffer,
+		UniformBuffer,
+		ShaderStorageBuffer,
+		DrawIndirectBuffer,
+		PixelUnpackBuffer,
+
+		BufferTarget_Count
+	};
+	enum TextureTarget
+	{
+		Texture2D = 0,
+		TextureCubeMap,
+		Texture2DArray,
+
+		TextureTarget_Count
+	};
+	enum Capability
+	{
+		DepthTest = 0,
+		CullFace,
+		Blend,
+		ScissorTest,
+
+		Capability_Count
+	};
+
+	static int GetBufferTarget(unsigned int a_target);
+	static int GetTextureTarget(unsigned int a_target);
+	static int GetCapability(unsigned int a_capability);
+	//Update a shadowed value, returns true if the GL call needs to be made
+	static bool Change(unsigned int& a_shadow, unsigned int a_value);
+	static void SetCapability(unsigned int a_capability, bool a_enabled);
+
+	static unsigned int s_program;
+	static unsigned int s_vertexArray;
+	static unsigned int s_buffers[BufferTarget_Count];
+	static unsigned int s_uniformBases[MaxBufferBindings];
+	static unsigned int s_storageBases[MaxBufferBindings];
+	static unsigned int s_activeTexture;
+	static unsigned int s_textures[MaxTextureUnits][TextureTarget_Count];
+	static unsigned int s_capabilities[Capability_Count];
+	static unsigned int s_depthMask;
+	static unsigned int s_depthFunc;
+	static unsigned int s_blendFunc;	//Source factor in the high 16 bits, destination in the low 16
+	static unsigned int s_colorMask;
+
+	static Stats s_stats;
+	static Stats s_frameStats;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+//A read only view of a whole file mapped into memory
+//Pages are read from disk on first touch by whichever thread reads them, so decoders can work straight from the
+//mapping without the file first being copied into a buffer
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	//Map a file, returns false if the file could not be opened or is empty
+	bool Open(const std::string& a_filename);
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const unsigned char* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	//Copying would unmap the view twice
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include "TextureCompressor.h"
+
+//Builds the full mip chain of an RGBA8 image on the CPU
+//Levels are filtered in floating point from the level above, four channels at a time with SSE2 where available.
+//Colour maps are filtered in linear space and written back as sRGB so dark detail does not swallow bright detail
+//as the levels shrink, and normal maps are renormalised after every level so shading keeps unit length normals.
+class MipGenerator
+{
+public:
+	enum Filter
+	{
+		BoxFilter = 0,		//2x2 average, cheapest
+		KaiserFilter,		//8 tap Kaiser windowed sinc, keeps detail the box filter blurs away
+	};
+	//How the texel values are interpreted while filtering
+	enum Mode
+	{
+		LinearMode = 0,		//Data such as specular maps, filtered as stored
+		ColourMode,			//sRGB encoded colour, alpha is filtered as stored
+		NormalMode,			//Tangent space normals packed into rgb, alpha is filtered as stored
+	};
+
+	//The mode matching a texture usage
+	static Mode GetMode(TextureCompressor::Usage a_usage);
+	//Fill a_levels with a_rgba as level 0 followed by every smaller level down to 1x1
+	static void Generate(const unsigned char* a_rgba, unsigned int a_width, unsigned int a_height, Mode a_mode, Filter a_filter,
+		std::vector<TextureCompressor::MipLevel>& a_levels);
+};
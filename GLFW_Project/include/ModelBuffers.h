@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+//Forward declare the OBJ Model
+class OBJModel;
+class OBJMaterial;
+
+//The GPU geometry and draw data of one OBJ Model
+//Every mesh of the model is packed into a single vertex buffer and a single index buffer, each mesh is addressed by
+//its base vertex and first index. One indirect draw command is built per mesh along with a matching entry of
+//material parameters in a shader storage buffer. The render queue sorts and submits the draws, looking the
+//material of each draw up through gl_DrawID.
+//When the texture manager hands out bindless handles they are stored with the material parameters, so every draw
+//of the model samples its own textures and the whole model is drawn without binding a texture.
+class ModelBuffers
+{
+public:
+	//Builds all buffers for the model, the model's material textures must already be loaded
+	ModelBuffers(OBJModel* a_model);
+	~ModelBuffers();
+
+	//Layout matches the DrawElementsIndirectCommand structure read by glMultiDrawElementsIndirect
+	typedef struct DrawCommand
+	{
+		unsigned int count;
+		unsigned int instanceCount;
+		unsigned int firstIndex;
+		int baseVertex;
+		unsigned int baseInstance;
+	}DrawCommand;
+
+	//std430 layout of the per draw material parameters in the MaterialBuffer block of obj_fragment.glsl
+	typedef struct DrawMaterial
+	{
+		float kA[4];
+		float kD[4];
+		float kS[4];
+		uint64_t textureHandles[3];		//Bindless diffuse, specular and normal handles, 0 when not resident
+		uint32_t flags;					//MaterialFlags
+		uint32_t padding;				//std430 aligns the vec4 array below to 16 bytes
+		float uvTransforms[3][4];		//Scale in xy and offset in zw into an atlas page for each texture, identity otherwise
+	}DrawMaterial;
+	enum MaterialFlags
+	{
+		NormalMapXY = 1,				//The normal map only stores x and y (BC5), the shader rebuilds z
+	};
+
+	//CPU side state of each draw used to build sort keys
+	typedef struct DrawInfo
+	{
+		unsigned int textureIDs[3];		//Diffuse, specular and normal textures, all 0 when the draw uses bindless handles
+		glm::vec3 boundsMin;			//Model space bounds of the mesh
+		glm::vec3 boundsMax;
+		bool transparent;				//Material dissolve is below one
+		unsigned int mesh;				//Index of the source mesh in the model, used to rasterize occluders
+	}DrawInfo;
+
+	unsigned int GetVertexArray() const { return m_vertexArray; }
+	unsigned int GetMaterialBuffer() const { return m_materialBuffer; }
+	unsigned int GetDrawCount() const { return (unsigned int)m_commands.size(); }
+	const DrawCommand& GetDrawCommand(unsigned int a_draw) const { return m_commands[a_draw]; }
+	const DrawInfo& GetDrawInfo(unsigned int a_draw) const { return m_drawInfo[a_draw]; }
+	//Bytes of GPU memory used by the vertex, index and material buffers
+	size_t GetGPUMemory() const { return m_gpuMemory; }
+	//Model the buffers were built from, owned by whoever owns these buffers
+	const OBJModel* GetModel() const { return m_model; }
+	//Model space bounds of every mesh together
+	const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+	const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+	//True if the materials reference their textures by bindless handle and nothing needs binding to draw
+	bool UsesBindlessTextures() const { return m_bindlessTextures; }
+	//Rewrite the material buffer if textures finished streaming since it was written, bindless handles move from the
+	//placeholder to the real texture and the normal map format is only known once it has loaded
+	//Materials on an atlas page that failed to build are moved to their own textures here as well
+	void RefreshMaterials();
+	//Tell the texture manager every texture of the model is being drawn, keeping them from being trimmed
+	void MarkTexturesUsed() const;
+
+	//True if draws are submitted with multi-draw-indirect, false if they fall back to one draw per mesh
+	static bool UseMultiDrawIndirect();
+	//Allocate immutable storage when glBufferStorage is available, otherwise fall back to glBufferData
+	//a_flags are the glBufferStorage flags, GL_DYNAMIC_STORAGE_BIT for buffers later written with glBufferSubData
+	static void BufferStorage(unsigned int a_target, size_t a_size, const void* a_data, unsigned int a_flags = 0);
+
+	//Running count of bytes sent to the GPU by the renderer, reset once per frame to report bytes uploaded per frame
+	static size_t GetUploadedBytes() { return s_uploadedBytes; }
+	static void AddUploadedBytes(size_t a_bytes) { s_uploadedBytes += a_bytes; }
+	static void ResetUploadedBytes() { s_uploadedBytes = 0; }
+
+private:
+	//Fill the bindless handles, atlas UV transforms and texture dependent flags of a material from the textures it currently has
+	void SetMaterialTextures(DrawMaterial& a_material, const OBJMaterial* a_source) const;
+
+	OBJModel* m_model;
+	glm::vec3 m_boundsMin;
+	glm::vec3 m_boundsMax;
+	unsigned int m_vertexArray;
+	unsigned int m_vertexBuffer;
+	unsigned int m_indexBuffer;
+	unsigned int m_materialBuffer;
+	size_t m_gpuMemory;
+	bool m_bindlessTextures;
+	unsigned int m_textureGeneration;
+	std::vector<DrawCommand> m_commands;
+	std::vector<DrawInfo> m_drawInfo;
+	std::vector<DrawMaterial> m_materials;
+
+	static size_t s_uploadedBytes;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "OBJ_JobSystem.h"
+
+class OBJModel;
+class ModelBuffers;
+
+//A size bounded least-recently-used cache of loaded OBJ models
+//Models are keyed by their canonical path, a cached model keeps its texture references held in the
+//TextureManager so switching back to it does not touch the disk. Neighbouring files in the same
+//directory can be prefetched as background jobs so flipping through a folder is near instant.
+class ModelCache
+{
+public:
+	ModelCache(size_t a_budgetBytes = 256 * 1024 * 1024);
+	~ModelCache();
+
+	//Get a model from the cache, loading it if required - returns nullptr if the file could not be loaded
+	//The returned model becomes the current model and will not be evicted until another model is acquired
+	OBJModel* Acquire(const std::string& a_filename);
+	//Get the GPU buffers built for a cached model, returns nullptr if the model is not in the cache
+	ModelBuffers* GetBuffers(const OBJModel* a_model) const;
+	//Queue background loads of the files either side of a_filename in its directory
+	void PrefetchNeighbours(const std::string& a_filename, int a_range = 1);
+	//Get the next or previous OBJ file in the same directory as a_filename, wraps around
+	static std::string GetNeighbour(const std::string& a_filename, int a_offset);
+	//Finish any completed prefetches on the main thread and refresh materials of models whose textures finished
+	//streaming, call once per frame
+	void Update();
+	//Remove every model from the cache except the current model
+	void Clear();
+
+	size_t GetBudget() const { return m_budgetBytes; }
+	void SetBudget(size_t a_budgetBytes) { m_budgetBytes = a_budgetBytes; Evict(); }
+	size_t GetUsedBytes() const { return m_usedBytes; }
+	unsigned int GetEntryCount() const { return (unsigned int)m_entries.size(); }
+	unsigned int GetHitCount() const { return m_hits; }
+	unsigned int GetMissCount() const { return m_misses; }
+	unsigned int GetPrefetchHitCount() const { return m_prefetchHits; }
+
+private:
+	typedef struct CacheEntry
+	{
+		std::string key;
+		OBJModel* model;
+		ModelBuffers* buffers;
+		size_t bytes;
+	}CacheEntry;
+	typedef std::list<CacheEntry> EntryList;
+
+	//Canonical form of a path, so different spellings of the same file share a cache entry
+	static std::string CanonicalPath(const std::string& a_filename);
+	//Move a freshly loaded model into the cache, loading its textures and uploading its geometry
+	EntryList::iterator Insert(const std::string& a_key, OBJModel* a_model);
+	void Remove(EntryList::iterator a_entry);
+	//Evict least recently used entries until the cache is within budget
+	void Evict();
+	//Take a completed (or wait for a running) prefetch of a_key, returns nullptr if there is none or it had not started
+	OBJModel* TakePrefetched(const std::string& a_key);
+
+	//Most recently used entries are at the front of the list
+	EntryList m_entries;
+	std::map<std::string, EntryList::iterator> m_lookup;
+	OBJModel* m_current;
+	size_t m_budgetBytes;
+	size_t m_usedBytes;
+	unsigned int m_hits;
+	unsigned int m_misses;
+	unsigned int m_prefetchHits;
+
+	//Background prefetching, prefetches are low priority jobs so they never hold up a frame's jobs
+	//Each prefetch is shared with its job, so a cancelled prefetch that is still queued can run after it has left the
+	//cache (or the cache is gone) and only finds out it has nothing to do
+	enum PrefetchState
+	{
+		Prefetch_Queued = 0,
+		Prefetch_Running,
+		Prefetch_Complete,
+		Prefetch_Cancelled,
+	};
+	typedef struct Prefetch
+	{
+		std::atomic<int> state;
+		OBJModel* model;			//Only written by the job, read once the state is Prefetch_Complete
+		JobSystem::Counter job;
+	}Prefetch;
+	//Stop a prefetch that has not started, or wait for one that has. Returns true if it was cancelled
+	static bool CancelOrWait(Prefetch& a_prefetch);
+	//Only touched from the main thread, the jobs see nothing but their own Prefetch
+	std::map<std::string, std::shared_ptr<Prefetch>> m_prefetches;
+};
@@ -1,14 +1,23 @@
 #pragma once
 #include "Application.h"
 #include "ApplicationEvent.h"
+#include "OBJ_Loader.h"
+#include "OBJ_BatchLoader.h"
+#include "ShaderUtil.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 
-//Forward declare OBJ model and SkyBox
-class OBJModel;
+//Forward declare SkyBox and the model cache
 class Skybox;
+class ModelCache;
+class ModelBuffers;
+class RenderQueue;
+class Scene;
 
 class ModelRenderer : public Application
 {
@@ -17,12 +26,41 @@ public:
 	virtual ~ModelRenderer();
 
 	void OnWindowResize(WindowResizeEvent* e);
+
+	//Snapshot of the memory used by the renderer, all values are in bytes
+	typedef struct MemoryStats
+	{
+		OBJMemoryUsage modelCPU;	//CPU memory of the currently loaded model
+		size_t textureGPU;			//GPU memory of all textures held by the TextureManager
+		size_t skyboxGPU;			//GPU memory of the skybox cubemap and vertex buffer
+		size_t modelGPU;			//GPU memory of the vertex and index buffers of the current model
+		size_t modelCacheCPU;		//CPU memory of every model held in the model cache, including the current model
+		unsigned int textureCount;
+		unsigned int modelCacheEntries;
+	}MemoryStats;
+	//Programmatic query of current memory usage, suitable for external monitoring
+	MemoryStats GetMemoryStats() const;
+
 protected:
 	virtual bool OnCreate();
 	virtual void Update(float deltaTime);
 	virtual void Draw();
 	virtual void Destroy();
 
+	//ImGui panel displaying memory totals with a per mesh and per texture breakdown
+	void showMemoryData();
+	//ImGui panel to batch load a directory of models and report per file results
+	void showBatchLoader();
+	//Load the textures of the batch's models on the main thread
+	void LoadBatchTextures();
+	//Once none of the batch's textures are still streaming, record the ones that failed in the results and release
+	//the models, returns false while textures are still streaming
+	bool ReleaseBatchTextures();
+	//Draw timing and upload statistics added to the frame data overlay
+	virtual void showFrameStats();
+	//Rebuild the scene hierarchy for the current model and instance grid
+	void BuildScene();
+
 private:
 	//Structure for a simple vertex - interleaved (position, colour)
 	typedef struct Vertex
@@ -44,22 +82,69 @@ private:
 	//Shader programs
 	unsigned int m_uiProgram;
 	unsigned int m_objProgram;
+	unsigned int m_depthProgram;	//obj vertex shader with an empty fragment shader for the depth pre-pass
+	//std140 layout of the FrameData uniform block shared by every shader, written once per frame
+	typedef struct FrameData
+	{
+		glm::mat4 viewMatrix;
+		glm::mat4 projectionMatrix;
+		glm::mat4 projectionViewMatrix;
+		glm::vec4 cameraPosition;
+		glm::vec4 lightDirection;
+	}FrameData;
+	unsigned int m_frameDataBuffer;
+
+	//Model draws are sorted and submitted by the render queue, m_objProgramSlot is the obj program's slot in it
+	RenderQueue* m_renderQueue;
+	unsigned int m_objProgramSlot;
 	unsigned int m_lineVBO;
-	unsigned int m_objModelBuffer[2];
+	unsigned int m_lineVAO;
 	bool m_renderSkybox;
+	//Depth only pre-pass before shading the model, with the skybox drawn last instead of first
+	bool m_depthPrepass;
+	//Smoothed GPU time of the skybox and model passes for each ordering, 0 without and 1 with the pre-pass
+	float m_renderOrderMs[2];
+	unsigned int m_renderOrderFrames;	//Frames since the ordering last changed
 
 	//Model variables
 	std::string m_currentFile;
 	std::string m_previousFile;
 	float m_scale;
+	glm::vec3 m_modelTranslation;
+	glm::vec3 m_modelRotation;	//Degrees
+	//Copies of the model are laid out on an m_instanceGrid x m_instanceGrid grid and drawn instanced
+	int m_instanceGrid;
+	bool m_tintInstances;
+
+	//The model and its copies are children of one root node that takes the UI transform
+	//The scene is rebuilt when the model, grid size or tinting changes
+	Scene* m_scene;
+	unsigned int m_sceneRoot;
+	const ModelBuffers* m_sceneBuffers;
+	int m_sceneGrid;
+	bool m_sceneTinted;
 
-	//Model
+	//Model - owned by the model cache
 	OBJModel* m_objModel;
-	Line* lines;
+	ModelBuffers* m_objBuffers;
+	ModelCache* m_modelCache;
 
 	//Skybox
 	Skybox* m_skybox;
 
 	//Panel Stuff
 	glm::vec3 m_backgroundColour;
+
+	//Frame statistics from the last frame
+	float m_drawTimeMs;				//CPU time spent in Draw
+	size_t m_frameUploadBytes;		//Bytes of buffer data sent to the GPU
+	unsigned int m_frameDrawCalls;
+
+	//Batch loading
+	OBJBatchLoader* m_batchLoader;
+	std::thread m_batchThread;
+	bool m_batchRunning;
+	std::atomic<bool> m_batchComplete;
+	std::vector<OBJBatchResult> m_batchResults;
+	unsigned int m_batchUniqueTextures;
 };
\ No newline at end of file
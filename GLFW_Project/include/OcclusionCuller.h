@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+//Forward declarations
+class OBJMesh;
+
+//Software occlusion culling against a low resolution depth buffer rendered on the CPU
+//A few large occluder meshes are transformed and rasterized each frame into a Width x Height depth buffer, the
+//buffer is split into horizontal bands that are rasterized in parallel with SSE four pixels at a time.
+//A max depth pyramid (hierarchical Z) is built from the result and world space boxes are tested against the
+//level where they cover only a few texels. Nothing here touches the GL context so it can run headless.
+class OcclusionCuller
+{
+public:
+	static const unsigned int Width = 256;
+	static const unsigned int Height = 128;
+	//Rows of the depth buffer each raster task owns
+	static const unsigned int BandHeight = 16;
+
+	//Per frame counts, the raster time covers transform, rasterization and the depth pyramid
+	typedef struct Stats
+	{
+		unsigned int occluders;
+		unsigned int occluderTriangles;
+		unsigned int tested;
+		unsigned int occluded;
+		float rasterMs;
+	}Stats;
+
+	//Occluders are transformed and bands rasterized on the shared JobSystem
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	//Clear the depth buffer and occluders for a new frame
+	void Begin(const glm::mat4& a_projectionView);
+	//Queue every triangle of a mesh to be rendered into the depth buffer, the mesh must outlive Rasterize
+	void AddOccluder(const OBJMesh* a_mesh, const glm::mat4& a_worldMatrix);
+	//Transform and rasterize the queued occluders on the worker threads then build the depth pyramid
+	void Rasterize();
+	//True if a world space box is entirely behind the rasterized occluders
+	bool IsOccluded(const glm::vec3& a_centre, const glm::vec3& a_extent);
+
+	//Depth of each pixel from 0 at the near plane to 1 at the far plane, rows run bottom to top
+	const float* GetDepthBuffer() const { return m_depth[0].data(); }
+	const Stats& GetStats() const { return m_stats; }
+
+	bool IsEnabled() const { return m_enabled; }
+	void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+	//Only meshes covering at least this many pixels on screen and no more than the triangle limit become occluders
+	float GetOccluderMinPixels() const { return m_occluderMinPixels; }
+	void SetOccluderMinPixels(float a_pixels) { m_occluderMinPixels = a_pixels; }
+	unsigned int GetMaxOccluderTriangles() const { return m_maxOccluderTriangles; }
+	unsigned int GetMaxOccluders() const { return m_maxOccluders; }
+
+private:
+	//Copying would share the worker pool
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator = (const OcclusionCuller&) = delete;
+
+	typedef struct Occluder
+	{
+		const OBJMesh* mesh;
+		glm::mat4 clipMatrix;			//World matrix premultiplied by the projection-view
+		unsigned int firstTriangle;		//Offset of the mesh's triangles in m_triangles
+	}Occluder;
+
+	//Screen space triangle ready for rasterization, culled triangles are flagged rather than removed
+	typedef struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		bool valid;
+	}ScreenTriangle;
+
+	void TransformOccluder(const Occluder& a_occluder);
+	void RasterizeBand(unsigned int a_firstRow, unsigned int a_lastRow);
+	void BuildPyramid();
+
+	glm::mat4 m_projectionView;
+	std::vector<Occluder> m_occluders;
+	std::vector<ScreenTriangle> m_triangles;
+	//Level 0 is the full resolution depth buffer, every following level holds the max of 2x2 texels of the last
+	std::vector<std::vector<float>> m_depth;
+
+	bool m_enabled;
+	float m_occluderMinPixels;
+	unsigned int m_maxOccluderTriangles;
+	unsigned int m_maxOccluders;
+	Stats m_stats;
+};
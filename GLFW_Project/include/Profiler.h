@@ -0,0 +1,127 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Frame profiler for nested CPU scopes and GPU render passes
+//CPU scopes can nest to any depth and are timed with the high resolution clock, scopes with the same path in one
+//frame are summed. GPU passes can not nest, each pass is timed with a GL_TIME_ELAPSED query and counts vertices,
+//primitives and fragment shader invocations with pipeline statistics queries when the driver supports them.
+//GPU queries are double buffered and only read once their results are available so the CPU never waits on the GPU,
+//GPU results are therefore one or two frames behind the CPU results.
+class Profiler
+{
+public:
+	//This profiler will act as a Singleton object for ease of access
+	static Profiler* CreateInstance();
+	static Profiler* GetInstance();
+	static void DestroyInstance();
+
+	//Number of frames kept for the rolling graphs
+	static const unsigned int HistoryLength = 120;
+
+	typedef struct CPUScopeResult
+	{
+		std::string name;
+		std::string path;		//Names of the enclosing scopes and this scope separated by '/'
+		unsigned int depth;
+		unsigned int calls;		//Times the scope was entered this frame
+		float ms;
+	}CPUScopeResult;
+
+	typedef struct GPUPassResult
+	{
+		std::string name;
+		float ms;
+		uint64_t verticesSubmitted;
+		uint64_t primitivesSubmitted;
+		uint64_t fragmentInvocations;
+	}GPUPassResult;
+
+	//Times a CPU scope for as long as it is alive
+	class CPUScope
+	{
+	public:
+		CPUScope(const char* a_name) { Profiler::GetInstance()->BeginScope(a_name); }
+		~CPUScope() { Profiler::GetInstance()->EndScope(); }
+	};
+	//Times a GPU pass for as long as it is alive
+	class GPUScope
+	{
+	public:
+		GPUScope(const char* a_name) { Profiler::GetInstance()->BeginGPUPass(a_name); }
+		~GPUScope() { Profiler::GetInstance()->EndGPUPass(); }
+	};
+
+	//Frames are bracketed by BeginFrame and EndFrame, results are published at EndFrame
+	void BeginFrame();
+	void EndFrame();
+	void BeginScope(const char* a_name);
+	void EndScope();
+	//Queries are created on first use so this needs the GL context current
+	void BeginGPUPass(const char* a_name);
+	void EndGPUPass();
+
+	//Results of the last completed frame, CPU scopes are in depth first order
+	const std::vector<CPUScopeResult>& GetCPUResults() const { return m_cpuResults; }
+	const std::vector<GPUPassResult>& GetGPUResults() const { return m_gpuResults; }
+	float GetFrameTime() const { return m_frameMs; }
+	//Time of a scope by path such as "Draw/Culling", returns 0 if the scope did not run last frame
+	float GetCPUTime(const std::string& a_path) const;
+	float GetGPUTime(const std::string& a_pass) const;
+	//Rolling history of a scope, pass or the whole frame, the oldest sample is at GetHistoryOffset
+	//Returns nullptr if nothing has been recorded under that name
+	const float* GetCPUHistory(const std::string& a_path) const;
+	const float* GetGPUHistory(const std::string& a_pass) const;
+	const float* GetFrameHistory() const { return m_frameHistory.data(); }
+	unsigned int GetHistoryOffset() const { return m_historyOffset; }
+	bool HasPipelineStatistics() const { return m_pipelineStatistics; }
+
+private:
+	Profiler();
+	~Profiler();
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	typedef struct ScopeRecord
+	{
+		const char* name;
+		int parent;
+		Clock::time_point start;
+		float ms;
+	}ScopeRecord;
+
+	//Per pass queries for both frames in flight: elapsed time then vertices, primitives and fragments
+	typedef struct GPUPass
+	{
+		std::string name;
+		unsigned int queries[2][4];
+		bool pending[2];
+		GPUPassResult result;
+		std::vector<float> history;
+	}GPUPass;
+
+	void ResolveGPUPass(GPUPass& a_pass, unsigned int a_set);
+	std::string GetPath(int a_record) const;
+
+	static Profiler* m_instance;
+
+	//This frame's scopes in the order they were entered and the scopes currently open
+	std::vector<ScopeRecord> m_records;
+	std::vector<int> m_openScopes;
+	std::vector<CPUScopeResult> m_cpuResults;
+	std::vector<std::pair<std::string, std::vector<float>>> m_cpuHistory;
+
+	std::vector<GPUPass> m_gpuPasses;
+	std::vector<GPUPassResult> m_gpuResults;
+	int m_activePass;				//-1 when no pass is being timed, or the open pass is still waiting on its old queries
+	unsigned int m_gpuPassDepth;	//Nested passes are folded into the outermost one
+	bool m_pipelineStatistics;
+
+	Clock::time_point m_frameStart;
+	float m_frameMs;
+	std::vector<float> m_frameHistory;
+	unsigned int m_historyOffset;
+	uint64_t m_frameIndex;
+};
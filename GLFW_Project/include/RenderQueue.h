@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <array>
+#include <glm/glm.hpp>
+#include "ShaderUtil.h"
+#include "ModelBuffers.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+
+//Collects every mesh draw of a frame, sorts them by a 64 bit key and submits them with as few state changes as possible
+//Key layout from the most significant bit:
+//	opaque:			pass (2) | program (6) | texture set (16) | model (8) | depth (24) | unused (8)
+//	transparent:	pass (2) | inverted depth (24) | program (6) | texture set (16) | model (8) | unused (8)
+//Opaque draws sort by state first and front-to-back within a state bucket for early depth rejection. Transparent
+//draws sort back-to-front across every state, so they blend in the right order at the cost of more state changes.
+//Runs of draws that share all of their state are submitted with a single glMultiDrawElementsIndirect.
+//Every submission is instanced, world matrices and tints of the surviving instances of each mesh are written to a
+//per frame instance buffer and each mesh is drawn once with an instance count, so the number of draw calls does
+//not grow with the number of copies of a model.
+//Draws whose world space bounds are outside the frustum or too small on screen are culled before sorting, the
+//largest remaining opaque meshes are then rasterized on the CPU as occluders and hidden draws are dropped too.
+//With the depth pre-pass enabled opaque draws are first drawn depth only, then shaded with GL_EQUAL depth testing
+//so the lit fragment shader runs once per covered pixel however much the opaque geometry overlaps.
+class RenderQueue
+{
+public:
+	enum Pass
+	{
+		OpaquePass = 0,
+		TransparentPass,
+	};
+
+	//A program that queued draws can use along with the handles the queue sets for each draw call
+	typedef struct ProgramUniforms
+	{
+		unsigned int program;
+		ShaderUniform<int> drawBase;
+		ShaderUniform<int> instanceBase;	//Only read by shaders without shader draw parameters
+	}ProgramUniforms;
+
+	//One copy of a model, the tint multiplies the diffuse colour
+	typedef struct Instance
+	{
+		glm::mat4 worldMatrix;
+		glm::vec4 tint;
+	}Instance;
+
+	//Per frame submission counters, binds saved compares against binding everything for every draw
+	typedef struct Stats
+	{
+		unsigned int draws;				//Meshes queued, each instance of a mesh counts once
+		unsigned int instances;			//Mesh instances left to draw after culling
+		unsigned int drawCalls;			//GL draw calls issued, including the depth pre-pass
+		unsigned int prepassDrawCalls;
+		unsigned int programBinds;
+		unsigned int vertexArrayBinds;
+		unsigned int materialBinds;
+		unsigned int textureBinds;
+		unsigned int bindsSaved;
+	}Stats;
+
+	RenderQueue();
+	~RenderQueue();
+
+	//Register a program, the returned slot is used when submitting draws
+	unsigned int AddProgram(const ProgramUniforms& a_program);
+	//Depth only program used for a slot's opaque draws in the pre-pass, it must share the slot's vertex shader so the
+	//depth it writes matches the shading pass exactly. Draws of slots without one are shaded with normal depth testing
+	void SetDepthProgram(unsigned int a_programSlot, const ProgramUniforms& a_depthProgram);
+	void SetDepthPrepass(bool a_enabled) { m_depthPrepass = a_enabled; }
+	bool UsesDepthPrepass() const { return m_depthPrepass; }
+	//Clear the queue for a new frame, the view matrix and far plane are used to quantise draw depth
+	//The projection and viewport height set up the culling frustum and projected size test
+	void Begin(const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_farPlane, float a_viewportHeight);
+	//Queue every draw of a model once per instance, the geometry is shared and each mesh is one instanced draw
+	void SubmitInstanced(unsigned int a_programSlot, const ModelBuffers* a_buffers, const Instance* a_instances, unsigned int a_instanceCount);
+	//Cull, sort and upload everything queued since Begin, then draw the depth pre-pass and the opaque draws
+	void ExecuteOpaque();
+	//Draw the transparent draws over everything drawn so far, back-to-front, and finish the frame's queue
+	//Anything that must show through transparent surfaces, such as the skybox, is drawn between the two calls
+	void ExecuteTransparent();
+
+	const Stats& GetStats() const { return m_stats; }
+	FrustumCuller& GetCuller() { return m_culler; }
+	OcclusionCuller& GetOcclusionCuller() { return m_occlusionCuller; }
+
+	static uint64_t MakeKey(Pass a_pass, unsigned int a_program, unsigned int a_textureSet, unsigned int a_model, float a_depth);
+
+private:
+	//One mesh of a submission drawn for every instance that survived culling
+	typedef struct RenderItem
+	{
+		const ModelBuffers* buffers;
+		unsigned int draw;
+		unsigned int program;
+		unsigned int firstInstance;		//Offset into this frame's instance buffer
+		unsigned int instanceCount;
+	}RenderItem;
+
+	typedef struct Submission
+	{
+		const ModelBuffers* buffers;
+		unsigned int program;
+		unsigned int modelSlot;
+		unsigned int firstInstance;		//Offset into m_instances
+		unsigned int instanceCount;
+		unsigned int firstBox;			//Culling box of draw d, instance i is firstBox + d * instanceCount + i
+	}Submission;
+
+	//std430 layout of the Instance structure of obj_vertex.glsl, a mat3 is stored as three padded columns
+	typedef struct InstanceData
+	{
+		float worldMatrix[16];
+		float normalMatrix[12];
+		float tint[4];
+	}InstanceData;
+
+	typedef struct SortEntry
+	{
+		uint64_t key;
+		unsigned int item;
+	}SortEntry;
+
+	//Least significant digit radix sort on 8 bit digits, digits every key shares are skipped
+	static void RadixSort(std::vector<SortEntry>& a_entries, std::vector<SortEntry>& a_scratch);
+	//Small stable ID for a set of textures so draws sharing textures land next to each other
+	unsigned int GetTextureSet(const unsigned int* a_textureIDs);
+	//Rasterize the largest frustum visible opaque boxes and mark the boxes they hide as culled
+	void CullOccluded();
+	//Gather the surviving instances of every submitted mesh into render items and sort entries
+	void BuildItems();
+	//Lay down depth for the first a_opaqueCount sorted entries with the slots' depth programs
+	void DrawDepthPrepass(unsigned int a_opaqueCount);
+	//Shade sorted entries [a_first, a_last) in runs, only binding what changes between runs
+	void DrawShaded(unsigned int a_first, unsigned int a_last);
+	//Set the depth test for shading sorted entries [a_first, a_last) then draw them
+	void DrawShadedRun(unsigned int a_first, unsigned int a_last);
+	//Draw sorted entries [a_first, a_last) which all share the same state with the given program's handles
+	void DrawRun(unsigned int a_first, unsigned int a_last, const ProgramUniforms& a_program);
+	static Pass GetPass(uint64_t a_key) { return (Pass)(a_key >> 62); }
+
+	std::vector<ProgramUniforms> m_programs;
+	std::vector<ProgramUniforms> m_depthPrograms;	//Program 0 where a slot has no depth program
+	bool m_depthPrepass;
+	std::vector<Submission> m_submissions;
+	std::vector<InstanceData> m_instances;
+	//Submission, draw and instance of every culling box along with its normalised view depth
+	std::vector<unsigned int> m_boxSubmission;
+	std::vector<float> m_boxDepth;
+	std::vector<RenderItem> m_items;
+	std::vector<SortEntry> m_sorted;
+	std::vector<SortEntry> m_scratch;
+	unsigned int m_opaqueCount;		//Sorted entries before the first transparent one
+	std::vector<const ModelBuffers*> m_frameModels;
+	std::map<std::array<unsigned int, 3>, unsigned int> m_textureSets;
+	FrustumCuller m_culler;
+	OcclusionCuller m_occlusionCuller;
+	std::vector<unsigned char> m_occluded;
+	glm::mat4 m_projectionView;
+	glm::mat4 m_viewMatrix;
+	float m_farPlane;
+
+	//Sorted draw commands and the material index of each draw, uploaded once per frame
+	std::vector<ModelBuffers::DrawCommand> m_commands;
+	std::vector<unsigned int> m_drawMaterials;
+	std::vector<InstanceData> m_frameInstances;
+	unsigned int m_commandBuffer;
+	unsigned int m_drawBuffer;
+	unsigned int m_instanceBuffer;
+	size_t m_commandBufferSize;
+	size_t m_drawBufferSize;
+	size_t m_instanceBufferSize;
+
+	Stats m_stats;
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "FrustumCuller.h"
+#include "RenderQueue.h"
+
+//Forward declarations
+class ModelBuffers;
+
+//A hierarchy of placed models stored as flat structure-of-arrays
+//Nodes are kept sorted by their depth in the hierarchy so every parent is updated before its children and each
+//level can be updated in parallel without locking. Changing a node's transform marks it dirty, Update only
+//recomputes the world matrices and bounds of dirty nodes and their descendants.
+//Nodes are addressed by a stable ID, the array slot of a node changes whenever the hierarchy is re-sorted.
+class Scene
+{
+public:
+	typedef unsigned int NodeID;
+	static const NodeID InvalidNode = 0xFFFFFFFF;
+
+	//Per frame counts, visible nodes are those with a model that passed the frustum test in Submit
+	typedef struct Stats
+	{
+		unsigned int nodes;
+		unsigned int levels;
+		unsigned int updated;
+		unsigned int visible;
+		float updateMs;
+	}Stats;
+
+	//Large levels are updated on the shared JobSystem
+	Scene();
+	~Scene();
+
+	//Add a node under a parent, or at the root with InvalidNode. The model may be null for a pure transform node
+	NodeID CreateNode(NodeID a_parent = InvalidNode, const ModelBuffers* a_model = nullptr);
+	//Remove a node and every node below it
+	void RemoveNode(NodeID a_node);
+	void Clear();
+
+	//Local transform relative to the parent, applied as scale, then rotation (radians, y then x then z), then translation
+	void SetLocalTransform(NodeID a_node, const glm::vec3& a_translation, const glm::vec3& a_rotation, const glm::vec3& a_scale);
+	void SetModel(NodeID a_node, const ModelBuffers* a_model);
+	void SetTint(NodeID a_node, const glm::vec4& a_tint);
+	//World matrix as of the last Update
+	const glm::mat4& GetWorldMatrix(NodeID a_node) const { return m_world[m_slotOf[a_node]]; }
+	bool IsValid(NodeID a_node) const { return a_node < m_slotOf.size() && m_slotOf[a_node] != InvalidNode; }
+
+	//Re-sort the hierarchy if nodes were added or removed then update dirty subtrees one level at a time
+	void Update();
+	//Frustum test every node with a model and queue the visible ones, nodes sharing a model become one instanced submission
+	void Submit(RenderQueue& a_queue, unsigned int a_programSlot, const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_viewportHeight);
+
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	//Copying would share the worker pool
+	Scene(const Scene&) = delete;
+	Scene& operator = (const Scene&) = delete;
+
+	//Sort slots by depth, drop removed subtrees and rebuild the level ranges
+	void Reorder();
+	//Update the world matrix and bounds of dirty nodes in slots [a_first, a_last), returns the number updated
+	unsigned int UpdateRange(unsigned int a_first, unsigned int a_last);
+
+	//Node data indexed by slot
+	std::vector<unsigned int> m_parent;		//Slot of the parent or InvalidNode
+	std::vector<unsigned int> m_depth;
+	std::vector<glm::vec3> m_translation;
+	std::vector<glm::vec3> m_rotation;
+	std::vector<glm::vec3> m_scale;
+	std::vector<glm::vec4> m_tint;
+	std::vector<glm::mat4> m_world;
+	std::vector<glm::vec3> m_boundsMin;		//World space bounds of the node's model
+	std::vector<glm::vec3> m_boundsMax;
+	std::vector<const ModelBuffers*> m_model;
+	std::vector<unsigned char> m_dirty;
+	std::vector<unsigned char> m_removed;
+	std::vector<NodeID> m_idOf;
+
+	//Slot of every node ID, InvalidNode once removed
+	std::vector<unsigned int> m_slotOf;
+	//First slot of every depth level with one extra entry for the end of the last level
+	std::vector<unsigned int> m_levelStart;
+	bool m_orderDirty;
+
+	//Submission scratch, the instances of each model seen this frame
+	FrustumCuller m_culler;
+	std::vector<unsigned int> m_cullSlots;
+	std::vector<std::pair<const ModelBuffers*, std::vector<RenderQueue::Instance>>> m_batches;
+
+	Stats m_stats;
+};
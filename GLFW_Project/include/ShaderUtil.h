@@ -1,5 +1,70 @@
 #pragma once
 #include <vector>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <glm/fwd.hpp>
+
+//An active uniform found when its program was linked
+typedef struct ShaderUniformInfo
+{
+	int location;
+	unsigned int type;	//GL type enum, e.g. GL_FLOAT_MAT4
+	int arraySize;
+}ShaderUniformInfo;
+
+//An active uniform block or shader storage block found when its program was linked
+typedef struct ShaderBlockInfo
+{
+	unsigned int index;
+	int binding;
+	int dataSize;
+	bool storage;		//True for shader storage blocks, false for uniform blocks
+}ShaderBlockInfo;
+
+//Everything reflected from a linked program, looked up by name
+typedef struct ShaderProgramInfo
+{
+	std::unordered_map<std::string, ShaderUniformInfo> uniforms;
+	std::unordered_map<std::string, ShaderBlockInfo> blocks;
+}ShaderProgramInfo;
+
+//A pre-resolved handle to a uniform of type T, resolve it once with ShaderUtil::GetUniform and set it every frame
+//without any string lookups. Handles to uniforms that are not active in the program are invalid and ignore Set.
+template <typename T>
+class ShaderUniform
+{
+public:
+	ShaderUniform() : m_location(-1) {}
+	explicit ShaderUniform(int a_location) : m_location(a_location) {}
+
+	bool IsValid() const { return m_location >= 0; }
+	int GetLocation() const { return m_location; }
+	//Set the value on the currently bound program
+	void Set(const T& a_value) const;
+	//True if a uniform of the reflected GL type can be set through this handle
+	static bool Accepts(unsigned int a_type);
+
+private:
+	int m_location;
+};
+//Supported uniform types, defined in ShaderUtil.cpp
+template<> void ShaderUniform<int>::Set(const int& a_value) const;
+template<> void ShaderUniform<unsigned int>::Set(const unsigned int& a_value) const;
+template<> void ShaderUniform<float>::Set(const float& a_value) const;
+template<> void ShaderUniform<glm::vec2>::Set(const glm::vec2& a_value) const;
+template<> void ShaderUniform<glm::vec3>::Set(const glm::vec3& a_value) const;
+template<> void ShaderUniform<glm::vec4>::Set(const glm::vec4& a_value) const;
+template<> void ShaderUniform<glm::mat3>::Set(const glm::mat3& a_value) const;
+template<> void ShaderUniform<glm::mat4>::Set(const glm::mat4& a_value) const;
+template<> bool ShaderUniform<int>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<unsigned int>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<float>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<glm::vec2>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<glm::vec3>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<glm::vec4>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<glm::mat3>::Accepts(unsigned int a_type);
+template<> bool ShaderUniform<glm::mat4>::Accepts(unsigned int a_type);
 
 class ShaderUtil
 {
@@ -12,6 +77,19 @@ public:
 	static unsigned int CreateProgram(const int& a_vertexShader, const int& a_fragmentShader);
 	static void DeleteProgram(unsigned int a_program);
 
+	//Reflection data gathered when the program was linked, returns nullptr for unknown programs or names
+	static const ShaderProgramInfo* GetProgramInfo(unsigned int a_program);
+	static const ShaderUniformInfo* FindUniform(unsigned int a_program, const char* a_name);
+	static const ShaderBlockInfo* FindBlock(unsigned int a_program, const char* a_name);
+	//Resolve a typed uniform handle, the handle is invalid if the uniform is inactive or declared with a different type
+	template <typename T>
+	static ShaderUniform<T> GetUniform(unsigned int a_program, const char* a_name);
+	//Point a program's uniform block at a uniform buffer binding, returns false if the block is not active
+	static bool BindUniformBlock(unsigned int a_program, const char* a_name, unsigned int a_binding);
+
+	//Uniform buffer binding points shared by every program
+	static const unsigned int FrameDataBinding = 0;
+
 private:
 	//private Constructor and Destructor
 	//ShaderUtil implements a Singleton Design Pattern
@@ -25,5 +103,26 @@ private:
 	void DeleteShaderInternal(unsigned int a_shaderID);
 	unsigned int CreateProgramInternal(const int& a_vertexShader, const int& a_fragmentShader);
 	void DeleteProgramInternal(unsigned int a_program);
+	//Query every active uniform and block of a linked program into mProgramInfo
+	void ReflectProgram(unsigned int a_program);
+	static void ReportTypeMismatch(unsigned int a_program, const char* a_name);
+
+	std::map<unsigned int, ShaderProgramInfo> mProgramInfo;
 	static ShaderUtil* mInstance;
-};
\ No newline at end of file
+};
+
+template <typename T>
+ShaderUniform<T> ShaderUtil::GetUniform(unsigned int a_program, const char* a_name)
+{
+	const ShaderUniformInfo* info = FindUniform(a_program, a_name);
+	if (info == nullptr)
+	{
+		return ShaderUniform<T>();
+	}
+	if (!ShaderUniform<T>::Accepts(info->type))
+	{
+		ReportTypeMismatch(a_program, a_name);
+		return ShaderUniform<T>();
+	}
+	return ShaderUniform<T>(info->location);
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <glm/fwd.hpp>
+#include "ShaderUtil.h"
 
 //Forward declaring the cubemap
 class CubeMap;
@@ -15,7 +16,13 @@ public:
 
 	//Functions
 	void SetupSkybox();
-	void RenderSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+	//The view and projection matrices are read from the FrameData uniform buffer
+	//The cube is drawn at maximum depth so it can go first or after the scene to skip pixels already covered
+	//Nothing is drawn until the cubemap has finished loading in the background
+	void RenderSkybox();
+	bool IsReady() const;
+	//Bytes of GPU memory used by the cube vertex buffer and cubemap texture
+	size_t GetGPUMemory() const;
 
 private:
 	//Skybox variables
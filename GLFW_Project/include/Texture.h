@@ -1,6 +1,20 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <atomic>
+#include "TextureCompressor.h"
+#include "OBJ_JobSystem.h"
+
+//CPU copy of every mip level of a texture, decoded away from the GL thread and uploaded level by level
+typedef struct TextureImage
+{
+	bool compressed;
+	TextureCompressor::Format format;	//Block format of the levels when compressed, otherwise they are RGBA8
+	unsigned int width;
+	unsigned int height;
+	std::vector<TextureCompressor::MipLevel> levels;
+}TextureImage;
 
 //A Class to store texture data
 //A texture is a data buffer that contains values which relate to pixel colours
@@ -12,19 +26,58 @@ public:
 	Texture();
 	~Texture();
 
-	//Function to load a texture from file
-	bool Load(std::string a_filename);
+	//Decode a texture file to its full mip chain without touching GL, safe to call from any thread
+	//With a_compress the chain is block compressed for its usage, from the compressed texture cache when the
+	//source file has been compressed before, otherwise the levels are RGBA8
+	static bool Decode(const std::string& a_filename, TextureCompressor::Usage a_usage, bool a_compress, TextureImage& a_image);
+	//Read the dimensions of an image file from its header without decoding it
+	static bool ReadDimensions(const std::string& a_filename, unsigned int& a_width, unsigned int& a_height);
+	//Decode an image file to flipped RGBA8 pixels only, safe to call from any thread
+	static bool DecodePixels(const std::string& a_filename, std::vector<unsigned char>& a_pixels, unsigned int& a_width, unsigned int& a_height);
+
+	//Function to load a texture from file, decodes and uploads every level before returning
+	bool Load(std::string a_filename, TextureCompressor::Usage a_usage = TextureCompressor::ColourUsage, bool a_compress = false);
 	void unload();
+	//Create the texture holding a 1x1 placeholder so its ID can be handed out before the file is decoded
+	void CreatePlaceholder(const std::string& a_filename);
+	//Upload one level of a decoded image, a_pixels points to client memory or is an offset into the bound pixel unpack buffer
+	//Levels go up from the smallest and the texture samples from the largest level uploaded so far
+	void UploadLevel(const TextureImage& a_image, unsigned int a_level, const void* a_pixels);
+	//True once level 0 has been uploaded, until then the texture samples the placeholder or a partial mip chain
+	bool IsReady() const { return m_ready; }
+	//Largest level on the GPU, greater than 0 while the texture is still streaming or has been trimmed
+	unsigned int GetBaseLevel() const { return m_baseLevel; }
+	//Free every level larger than a_baseLevel, the texture samples from a_baseLevel until they are streamed back in
+	//Returns false if the texture can not be trimmed, a texture with a bindless handle can no longer change its levels
+	bool Trim(unsigned int a_baseLevel);
 	//get file name
 	const std::string& GetFileName() const { return m_filename; }
 	unsigned int GetTextureID() const { return m_textureID; }
 	void GetDimensions(unsigned int& a_w, unsigned int& a_h) const;
+	unsigned int GetMipLevels() const { return m_mipLevels; }
+	//Bytes of GPU memory used by the levels uploaded so far
+	size_t GetGPUMemory() const { return m_gpuBytes; }
+	bool IsCompressed() const { return m_compressed; }
+	TextureCompressor::Format GetCompressedFormat() const { return m_compressedFormat; }
+	//Name of the storage format such as "RGBA8" or "BC1"
+	const char* GetFormatName() const { return m_compressed ? TextureCompressor::GetFormatName(m_compressedFormat) : "RGBA8"; }
+	//Resident ARB_bindless_texture handle, created on first request - returns 0 if bindless textures are unsupported
+	//The texture's parameters and storage can not change once a handle exists so a texture still streaming has none
+	uint64_t GetBindlessHandle();
+	bool HasBindlessHandle() const { return m_bindlessHandle != 0; }
 
 private:
 	std::string m_filename;
 	unsigned int m_width;
 	unsigned int m_height;
+	unsigned int m_mipLevels;
+	unsigned int m_baseLevel;
 	unsigned int m_textureID;
+	uint64_t m_bindlessHandle;
+	bool m_ready;
+	bool m_compressed;
+	TextureCompressor::Format m_compressedFormat;
+	size_t m_gpuBytes;
 };
 
 inline void Texture::GetDimensions(unsigned int& a_w, unsigned int& a_h) const
@@ -32,20 +85,56 @@ inline void Texture::GetDimensions(unsigned int& a_w, unsigned int& a_h) const
 	a_w = m_width; a_h = m_height;
 }
 
+//A six face cubemap loaded in the background
+//The faces are decoded concurrently as background jobs from memory mapped files as soon as the cubemap is constructed,
+//the GL thread only uploads faces once they are decoded so the first frames are never held up by the skybox
 class CubeMap
 {
 public:
 	CubeMap();
 	~CubeMap();
 
+	//Upload any decoded faces, at most one face per call so large face sets are spread across frames
+	//Returns true once every face is on the GPU, the texture must not be sampled before then
+	bool Update();
+	bool IsReady() const { return m_ready; }
 	//Getter function
 	unsigned int GetCubeMapTexture() { return m_cubemapTextureID; }
+	//Bytes of GPU memory used by the six cubemap faces
+	size_t GetGPUMemory() const { return m_gpuMemory; }
 
 private:
-	//Cubemap Load Textures function
-	unsigned int LoadCubeMap(std::vector<std::string> faces);
+	enum FaceState
+	{
+		FacePending = 0,
+		FaceDecoded,
+		FaceFailed,
+		FaceUploaded,
+	};
+	//Pixels are written by a worker before the state becomes FaceDecoded and only read by the GL thread after
+	typedef struct CubeFace
+	{
+		unsigned char* data;
+		int width;
+		int height;
+		std::atomic<int> state;
+	}CubeFace;
+
+	//Cubemap Load Textures function, queues a decode of each face
+	void LoadCubeMap(const std::vector<std::string>& faces);
+	void DecodeFace(unsigned int a_face);
+	//Upload one decoded face, creating the texture storage from the first face
+	bool UploadFace(unsigned int a_face);
+	//Wait for the decode jobs and free any faces that were not uploaded
+	void FinishLoading();
 
 	//Cubemap Variables
 	std::vector<std::string> m_skyboxFaces;
+	CubeFace m_faces[6];
+	JobSystem::Counter m_decodeJobs;
+	std::atomic<bool> m_cancelled;
 	unsigned int m_cubemapTextureID;
+	size_t m_gpuMemory;
+	bool m_ready;
+	bool m_failed;
 };
\ No newline at end of file
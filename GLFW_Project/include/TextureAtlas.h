@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "TextureCompressor.h"
+
+struct TextureImage;
+
+//Packs small textures into shared atlas pages
+//Each texture is surrounded by a gutter of its own texels wrapped around its edges, and every rectangle is sized and
+//placed on a multiple of the gutter so the first mip levels never sample a neighbour. The page's mip chain is cut off
+//at the level where the gutter is one texel wide. Materials sample a packed texture through a scale and offset
+//applied to the fractional part of their UVs, so tiling textures still repeat within their rectangle.
+class TextureAtlas
+{
+public:
+	//Where one texture sits in a page, x and y are the corner inside the gutter
+	typedef struct Placement
+	{
+		std::string filename;
+		unsigned int width;
+		unsigned int height;
+		unsigned int x;
+		unsigned int y;
+	}Placement;
+
+	typedef struct Page
+	{
+		TextureCompressor::Usage usage;
+		std::vector<Placement> placements;
+	}Page;
+
+	//Textures no larger than this on either side are packed
+	static const unsigned int MaxEntrySize = 256;
+	static const unsigned int PageSize = 2048;
+	//Gutter of 8 texels keeps levels 0 to 3 free of bleeding between neighbours
+	static const unsigned int Gutter = 8;
+	static const unsigned int PageMipLevels = 4;
+
+	//Pack images (width and height set) into as few pages as possible, placing every image
+	static void Pack(const std::vector<Placement>& a_images, TextureCompressor::Usage a_usage, std::vector<Page>& a_pages);
+	//Decode every texture of a page into it and build the page's mip chain, safe to call from any thread
+	//Returns false if any of the page's textures can not be decoded, the page fails as a whole rather than show a hole
+	static bool BuildPage(const Page& a_page, bool a_compress, TextureImage& a_image);
+	//Scale in xy and offset in zw from a texture's own UVs to the page
+	static void GetUVTransform(const Placement& a_placement, float* a_transform);
+};
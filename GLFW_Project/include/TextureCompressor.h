@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//CPU block compression of RGBA8 images to BCn formats and a disk cache of the compressed mip chains
+//Colour maps become BC1, or BC3 when any pixel is not fully opaque, single channel maps become BC4 and normal maps
+//become BC5 holding only x and y. Compressed images are cached in a KTX2 style file of level index and block data
+//named by a hash of the source file, so an edited source is compressed again and an unchanged one never is.
+class TextureCompressor
+{
+public:
+	enum Format
+	{
+		BC1 = 0,
+		BC3,
+		BC4,
+		BC5,
+
+		Format_Count
+	};
+	//What a texture holds, decides the format it is compressed to
+	enum Usage
+	{
+		ColourUsage = 0,
+		SingleChannelUsage,
+		NormalUsage,
+
+		Usage_Count
+	};
+
+	typedef struct MipLevel
+	{
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned char> data;	//Blocks in row order, levels smaller than a block are padded to one - RGBA8 pixels when uncompressed
+	}MipLevel;
+
+	typedef struct CompressedImage
+	{
+		Format format;
+		unsigned int width;
+		unsigned int height;
+		std::vector<MipLevel> levels;
+	}CompressedImage;
+
+	//Pick the format for an image of the given usage
+	static Format ChooseFormat(const unsigned char* a_rgba, unsigned int a_width, unsigned int a_height, Usage a_usage);
+	//Compress every level of an RGBA8 mip chain, such as one built by MipGenerator
+	static void Compress(const std::vector<MipLevel>& a_levels, Format a_format, CompressedImage& a_image);
+
+	//Encode one 4x4 block of RGBA8 pixels, BC1 colour endpoints are fit along the principal axis of the block's colours
+	static void EncodeBC1(const unsigned char* a_block, unsigned char* a_output);
+	//Encode one 4x4 block of single channel values
+	static void EncodeBC4(const unsigned char* a_values, unsigned char* a_output);
+
+	//Bytes of one 4x4 block
+	static unsigned int GetBlockBytes(Format a_format) { return (a_format == BC1 || a_format == BC4) ? 8 : 16; }
+	static unsigned int GetGLFormat(Format a_format);
+	static const char* GetFormatName(Format a_format);
+
+	//64 bit FNV-1a hash of a source file's bytes, used as the cache key
+	static uint64_t HashBytes(const unsigned char* a_data, size_t a_size);
+	//Directory holding cached images, relative to the working directory like the other resources
+	static const char* CacheDirectory;
+	static std::string GetCachePath(uint64_t a_sourceHash, Usage a_usage);
+	//Returns false if the file is missing, from an older encoder or for a different source
+	static bool ReadCache(const std::string& a_path, uint64_t a_sourceHash, CompressedImage& a_image);
+	//Written to a temporary file and renamed so a reader never sees a partly written entry
+	static bool WriteCache(const std::string& a_path, uint64_t a_sourceHash, const CompressedImage& a_image);
+
+	//Bumped whenever the encoder output or file layout changes so stale entries are rebuilt
+	static const uint32_t CacheVersion = 2;
+};
@@ -1,9 +1,19 @@
 #pragma once
 #include <map>
+#include <set>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
 #include <string>
+#include <vector>
+#include "TextureCompressor.h"
 //Forward declare Texture as only a pointer will be needed here
 //and this avoids cyclic dependency
 class Texture;
+class TextureStreamer;
+struct TextureImage;
+class OBJModel;
+class OBJMaterial;
 
 class TextureManager
 {
@@ -16,24 +26,142 @@ public:
 
 	bool TextureExists(const char* a_pName);
 	//Load a Texture file --> Calls Texture::Load()
-	unsigned int LoadTexture(const char* a_pfilename);
+	//The usage picks the block compression format when texture compression is enabled
+	//When streaming the ID is returned straight away holding a placeholder, the file is loaded over the following frames
+	unsigned int LoadTexture(const char* a_pfilename, TextureCompressor::Usage a_usage = TextureCompressor::ColourUsage);
 	unsigned int GetTexture(const char* a_filename);
 
+	//Drop a reference, a texture with no references stays resident until the memory budget needs its space
 	void ReleaseTexture(unsigned int a_texture);
+	//The texture with a GL texture ID, nullptr if the manager does not hold it
+	const Texture* FindTexture(unsigned int a_texture) const;
+	//Record that a texture is being drawn this frame, a trimmed texture streams its dropped levels back in
+	void MarkUsed(unsigned int a_texture);
+	//Bindless handle to sample a texture through, the placeholder's handle until the texture has finished streaming
+	uint64_t GetBindlessHandle(unsigned int a_texture);
+
+	//Upload streamed textures within the frame's upload budget and bring texture memory back under budget
+	//Call once per frame
+	void Update();
+	//GPU bytes the textures are kept within. Least recently used textures are trimmed to their smaller mip levels
+	//first, then ones nobody references are evicted entirely. Referenced textures in use are never touched.
+	//A texture with a bindless handle can not change its levels, it counts against the budget but is only evicted.
+	//A budget of 0 leaves texture memory unlimited.
+	static const size_t DefaultMemoryBudget = 256 * 1024 * 1024;
+	size_t GetMemoryBudget() const { return m_budgetBytes; }
+	void SetMemoryBudget(size_t a_bytes) { m_budgetBytes = a_bytes; }
+	unsigned int GetTrimmedCount() const { return m_trimmedCount; }
+	unsigned int GetEvictedCount() const { return m_evictedCount; }
+	//Textures the last budget pass wanted to trim but could not as they have a bindless handle
+	unsigned int GetPinnedCount() const { return m_pinnedCount; }
+	//Bumped each time streamed textures become ready, holders of bindless handles or format dependent state
+	//compare it with the value they last saw to know when to refresh
+	unsigned int GetTextureGeneration() const { return m_textureGeneration; }
+	//When true LoadTexture returns immediately and textures are decoded on worker threads, otherwise the file is
+	//loaded before LoadTexture returns. Enabled by default.
+	bool UseStreaming() const { return m_streaming; }
+	void SetStreaming(bool a_enabled) { m_streaming = a_enabled; }
+	TextureStreamer* GetStreamer() const { return m_streamer; }
+
+	//Load every texture referenced by a model's materials and store the IDs in the materials
+	//Textures shared between models (or materials) are only loaded once and reference counted
+	//With the texture atlas on, small textures are packed into shared pages and the material's ID is the page's
+	void LoadMaterialTextures(OBJModel* a_model);
+	//Release the references taken by LoadMaterialTextures
+	void ReleaseMaterialTextures(OBJModel* a_model);
+	//Move a material's textures off atlas pages that failed to build, each is loaded on its own instead and the
+	//material's reference to the page is released. Returns true if any of the material's texture IDs changed.
+	//Failed pages bump the texture generation, so call this for each material when the generation changes
+	bool ReplaceFailedAtlasPages(OBJMaterial* a_material);
+	//When true LoadMaterialTextures also makes each texture resident and stores its bindless handle in the material
+	//so models can be drawn without binding textures. Enabled by default when ARB_bindless_texture is supported.
+	bool UseBindlessTextures() const { return m_bindless; }
+	void SetBindlessTextures(bool a_enabled);
+	//When true textures are block compressed on the CPU and cached on disk, later loads upload the cached blocks
+	//Enabled by default when the driver supports S3TC, textures already loaded keep the format they were loaded with
+	bool UseCompressedTextures() const { return m_compress; }
+	void SetCompressedTextures(bool a_enabled);
+	//When true LoadMaterialTextures packs textures no larger than TextureAtlas::MaxEntrySize into atlas pages, so
+	//materials with small textures share one texture object. Enabled by default, textures already loaded stay put.
+	bool UseTextureAtlas() const { return m_atlas; }
+	void SetTextureAtlas(bool a_enabled) { m_atlas = a_enabled; }
+	//Scale in xy and offset in zw from a texture's UVs to where it is sampled, identity unless it is in an atlas page
+	void GetUVTransform(const std::string& a_filename, float* a_transform) const;
+	unsigned int GetAtlasEntryCount() const { return (unsigned int)m_atlasEntries.size(); }
+	unsigned int GetAtlasPageCount() const;
+
+	//Memory accounting for each texture currently held by the manager
+	typedef struct TextureMemoryInfo
+	{
+		std::string filename;
+		unsigned int width;
+		unsigned int height;
+		unsigned int mipLevels;
+		unsigned int baseLevel;		//Largest level resident, above 0 when trimmed or still streaming
+		unsigned int refCount;
+		unsigned int framesUnused;
+		size_t gpuBytes;
+		const char* format;
+	}TextureMemoryInfo;
+	//Fills a_info with a per texture breakdown and returns the total GPU bytes of all textures
+	size_t GetMemoryUsage(std::vector<TextureMemoryInfo>& a_info) const;
+	size_t GetTotalGPUMemory() const;
+	unsigned int GetTextureCount() const { return (unsigned int)m_pTextureMap.size(); }
 
 private:
 
 	static TextureManager* m_instance;
 
 	//References count indicates how many pointers are
-	//currently pointing to this texture -> only unload at 0 refs
+	//currently pointing to this texture -> only evict at 0 refs
 	typedef struct TextureRef
 	{
 		Texture* pTexture;
 		unsigned int refCount;
+		unsigned int lastUsedFrame;
+		std::function<bool(TextureImage&)> decode;	//Kept to stream trimmed levels back in
 	}TextureRef;
+	typedef std::map<std::string, TextureRef> TextureMap;
+	//A texture packed into an atlas page
+	typedef struct AtlasEntry
+	{
+		unsigned int page;
+		float uvTransform[4];
+	}AtlasEntry;
+
+	//Create a texture named a_name filled by a_decode, streamed or loaded straight away, returns 0 if loading failed
+	unsigned int AddTexture(const std::string& a_name, std::function<bool(TextureImage&)> a_decode, unsigned int a_refCount);
+	//Remove a texture from both lookups and delete it, along with the atlas entries of a page
+	void EraseTexture(TextureMap::iterator a_entry);
+	//Pack the small textures of a model that are not loaded yet into new atlas pages
+	void PackMaterialTextures(OBJModel* a_model);
+	//Trim then evict least recently used textures until the textures fit the budget
+	void EnforceBudget();
+	//Drop the atlas entries of streamed pages that failed to build so their textures load on their own from now on
+	//Returns true if any page failed, the pages stay until the materials holding them have been moved off them
+	bool SplitFailedAtlasPages();
 
-	std::map<std::string, TextureRef> m_pTextureMap;
+	TextureMap m_pTextureMap;
+	//Reverse lookup from GL texture ID, map iterators stay valid until their own entry is erased
+	std::unordered_map<unsigned int, TextureMap::iterator> m_idLookup;
+	std::map<std::string, AtlasEntry> m_atlasEntries;
+	unsigned int m_atlasPagesCreated;
+	//Pages that failed to build and still have materials referencing them
+	std::set<unsigned int> m_failedPages;
+	unsigned int m_failuresSeen;
+	TextureStreamer* m_streamer;
+	//Sampled by bindless materials in place of textures still streaming
+	Texture* m_placeholder;
+	unsigned int m_textureGeneration;
+	unsigned int m_frame;
+	size_t m_budgetBytes;
+	unsigned int m_trimmedCount;
+	unsigned int m_evictedCount;
+	unsigned int m_pinnedCount;
+	bool m_bindless;
+	bool m_compress;
+	bool m_streaming;
+	bool m_atlas;
 
 	TextureManager();
 	~TextureManager();
@@ -0,0 +1,100 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Texture.h"
+#include "OBJ_JobSystem.h"
+
+//Streams textures onto the GPU without stalling the frame
+//Files are decoded (and block compressed or read from the compressed texture cache) as background jobs while the
+//texture samples a placeholder. Decoded levels are copied into a persistently mapped pixel unpack buffer ring and
+//uploaded from there, smallest level first, until the frame's upload budget is spent. Each frame's part of the ring
+//is fenced so it is only written again once the GPU has finished reading it.
+class TextureStreamer
+{
+public:
+	TextureStreamer(size_t a_ringBytes = 32 * 1024 * 1024, size_t a_frameBudgetBytes = 4 * 1024 * 1024);
+	~TextureStreamer();
+
+	//Fills an image on a worker thread, returns false if the source can not be read
+	typedef std::function<bool(TextureImage&)> DecodeFunction;
+	//Queue a decode for a texture, the texture must already hold its placeholder
+	//A ready texture that has been trimmed is requested again to stream back the levels it dropped
+	void Request(Texture* a_texture, DecodeFunction a_decode);
+	//Decode function reading a texture file with Texture::Decode
+	static DecodeFunction DecodeFile(const std::string& a_filename, TextureCompressor::Usage a_usage, bool a_compress);
+	//True from the request until the texture's last level is uploaded
+	bool IsStreaming(const Texture* a_texture) const;
+	//True once a texture's last request could not be decoded, until it is requested again or cancelled
+	bool HasFailed(const Texture* a_texture) const { return m_failed.find(a_texture) != m_failed.end(); }
+	//Drop any work queued for a texture that is about to be deleted
+	void Cancel(Texture* a_texture);
+	//Upload decoded levels until the frame budget is spent, call once per frame on the GL thread
+	//Returns the number of textures that became ready
+	unsigned int Update();
+
+	//Bytes uploaded per frame, a single level larger than the budget is still uploaded on its own in one frame
+	size_t GetFrameBudget() const { return m_frameBudget; }
+	void SetFrameBudget(size_t a_bytes) { m_frameBudget = a_bytes; }
+
+	typedef struct Stats
+	{
+		unsigned int decoding;		//Requested textures still waiting on a worker
+		unsigned int uploading;		//Decoded textures with levels left to upload
+		unsigned int completed;		//Textures finished since the streamer was created
+		unsigned int failed;		//Files that could not be read or decoded
+		size_t frameBytes;			//Bytes uploaded by the last Update
+		size_t ringBytes;			//Bytes of the ring still waiting on the GPU
+		size_t ringSize;			//Zero when the ring is unavailable and uploads come from client memory
+	}Stats;
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	//Written by a worker until it is queued as decoded, after that only touched by the GL thread
+	typedef struct StreamRequest
+	{
+		Texture* texture;
+		std::string filename;
+		DecodeFunction decode;
+		std::atomic<bool> cancelled;
+		bool success;
+		TextureImage image;
+		unsigned int nextLevel;
+	}StreamRequest;
+	typedef std::shared_ptr<StreamRequest> RequestPtr;
+	//A frame's writes to the ring and the fence signalled once the GPU has read them
+	typedef struct RingFrame
+	{
+		size_t bytes;
+		void* fence;	//GLsync
+	}RingFrame;
+
+	void Decode(RequestPtr a_request);
+	//Reserve ring space for a level, returns false if the ring has no room until the GPU catches up
+	bool Allocate(size_t a_size, size_t& a_offset);
+	//Release the ring space of frames the GPU has finished with
+	void RetireFrames();
+
+	JobSystem::Counter m_decodeJobs;
+	std::mutex m_decodedMutex;
+	std::vector<RequestPtr> m_decoded;
+	std::map<Texture*, RequestPtr> m_requests;
+	std::set<const Texture*> m_failed;
+	std::deque<RequestPtr> m_uploads;
+
+	unsigned int m_ringBuffer;
+	unsigned char* m_ringData;
+	size_t m_ringSize;
+	size_t m_ringHead;
+	size_t m_ringUsed;
+	size_t m_ringFrameBytes;
+	std::deque<RingFrame> m_ringFrames;
+	size_t m_frameBudget;
+	Stats m_stats;
+};
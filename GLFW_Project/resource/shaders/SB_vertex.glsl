@@ -3,11 +3,21 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 ProjectionMatrix;
-uniform mat4 View;
+//Per frame data shared by every program, layout must match ModelRenderer::FrameData
+layout(std140) uniform FrameData
+{
+    mat4 ViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 ProjectionViewMatrix;
+    vec4 CameraPosition;
+    vec4 LightDirection;
+};
 
 void main()
 {
     TexCoords = aPos;
-    gl_Position = ProjectionMatrix * View * vec4(aPos, 1.0);
+    //Remove translation from the view matrix so the skybox stays centred on the camera
+    vec4 position = ProjectionMatrix * mat4(mat3(ViewMatrix)) * vec4(aPos, 1.0);
+    //Setting z to w puts the cube on the far plane, drawn last it only shades pixels nothing else covered
+    gl_Position = position.xyww;
 }
\ No newline at end of file
@@ -0,0 +1,7 @@
+#version 430
+
+//Depth pre-pass, paired with obj_vertex.glsl so the depth written matches the shading pass exactly
+//Colour writes are masked off while this runs, only the depth test and write do any work
+void main()
+{
+}
@@ -1,16 +1,38 @@
-#version 400
+#version 430
+#extension GL_ARB_bindless_texture : enable
 
 smooth in vec4 vertPos;
 smooth in vec4 vertNormal;
 smooth in vec2 vertUV;
+flat in int vertMaterial;
+flat in vec4 vertTint;
 
 out vec4 outputColour;
 
-uniform vec4 camPos;
+//Per frame data shared by every program, layout must match ModelRenderer::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	mat4 ProjectionViewMatrix;
+	vec4 CameraPosition;
+	vec4 LightDirection;
+};
 
-uniform vec4 kA;
-uniform vec4 kD;
-uniform vec4 kS;
+//Material parameters for every draw of the model
+struct Material
+{
+	vec4 kA;
+	vec4 kD;
+	vec4 kS;
+	uvec2 textures[3];	//Bindless diffuse, specular and normal handles, zero when the texture is bound to a unit instead
+	uint flags;			//Bit 0 set when the normal map only stores x and y
+	vec4 uvTransforms[3];	//Scale in xy and offset in zw into the atlas page holding each texture
+};
+layout(std430, binding = 0) readonly buffer MaterialBuffer
+{
+	Material materials[];
+};
 //uniforms for texture data
 uniform sampler2D DiffuseTexture;
 uniform sampler2D SpecularTexture;
@@ -21,12 +43,30 @@ vec3 iA = vec3(0.25f, 0.25f, 0.25f);
 vec3 iD = vec3(1.f, 1.f, 1.f);
 vec3 iS = vec3(1.f, 1.f, 1.f);
 
-vec4 lightDir = normalize(vec4(0.f) - vec4(10.f, 8.f, 10.f, 0.f));
-
 void main()
 {
-	//Get texture data from UV coords
-	vec4 textureData = texture(NormalTexture, vertUV);
+	vec4 lightDir = LightDirection;
+	vec4 kA = materials[vertMaterial].kA;
+	vec4 kD = materials[vertMaterial].kD * vertTint;
+	vec4 kS = materials[vertMaterial].kS;
+	//Get texture data from UV coords, wrapped by hand within the texture's rectangle when it is packed in an atlas
+	//Gradients come from the unwrapped UVs so the wrap does not pick the smallest mip along the seam
+	vec4 uvTransform = materials[vertMaterial].uvTransforms[2];
+	vec2 uv = fract(vertUV) * uvTransform.xy + uvTransform.zw;
+	vec2 uvDx = dFdx(vertUV) * uvTransform.xy;
+	vec2 uvDy = dFdy(vertUV) * uvTransform.xy;
+#ifdef GL_ARB_bindless_texture
+	uvec2 textureHandle = materials[vertMaterial].textures[2];
+	vec4 textureData = (textureHandle != uvec2(0)) ? textureGrad(sampler2D(textureHandle), uv, uvDx, uvDy) : textureGrad(NormalTexture, uv, uvDx, uvDy);
+#else
+	vec4 textureData = textureGrad(NormalTexture, uv, uvDx, uvDy);
+#endif
+	if ((materials[vertMaterial].flags & 1u) != 0u)
+	{
+		//Two channel normal maps leave z out, rebuild it so the texture reads the same as the uncompressed map
+		vec2 normalXY = textureData.rg * 2.0 - 1.0;
+		textureData.b = sqrt(max(0.0, 1.0 - dot(normalXY, normalXY))) * 0.5 + 0.5;
+	}
 	vec3 Ambient = kA.xyz * iA; //ambient light
 	
 	//Get lambertian Term
@@ -34,13 +74,14 @@ void main()
 	vec3 Diffuse = kD.xyz * iD * nDl * textureData.rgb;
 
 	vec3 R = reflect(lightDir, normalize(vertNormal)).xyz;	//reflected light vector
-	vec3 E = normalize(camPos - vertPos).xyz;		//Surface to eye vector
+	vec3 E = normalize(CameraPosition - vertPos).xyz;		//Surface to eye vector
 
 	float specTerm = pow(max(0.f, dot(E, R)), kS.a);	//Specular Term
 	vec3 Specular = kS.xyz * iS * specTerm;
 
 	vec4 vertColour = vec4(Ambient + Diffuse + Specular, 1.0f);
     vec4 litColour = vec4(vertColour.xyz * nDl, 1.0);
-    outputColour = vertColour + litColour;
+    //Alpha is the material dissolve, transparent draws are blended with it
+    outputColour = vec4(vertColour.xyz + litColour.xyz, kD.a);
 	//outputColour = vec4(Ambient + Diffuse + Specular, 1.f);
 }
\ No newline at end of file
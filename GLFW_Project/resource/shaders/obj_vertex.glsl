@@ -1,4 +1,7 @@
-#version 400
+#version 430
+//gl_DrawIDARB identifies the draw within a multi draw call and gl_BaseInstanceARB the draw's first instance,
+//without the extension each mesh is drawn on its own and DrawBase and InstanceBase are set for every draw
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec4 normal;
@@ -7,14 +10,53 @@ layout(location = 2) in vec2 uvCoord;
 smooth out vec4 vertPos;
 smooth out vec4 vertNormal;
 smooth out vec2 vertUV;
+flat out int vertMaterial;
+flat out vec4 vertTint;
+//The depth pre-pass runs this shader too, shading tests GL_EQUAL against its depth so positions must match bit for bit
+invariant gl_Position;
 
-uniform mat4 ProjectionViewMatrix;
-uniform mat4 ModelMatrix;
+//Per frame data shared by every program, layout must match ModelRenderer::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	mat4 ProjectionViewMatrix;
+	vec4 CameraPosition;
+	vec4 LightDirection;
+};
+
+//Index of the first draw of the current call into the draw buffer
+uniform int DrawBase;
+uniform int InstanceBase;
+//Material index of every draw in the frame, in the order the render queue submitted them
+layout(std430, binding = 1) readonly buffer DrawBuffer
+{
+	uint drawMaterials[];
+};
+//Transform and tint of every instance drawn this frame, layout must match RenderQueue::InstanceData
+struct Instance
+{
+	mat4 worldMatrix;
+	mat3 normalMatrix;
+	vec4 tint;
+};
+layout(std430, binding = 2) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
 
 void main()
 {	
 	vertUV = uvCoord;
-	vertNormal = normal;
-	vertPos = ModelMatrix * position; //World space position
-	gl_Position = ProjectionViewMatrix * ModelMatrix * position;	//Screen space position
+#ifdef GL_ARB_shader_draw_parameters
+	vertMaterial = int(drawMaterials[DrawBase + gl_DrawIDARB]);
+	Instance instance = instances[gl_BaseInstanceARB + gl_InstanceID];
+#else
+	vertMaterial = int(drawMaterials[DrawBase]);
+	Instance instance = instances[InstanceBase + gl_InstanceID];
+#endif
+	vertTint = instance.tint;
+	vertNormal = vec4(normalize(instance.normalMatrix * normal.xyz), 0.0);
+	vertPos = instance.worldMatrix * position; //World space position
+	gl_Position = ProjectionViewMatrix * vertPos;	//Screen space position
 }
\ No newline at end of file
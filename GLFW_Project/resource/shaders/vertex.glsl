@@ -5,7 +5,15 @@ layout(location = 1) in vec4 colour;
 
 smooth out vec4 vertColour;
 
-uniform mat4 ProjectionViewMatrix;
+//Per frame data shared by every program, layout must match ModelRenderer::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	mat4 ProjectionViewMatrix;
+	vec4 CameraPosition;
+	vec4 LightDirection;
+};
 
 void main()
 {
@@ -3,6 +3,9 @@
 #include "Dispatcher.h"
 #include "ShaderUtil.h"
 #include "Utilities.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include "OBJ_JobSystem.h"
 
 //Include the OpenGL Header
 #include <glad/glad.h>
@@ -45,6 +48,12 @@ bool Application::Create(const char* a_applicationName, unsigned int a_windowWid
 	int minor = glfwGetWindowAttrib(m_window, GLFW_CONTEXT_VERSION_MINOR);
 	int revision = glfwGetWindowAttrib(m_window, GLFW_CONTEXT_REVISION);
 	std::cout << "OpenGL Version " << major << "." << minor << "." << revision << std::endl;
+	//Nothing is known about the new context's bindings yet
+	GLState::Invalidate();
+	//The profiler checks for pipeline statistics support so it is created once GL is loaded
+	Profiler::CreateInstance();
+	//Created here so this thread, the one holding the GL context, is the job system's main thread
+	JobSystem::CreateInstance();
 	
 	//Set up glfw window resize callback function
 	glfwSetWindowSizeCallback(m_window, [](GLFWwindow*, int w, int h)
@@ -86,9 +95,11 @@ void Application::Run(const char* a_name, unsigned int a_width, unsigned int a_h
 	{
 		Utility::resetTimer();
 		m_running = true;
+		Profiler* profiler = Profiler::GetInstance();
 		do
 		{
 			float deltaTime = Utility::tickTimer();
+			profiler->BeginFrame();
 
 			//Start the imgui frame
 			ImGui_ImplOpenGL3_NewFrame();
@@ -97,15 +108,32 @@ void Application::Run(const char* a_name, unsigned int a_width, unsigned int a_h
 
 			showFrameData(true);
 
-			Update(deltaTime);
-
-			Draw();
+			{
+				Profiler::CPUScope scope("Update");
+				Update(deltaTime);
+			}
+			{
+				Profiler::CPUScope scope("Draw");
+				Draw();
+			}
+			//ImGui's calls are not counted, they go straight to GL
+			GLState::EndFrame();
 
-			ImGui::Render();
-			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			{
+				Profiler::CPUScope scope("ImGui Render");
+				Profiler::GPUScope gpuScope("UI");
+				ImGui::Render();
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			}
+			//The ImGui backend changes bindings behind GLState's back
+			GLState::Invalidate();
 
-			//Swap front and back buffers
-			glfwSwapBuffers(m_window);
+			{
+				//Swap front and back buffers, with vsync this is where the frame waits for the display
+				Profiler::CPUScope scope("Swap");
+				glfwSwapBuffers(m_window);
+			}
+			profiler->EndFrame();
 			//Poll for and process events
 			glfwPollEvents();
 		} while (m_running == true && glfwWindowShouldClose(m_window) == 0);
@@ -118,6 +146,8 @@ void Application::Run(const char* a_name, unsigned int a_width, unsigned int a_h
 
 	Dispatcher::DestroyInstance();
 	ShaderUtil::DestroyInstance();
+	Profiler::DestroyInstance();
+	JobSystem::DestroyInstance();
 	//Cleanup
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
@@ -147,6 +177,130 @@ void  Application::showFrameData(bool a_bShowFrameData)
 		{
 			ImGui::Text("Mouse Position: Invalid");
 		}
+		const GLState::Stats& glStats = GLState::GetFrameStats();
+		ImGui::Text("GL State Calls: %u issued, %u elided", glStats.issued, glStats.elided);
+		showFrameStats();
+		showProfiler();
+		showJobSystem();
 		ImGui::End();
 	}
-}
\ No newline at end of file
+}
+
+void Application::showProfiler()
+{
+	const Profiler* profiler = Profiler::GetInstance();
+	if (!ImGui::CollapsingHeader("Profiler"))
+	{
+		return;
+	}
+	const ImVec2 graphSize(120.f, 18.f);
+	const int offset = (int)profiler->GetHistoryOffset();
+	ImGui::Text("Frame: %.3f ms", profiler->GetFrameTime());
+	ImGui::PlotLines("##Frame", profiler->GetFrameHistory(), Profiler::HistoryLength, offset, nullptr, 0.f, FLT_MAX, ImVec2(graphSize.x * 2.f, graphSize.y * 2.f));
+
+	if (ImGui::BeginTable("CPU Scopes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("CPU Scope");
+		ImGui::TableSetupColumn("ms");
+		ImGui::TableSetupColumn("Calls");
+		ImGui::TableSetupColumn("History");
+		ImGui::TableHeadersRow();
+		for (const Profiler::CPUScopeResult& result : profiler->GetCPUResults())
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			//Indent children under their parent scope
+			ImGui::Text("%*s%s", (int)result.depth * 2, "", result.name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.ms);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", result.calls);
+			ImGui::TableNextColumn();
+			const float* history = profiler->GetCPUHistory(result.path);
+			if (history != nullptr)
+			{
+				ImGui::PushID(result.path.c_str());
+				ImGui::PlotLines("##History", history, Profiler::HistoryLength, offset, nullptr, 0.f, FLT_MAX, graphSize);
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndTable();
+	}
+
+	const bool pipelineStatistics = profiler->HasPipelineStatistics();
+	if (ImGui::BeginTable("GPU Passes", pipelineStatistics ? 6 : 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("GPU Pass");
+		ImGui::TableSetupColumn("ms");
+		if (pipelineStatistics)
+		{
+			ImGui::TableSetupColumn("Vertices");
+			ImGui::TableSetupColumn("Primitives");
+			ImGui::TableSetupColumn("Fragments");
+		}
+		ImGui::TableSetupColumn("History");
+		ImGui::TableHeadersRow();
+		for (const Profiler::GPUPassResult& result : profiler->GetGPUResults())
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", result.name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.ms);
+			if (pipelineStatistics)
+			{
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)result.verticesSubmitted);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)result.primitivesSubmitted);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)result.fragmentInvocations);
+			}
+			ImGui::TableNextColumn();
+			ImGui::PushID(result.name.c_str());
+			ImGui::PlotLines("##History", profiler->GetGPUHistory(result.name), Profiler::HistoryLength, offset, nullptr, 0.f, FLT_MAX, graphSize);
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+}
+
+void Application::showJobSystem()
+{
+	static std::vector<JobSystem::BenchmarkResult> benchmark;
+	if (!ImGui::CollapsingHeader("Job System"))
+	{
+		return;
+	}
+	const JobSystem* jobSystem = JobSystem::GetInstance();
+	ImGui::Text("Workers: %u  Steals: %u", jobSystem->GetThreadCount(), jobSystem->GetStealCount());
+	//Runs on private job systems on this thread, the frame stalls until it is done
+	if (ImGui::Button("Run Benchmark"))
+	{
+		benchmark = JobSystem::RunBenchmark();
+	}
+	if (!benchmark.empty() && ImGui::BeginTable("Job Benchmark", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("Threads (workers + caller)");
+		ImGui::TableSetupColumn("ns/job");
+		ImGui::TableSetupColumn("ParallelFor ms");
+		ImGui::TableSetupColumn("Speedup vs serial");
+		ImGui::TableSetupColumn("std::function overhead");
+		ImGui::TableHeadersRow();
+		for (const JobSystem::BenchmarkResult& result : benchmark)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%u (%u + 1)", result.threads, result.workers);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.0f", result.emptyJobNs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f", result.parallelForMs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2fx", result.speedup);
+			ImGui::TableNextColumn();
+			ImGui::Text("%+.1f%%", result.functionOverhead * 100.0);
+		}
+		ImGui::EndTable();
+	}
+}
@@ -0,0 +1,174 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+//Thin wrappers so one culling loop serves both the 4 wide SSE and 8 wide AVX builds
+namespace
+{
+#if defined(__AVX__)
+	typedef __m256 SimdFloat;
+	const unsigned int SimdWidth = 8;
+	inline SimdFloat SimdLoad(const float* a_p) { return _mm256_loadu_ps(a_p); }
+	inline SimdFloat SimdSplat(float a_f) { return _mm256_set1_ps(a_f); }
+	inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+	inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+	inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a, b); }
+	inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a, b); }
+	inline void SimdStore(float* a_p, SimdFloat a) { _mm256_storeu_ps(a_p, a); }
+	inline SimdFloat SimdSqrt(SimdFloat a) { return _mm256_sqrt_ps(a); }
+	inline SimdFloat SimdLess(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+	inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm256_or_ps(a, b); }
+	inline SimdFloat SimdAndNot(SimdFloat a, SimdFloat b) { return _mm256_andnot_ps(a, b); }
+	inline SimdFloat SimdZero() { return _mm256_setzero_ps(); }
+	inline int SimdMoveMask(SimdFloat a) { return _mm256_movemask_ps(a); }
+#else
+	typedef __m128 SimdFloat;
+	const unsigned int SimdWidth = 4;
+	inline SimdFloat SimdLoad(const float* a_p) { return _mm_loadu_ps(a_p); }
+	inline SimdFloat SimdSplat(float a_f) { return _mm_set1_ps(a_f); }
+	inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+	inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+	inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm_div_ps(a, b); }
+	inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a, b); }
+	inline void SimdStore(float* a_p, SimdFloat a) { _mm_storeu_ps(a_p, a); }
+	inline SimdFloat SimdSqrt(SimdFloat a) { return _mm_sqrt_ps(a); }
+	inline SimdFloat SimdLess(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a, b); }
+	inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+	inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm_or_ps(a, b); }
+	inline SimdFloat SimdAndNot(SimdFloat a, SimdFloat b) { return _mm_andnot_ps(a, b); }
+	inline SimdFloat SimdZero() { return _mm_setzero_ps(); }
+	inline int SimdMoveMask(SimdFloat a) { return _mm_movemask_ps(a); }
+#endif
+	inline unsigned int CountBits(int a_mask)
+	{
+		unsigned int count = 0;
+		for (; a_mask != 0; a_mask &= a_mask - 1)
+		{
+			++count;
+		}
+		return count;
+	}
+}
+
+FrustumCuller::FrustumCuller() : m_depthRow(0.f), m_pixelScale(0.f), m_minPixelSize(1.f), m_enabled(true), m_count(0), m_stats()
+{
+}
+
+void FrustumCuller::Begin(const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_viewportHeight)
+{
+	//Gribb-Hartmann extraction, each plane is the clip space w row plus or minus the x, y or z row
+	glm::mat4 projectionView = a_projectionMatrix * a_viewMatrix;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		rows[i] = glm::vec4(projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]);
+	}
+	m_planes[0] = rows[3] + rows[0];	//left
+	m_planes[1] = rows[3] - rows[0];	//right
+	m_planes[2] = rows[3] + rows[1];	//bottom
+	m_planes[3] = rows[3] - rows[1];	//top
+	m_planes[4] = rows[3] + rows[2];	//near
+	m_planes[5] = rows[3] - rows[2];	//far
+	for (glm::vec4& plane : m_planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	m_depthRow = rows[3];
+	//A sphere of radius r at view depth w covers r * P[1][1] / w of the half height of the viewport
+	m_pixelScale = a_projectionMatrix[1][1] * a_viewportHeight;
+
+	m_centreX.clear();
+	m_centreY.clear();
+	m_centreZ.clear();
+	m_extentX.clear();
+	m_extentY.clear();
+	m_extentZ.clear();
+	m_count = 0;
+	m_stats = Stats();
+}
+
+unsigned int FrustumCuller::Add(const glm::vec3& a_centre, const glm::vec3& a_extent)
+{
+	m_centreX.push_back(a_centre.x);
+	m_centreY.push_back(a_centre.y);
+	m_centreZ.push_back(a_centre.z);
+	m_extentX.push_back(a_extent.x);
+	m_extentY.push_back(a_extent.y);
+	m_extentZ.push_back(a_extent.z);
+	return m_count++;
+}
+
+void FrustumCuller::Cull()
+{
+	//Pad to whole SIMD lanes with empty boxes, their results are never read
+	size_t padded = (m_count + SimdWidth - 1) / SimdWidth * SimdWidth;
+	m_centreX.resize(padded, 0.f);
+	m_centreY.resize(padded, 0.f);
+	m_centreZ.resize(padded, 0.f);
+	m_extentX.resize(padded, 0.f);
+	m_extentY.resize(padded, 0.f);
+	m_extentZ.resize(padded, 0.f);
+	m_visible.assign(padded, 1);
+	m_projectedSize.resize(padded);
+	m_stats.tested = m_count;
+
+	const SimdFloat depthX = SimdSplat(m_depthRow.x);
+	const SimdFloat depthY = SimdSplat(m_depthRow.y);
+	const SimdFloat depthZ = SimdSplat(m_depthRow.z);
+	const SimdFloat depthW = SimdSplat(m_depthRow.w);
+	const SimdFloat pixelScale = SimdSplat(m_pixelScale);
+	const SimdFloat minPixels = SimdSplat(m_minPixelSize);
+	const SimdFloat nearest = SimdSplat(1e-6f);
+	for (size_t i = 0; i < padded; i += SimdWidth)
+	{
+		SimdFloat cx = SimdLoad(&m_centreX[i]);
+		SimdFloat cy = SimdLoad(&m_centreY[i]);
+		SimdFloat cz = SimdLoad(&m_centreZ[i]);
+		SimdFloat ex = SimdLoad(&m_extentX[i]);
+		SimdFloat ey = SimdLoad(&m_extentY[i]);
+		SimdFloat ez = SimdLoad(&m_extentZ[i]);
+
+		//A box is outside if its centre is further behind any plane than the box reaches towards that plane
+		SimdFloat outside = SimdZero();
+		for (const glm::vec4& plane : m_planes)
+		{
+			SimdFloat distance = SimdAdd(SimdAdd(SimdMul(cx, SimdSplat(plane.x)), SimdMul(cy, SimdSplat(plane.y))), SimdAdd(SimdMul(cz, SimdSplat(plane.z)), SimdSplat(plane.w)));
+			SimdFloat reach = SimdAdd(SimdAdd(SimdMul(ex, SimdSplat(fabsf(plane.x))), SimdMul(ey, SimdSplat(fabsf(plane.y)))), SimdMul(ez, SimdSplat(fabsf(plane.z))));
+			outside = SimdOr(outside, SimdLess(SimdAdd(distance, reach), SimdZero()));
+		}
+
+		//Projected size of the bounding sphere, compared as r * scale < pixels * w to avoid the divide
+		//Spheres reaching the camera plane are never small
+		SimdFloat radius = SimdSqrt(SimdAdd(SimdAdd(SimdMul(ex, ex), SimdMul(ey, ey)), SimdMul(ez, ez)));
+		SimdFloat depth = SimdAdd(SimdAdd(SimdMul(cx, depthX), SimdMul(cy, depthY)), SimdAdd(SimdMul(cz, depthZ), depthW));
+		SimdFloat tooSmall = SimdAnd(SimdLess(radius, depth), SimdLess(SimdMul(radius, pixelScale), SimdMul(minPixels, depth)));
+		//The size itself is kept for picking occluders, the depth is clamped to the radius so it never divides by zero
+		SimdStore(&m_projectedSize[i], SimdDiv(SimdMul(radius, pixelScale), SimdMax(depth, SimdMax(radius, nearest))));
+		if (!m_enabled)
+		{
+			continue;
+		}
+
+		int outsideMask = SimdMoveMask(outside);
+		int smallMask = SimdMoveMask(SimdAndNot(outside, tooSmall));
+		for (unsigned int lane = 0; lane < SimdWidth; ++lane)
+		{
+			if (((outsideMask | smallMask) >> lane) & 1)
+			{
+				m_visible[i + lane] = 0;
+			}
+		}
+		//Only count the lanes that hold real boxes
+		unsigned int lanes = (unsigned int)std::min<size_t>(SimdWidth, m_count - i);
+		int laneMask = (1 << lanes) - 1;
+		m_stats.frustumCulled += CountBits(outsideMask & laneMask);
+		m_stats.smallCulled += CountBits(smallMask & laneMask);
+	}
+	m_stats.visible = m_count - m_stats.frustumCulled - m_stats.smallCulled;
+}
@@ -0,0 +1,295 @@
+#include "GLState.h"
+#include <glad/glad.h>
+
+unsigned int GLState::s_program = GLState::Unknown;
+unsigned int GLState::s_vertexArray = GLState::Unknown;
+unsigned int GLState::s_buffers[GLState::BufferTarget_Count];
+unsigned int GLState::s_uniformBases[GLState::MaxBufferBindings];
+unsigned int GLState::s_storageBases[GLState::MaxBufferBindings];
+unsigned int GLState::s_activeTexture = GLState::Unknown;
+unsigned int GLState::s_textures[GLState::MaxTextureUnits][GLState::TextureTarget_Count];
+unsigned int GLState::s_capabilities[GLState::Capability_Count];
+unsigned int GLState::s_depthMask = GLState::Unknown;
+unsigned int GLState::s_depthFunc = GLState::Unknown;
+unsigned int GLState::s_blendFunc = GLState::Unknown;
+unsigned int GLState::s_colorMask = GLState::Unknown;
+GLState::Stats GLState::s_stats = { 0, 0 };
+GLState::Stats GLState::s_frameStats = { 0, 0 };
+
+bool GLState::Change(unsigned int& a_shadow, unsigned int a_value)
+{
+	if (a_shadow == a_value)
+	{
+		++s_stats.elided;
+		return false;
+	}
+	a_shadow = a_value;
+	++s_stats.issued;
+	return true;
+}
+
+int GLState::GetBufferTarget(unsigned int a_target)
+{
+	switch (a_target)
+	{
+	case GL_ARRAY_BUFFER:			return ArrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER:	return ElementArrayBuffer;
+	case GL_UNIFORM_BUFFER:			return UniformBuffer;
+	case GL_SHADER_STORAGE_BUFFER:	return ShaderStorageBuffer;
+	case GL_DRAW_INDIRECT_BUFFER:	return DrawIndirectBuffer;
+	case GL_PIXEL_UNPACK_BUFFER:	return PixelUnpackBuffer;
+	default:						return -1;
+	}
+}
+
+int GLState::GetTextureTarget(unsigned int a_target)
+{
+	switch (a_target)
+	{
+	case GL_TEXTURE_2D:			return Texture2D;
+	case GL_TEXTURE_CUBE_MAP:	return TextureCubeMap;
+	case GL_TEXTURE_2D_ARRAY:	return Texture2DArray;
+	default:					return -1;
+	}
+}
+
+int GLState::GetCapability(unsigned int a_capability)
+{
+	switch (a_capability)
+	{
+	case GL_DEPTH_TEST:		return DepthTest;
+	case GL_CULL_FACE:		return CullFace;
+	case GL_BLEND:			return Blend;
+	case GL_SCISSOR_TEST:	return ScissorTest;
+	default:				return -1;
+	}
+}
+
+void GLState::UseProgram(unsigned int a_program)
+{
+	if (Change(s_program, a_program))
+	{
+		glUseProgram(a_program);
+	}
+}
+
+void GLState::BindVertexArray(unsigned int a_vertexArray)
+{
+	if (Change(s_vertexArray, a_vertexArray))
+	{
+		glBindVertexArray(a_vertexArray);
+		//The element array binding is part of the vertex array state
+		s_buffers[ElementArrayBuffer] = Unknown;
+	}
+}
+
+void GLState::BindBuffer(unsigned int a_target, unsigned int a_buffer)
+{
+	int target = GetBufferTarget(a_target);
+	if (target < 0)
+	{
+		++s_stats.issued;
+		glBindBuffer(a_target, a_buffer);
+		return;
+	}
+	if (Change(s_buffers[target], a_buffer))
+	{
+		glBindBuffer(a_target, a_buffer);
+	}
+}
+
+void GLState::BindBufferBase(unsigned int a_target, unsigned int a_index, unsigned int a_buffer)
+{
+	unsigned int* bases = (a_target == GL_UNIFORM_BUFFER) ? s_uniformBases : (a_target == GL_SHADER_STORAGE_BUFFER) ? s_storageBases : nullptr;
+	if (bases == nullptr || a_index >= MaxBufferBindings)
+	{
+		++s_stats.issued;
+		glBindBufferBase(a_target, a_index, a_buffer);
+		return;
+	}
+	if (Change(bases[a_index], a_buffer))
+	{
+		glBindBufferBase(a_target, a_index, a_buffer);
+		//Binding an indexed target also binds the generic target
+		s_buffers[GetBufferTarget(a_target)] = a_buffer;
+	}
+}
+
+void GLState::BindTexture(unsigned int a_unit, unsigned int a_target, unsigned int a_texture)
+{
+	int target = GetTextureTarget(a_target);
+	if (target < 0 || a_unit >= MaxTextureUnits)
+	{
+		if (Change(s_activeTexture, a_unit))
+		{
+			glActiveTexture(GL_TEXTURE0 + a_unit);
+		}
+		++s_stats.issued;
+		glBindTexture(a_target, a_texture);
+		return;
+	}
+	//Only switch the active unit when the binding actually has to change
+	if (s_textures[a_unit][target] == a_texture)
+	{
+		++s_stats.elided;
+		return;
+	}
+	if (Change(s_activeTexture, a_unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + a_unit);
+	}
+	Change(s_textures[a_unit][target], a_texture);
+	glBindTexture(a_target, a_texture);
+}
+
+void GLState::BindTexture(unsigned int a_target, unsigned int a_texture)
+{
+	if (s_activeTexture == Unknown)
+	{
+		//The active unit is not known so make one known
+		Change(s_activeTexture, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	BindTexture(s_activeTexture, a_target, a_texture);
+}
+
+void GLState::SetCapability(unsigned int a_capability, bool a_enabled)
+{
+	int capability = GetCapability(a_capability);
+	if (capability < 0)
+	{
+		//Untracked capabilities are always passed through
+		++s_stats.issued;
+	}
+	else if (!Change(s_capabilities[capability], a_enabled ? 1 : 0))
+	{
+		return;
+	}
+	if (a_enabled)
+	{
+		glEnable(a_capability);
+	}
+	else
+	{
+		glDisable(a_capability);
+	}
+}
+
+void GLState::Enable(unsigned int a_capability)
+{
+	SetCapability(a_capability, true);
+}
+
+void GLState::Disable(unsigned int a_capability)
+{
+	SetCapability(a_capability, false);
+}
+
+void GLState::DepthMask(bool a_write)
+{
+	if (Change(s_depthMask, a_write ? 1 : 0))
+	{
+		glDepthMask(a_write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLState::DepthFunc(unsigned int a_func)
+{
+	if (Change(s_depthFunc, a_func))
+	{
+		glDepthFunc(a_func);
+	}
+}
+
+void GLState::BlendFunc(unsigned int a_source, unsigned int a_destination)
+{
+	//Blend factor enums all fit in 16 bits so both factors share one shadow value
+	if (Change(s_blendFunc, (a_source << 16) | (a_destination & 0xFFFF)))
+	{
+		glBlendFunc(a_source, a_destination);
+	}
+}
+
+void GLState::ColorMask(bool a_write)
+{
+	if (Change(s_colorMask, a_write ? 1 : 0))
+	{
+		GLboolean write = a_write ? GL_TRUE : GL_FALSE;
+		glColorMask(write, write, write, write);
+	}
+}
+
+void GLState::DeleteProgram(unsigned int a_program)
+{
+	if (s_program == a_program)
+	{
+		s_program = Unknown;
+	}
+	glDeleteProgram(a_program);
+}
+
+void GLState::DeleteVertexArray(unsigned int a_vertexArray)
+{
+	//Deleting the bound vertex array reverts the binding to zero
+	if (s_vertexArray == a_vertexArray)
+	{
+		s_vertexArray = Unknown;
+		s_buffers[ElementArrayBuffer] = Unknown;
+	}
+	glDeleteVertexArrays(1, &a_vertexArray);
+}
+
+void GLState::DeleteBuffer(unsigned int a_buffer)
+{
+	for (unsigned int& buffer : s_buffers)
+	{
+		if (buffer == a_buffer) { buffer = Unknown; }
+	}
+	for (unsigned int i = 0; i < MaxBufferBindings; ++i)
+	{
+		if (s_uniformBases[i] == a_buffer) { s_uniformBases[i] = Unknown; }
+		if (s_storageBases[i] == a_buffer) { s_storageBases[i] = Unknown; }
+	}
+	glDeleteBuffers(1, &a_buffer);
+}
+
+void GLState::DeleteTexture(unsigned int a_texture)
+{
+	for (unsigned int unit = 0; unit < MaxTextureUnits; ++unit)
+	{
+		for (unsigned int& texture : s_textures[unit])
+		{
+			if (texture == a_texture) { texture = Unknown; }
+		}
+	}
+	glDeleteTextures(1, &a_texture);
+}
+
+void GLState::Invalidate()
+{
+	s_program = Unknown;
+	s_vertexArray = Unknown;
+	s_activeTexture = Unknown;
+	s_depthMask = Unknown;
+	s_depthFunc = Unknown;
+	s_blendFunc = Unknown;
+	s_colorMask = Unknown;
+	for (unsigned int& buffer : s_buffers) { buffer = Unknown; }
+	for (unsigned int i = 0; i < MaxBufferBindings; ++i)
+	{
+		s_uniformBases[i] = Unknown;
+		s_storageBases[i] = Unknown;
+	}
+	for (unsigned int unit = 0; unit < MaxTextureUnits; ++unit)
+	{
+		for (unsigned int& texture : s_textures[unit]) { texture = Unknown; }
+	}
+	for (unsigned int& capability : s_capabilities) { capability = Unknown; }
+}
+
+void GLState::EndFrame()
+{
+	s_frameStats = s_stats;
+	s_stats.issued = 0;
+	s_stats.elided = 0;
+}
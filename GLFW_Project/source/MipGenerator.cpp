@@ -0,0 +1,281 @@
+#include "MipGenerator.h"
+#include <algorithm>
+#include <cmath>
+//32 bit MSVC does not define __SSE2__, it reports /arch:SSE2 and above through _M_IX86_FP
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+namespace
+{
+	//One RGBA texel in floating point, a single SSE register when SSE2 is available
+#ifdef MIP_GENERATOR_SSE2
+	typedef __m128 Texel;
+	inline Texel LoadTexel(const float* a_source) { return _mm_loadu_ps(a_source); }
+	inline void StoreTexel(float* a_destination, Texel a_texel) { _mm_storeu_ps(a_destination, a_texel); }
+	inline Texel ZeroTexel() { return _mm_setzero_ps(); }
+	inline Texel Add(Texel a_a, Texel a_b) { return _mm_add_ps(a_a, a_b); }
+	inline Texel Scale(Texel a_texel, float a_scale) { return _mm_mul_ps(a_texel, _mm_set1_ps(a_scale)); }
+#else
+	typedef struct Texel
+	{
+		float v[4];
+	}Texel;
+	inline Texel LoadTexel(const float* a_source) { Texel t = { { a_source[0], a_source[1], a_source[2], a_source[3] } }; return t; }
+	inline void StoreTexel(float* a_destination, Texel a_texel) { for (int c = 0; c < 4; ++c) { a_destination[c] = a_texel.v[c]; } }
+	inline Texel ZeroTexel() { Texel t = { { 0.f, 0.f, 0.f, 0.f } }; return t; }
+	inline Texel Add(Texel a_a, Texel a_b) { for (int c = 0; c < 4; ++c) { a_a.v[c] += a_b.v[c]; } return a_a; }
+	inline Texel Scale(Texel a_texel, float a_scale) { for (int c = 0; c < 4; ++c) { a_texel.v[c] *= a_scale; } return a_texel; }
+#endif
+
+	//sRGB to linear for every byte value, and linear back to sRGB at a finer step so dark values round correctly
+	typedef struct GammaTables
+	{
+		float toLinear[256];
+		unsigned char toSRGB[4096];
+
+		GammaTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.f;
+				toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; ++i)
+			{
+				float l = i / 4095.f;
+				float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+				toSRGB[i] = (unsigned char)(c * 255.f + 0.5f);
+			}
+		}
+	}GammaTables;
+	const GammaTables& GetGammaTables()
+	{
+		//Built on first use, static initialisation is thread safe so decode workers can race to it
+		static const GammaTables tables;
+		return tables;
+	}
+
+	//Taps either side of the two source texels under each destination texel
+	const int KaiserTaps = 8;
+	const float KaiserAlpha = 4.f;
+	const float Pi = 3.14159265f;
+
+	//Zeroth order modified Bessel function of the first kind, the series converges well within 20 terms here
+	float BesselI0(float a_x)
+	{
+		float sum = 1.f;
+		float term = 1.f;
+		for (int k = 1; k < 20; ++k)
+		{
+			term *= (a_x * 0.5f / k) * (a_x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	typedef struct KaiserKernel
+	{
+		float weights[KaiserTaps];
+
+		KaiserKernel()
+		{
+			//Tap i sits (i - 3.5) source texels from the destination centre, the window spans two destination texels
+			float total = 0.f;
+			for (int i = 0; i < KaiserTaps; ++i)
+			{
+				float x = (i - (KaiserTaps - 1) * 0.5f) * 0.5f;
+				float sinc = (x == 0.f) ? 1.f : std::sin(Pi * x) / (Pi * x);
+				float t = x / 2.f;
+				float window = BesselI0(KaiserAlpha * std::sqrt(std::max(0.f, 1.f - t * t))) / BesselI0(KaiserAlpha);
+				weights[i] = sinc * window;
+				total += weights[i];
+			}
+			for (int i = 0; i < KaiserTaps; ++i)
+			{
+				weights[i] /= total;
+			}
+		}
+	}KaiserKernel;
+	const KaiserKernel& GetKaiserKernel()
+	{
+		static const KaiserKernel kernel;
+		return kernel;
+	}
+
+	//Halve a level with a 2x2 box filter, odd edges reuse their last row or column
+	void DownsampleBox(const float* a_source, unsigned int a_width, unsigned int a_height, float* a_destination, unsigned int a_dstWidth, unsigned int a_dstHeight)
+	{
+		for (unsigned int y = 0; y < a_dstHeight; ++y)
+		{
+			const float* row0 = a_source + (size_t)std::min(y * 2, a_height - 1) * a_width * 4;
+			const float* row1 = a_source + (size_t)std::min(y * 2 + 1, a_height - 1) * a_width * 4;
+			for (unsigned int x = 0; x < a_dstWidth; ++x)
+			{
+				size_t x0 = (size_t)std::min(x * 2, a_width - 1) * 4;
+				size_t x1 = (size_t)std::min(x * 2 + 1, a_width - 1) * 4;
+				Texel sum = Add(Add(LoadTexel(row0 + x0), LoadTexel(row0 + x1)), Add(LoadTexel(row1 + x0), LoadTexel(row1 + x1)));
+				StoreTexel(a_destination + ((size_t)y * a_dstWidth + x) * 4, Scale(sum, 0.25f));
+			}
+		}
+	}
+
+	//Halve a level with the separable Kaiser kernel, rows first into a_scratch then columns, clamping at the edges
+	void DownsampleKaiser(const float* a_source, unsigned int a_width, unsigned int a_height, float* a_destination, unsigned int a_dstWidth, unsigned int a_dstHeight,
+		std::vector<float>& a_scratch)
+	{
+		const float* weights = GetKaiserKernel().weights;
+		const int firstTap = -(KaiserTaps / 2 - 1);
+		a_scratch.resize((size_t)a_dstWidth * a_height * 4);
+		for (unsigned int y = 0; y < a_height; ++y)
+		{
+			const float* row = a_source + (size_t)y * a_width * 4;
+			for (unsigned int x = 0; x < a_dstWidth; ++x)
+			{
+				Texel sum = ZeroTexel();
+				for (int t = 0; t < KaiserTaps; ++t)
+				{
+					int sx = std::min(std::max((int)x * 2 + firstTap + t, 0), (int)a_width - 1);
+					sum = Add(sum, Scale(LoadTexel(row + (size_t)sx * 4), weights[t]));
+				}
+				StoreTexel(a_scratch.data() + ((size_t)y * a_dstWidth + x) * 4, sum);
+			}
+		}
+		for (unsigned int y = 0; y < a_dstHeight; ++y)
+		{
+			for (unsigned int x = 0; x < a_dstWidth; ++x)
+			{
+				Texel sum = ZeroTexel();
+				for (int t = 0; t < KaiserTaps; ++t)
+				{
+					int sy = std::min(std::max((int)y * 2 + firstTap + t, 0), (int)a_height - 1);
+					sum = Add(sum, Scale(LoadTexel(a_scratch.data() + ((size_t)sy * a_dstWidth + x) * 4), weights[t]));
+				}
+				StoreTexel(a_destination + ((size_t)y * a_dstWidth + x) * 4, sum);
+			}
+		}
+	}
+
+	//Bring normals back to unit length, texels that cancel out entirely point straight out of the surface
+	void Renormalise(float* a_texels, size_t a_count)
+	{
+		for (size_t i = 0; i < a_count; ++i)
+		{
+			float* n = a_texels + i * 4;
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 1e-6f)
+			{
+				n[0] /= length; n[1] /= length; n[2] /= length;
+			}
+			else
+			{
+				n[0] = 0.f; n[1] = 0.f; n[2] = 1.f;
+			}
+		}
+	}
+
+	unsigned char ToByte(float a_value)
+	{
+		return (unsigned char)(std::min(std::max(a_value, 0.f), 1.f) * 255.f + 0.5f);
+	}
+}
+
+MipGenerator::Mode MipGenerator::GetMode(TextureCompressor::Usage a_usage)
+{
+	switch (a_usage)
+	{
+	case TextureCompressor::ColourUsage:	return ColourMode;
+	case TextureCompressor::NormalUsage:	return NormalMode;
+	default:								return LinearMode;
+	}
+}
+
+void MipGenerator::Generate(const unsigned char* a_rgba, unsigned int a_width, unsigned int a_height, Mode a_mode, Filter a_filter,
+	std::vector<TextureCompressor::MipLevel>& a_levels)
+{
+	a_levels.clear();
+	TextureCompressor::MipLevel level;
+	level.width = a_width;
+	level.height = a_height;
+	level.data.assign(a_rgba, a_rgba + (size_t)a_width * a_height * 4);
+	a_levels.push_back(std::move(level));
+
+	//Level 0 in the space it is filtered in
+	const GammaTables& gamma = GetGammaTables();
+	size_t count = (size_t)a_width * a_height;
+	std::vector<float> texels(count * 4);
+	for (size_t i = 0; i < count * 4; ++i)
+	{
+		unsigned char value = a_rgba[i];
+		bool alpha = (i & 3) == 3;
+		if (a_mode == ColourMode && !alpha)
+		{
+			texels[i] = gamma.toLinear[value];
+		}
+		else if (a_mode == NormalMode && !alpha)
+		{
+			texels[i] = value / 127.5f - 1.f;
+		}
+		else
+		{
+			texels[i] = value / 255.f;
+		}
+	}
+	if (a_mode == NormalMode)
+	{
+		Renormalise(texels.data(), count);
+	}
+
+	std::vector<float> nextTexels;
+	std::vector<float> scratch;
+	unsigned int width = a_width;
+	unsigned int height = a_height;
+	while (width > 1 || height > 1)
+	{
+		unsigned int nextWidth = std::max(1u, width / 2);
+		unsigned int nextHeight = std::max(1u, height / 2);
+		nextTexels.resize((size_t)nextWidth * nextHeight * 4);
+		if (a_filter == KaiserFilter)
+		{
+			DownsampleKaiser(texels.data(), width, height, nextTexels.data(), nextWidth, nextHeight, scratch);
+		}
+		else
+		{
+			DownsampleBox(texels.data(), width, height, nextTexels.data(), nextWidth, nextHeight);
+		}
+		texels.swap(nextTexels);
+		width = nextWidth;
+		height = nextHeight;
+		count = (size_t)width * height;
+		if (a_mode == NormalMode)
+		{
+			//Each level is filtered from unit normals so shortening does not build up down the chain
+			Renormalise(texels.data(), count);
+		}
+
+		TextureCompressor::MipLevel next;
+		next.width = width;
+		next.height = height;
+		next.data.resize(count * 4);
+		for (size_t i = 0; i < count * 4; ++i)
+		{
+			float value = texels[i];
+			bool alpha = (i & 3) == 3;
+			if (a_mode == ColourMode && !alpha)
+			{
+				//The Kaiser kernel's negative lobes can overshoot so clamp before the table lookup
+				next.data[i] = gamma.toSRGB[(int)(std::min(std::max(value, 0.f), 1.f) * 4095.f + 0.5f)];
+			}
+			else if (a_mode == NormalMode && !alpha)
+			{
+				next.data[i] = ToByte(value * 0.5f + 0.5f);
+			}
+			else
+			{
+				next.data[i] = ToByte(value);
+			}
+		}
+		a_levels.push_back(std::move(next));
+	}
+}
@@ -0,0 +1,216 @@
+#include "ModelBuffers.h"
+#include "OBJ_Loader.h"
+#include "GLState.h"
+#include "TextureManager.h"
+#include "Texture.h"
+#include <glad/glad.h>
+#include <cstring>
+
+size_t ModelBuffers::s_uploadedBytes = 0;
+
+ModelBuffers::ModelBuffers(OBJModel* a_model) : m_model(a_model), m_boundsMin(0.f), m_boundsMax(0.f), m_vertexArray(0), m_vertexBuffer(0), m_indexBuffer(0), m_materialBuffer(0),
+	m_gpuMemory(0), m_bindlessTextures(TextureManager::GetInstance()->UseBindlessTextures()), m_textureGeneration(TextureManager::GetInstance()->GetTextureGeneration()),
+	m_commands(), m_drawInfo(), m_materials()
+{
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (unsigned int i = 0; i < a_model->GetMeshCount(); ++i)
+	{
+		OBJMesh* pMesh = a_model->GetMeshByIndex(i);
+		vertexCount += pMesh->m_vertices.size();
+		indexCount += pMesh->m_indices.size();
+	}
+
+	//Pack the geometry, indices stay relative to their mesh and are offset by the base vertex when drawn
+	std::vector<OBJVertex> vertices;
+	std::vector<unsigned int> indices;
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+	for (unsigned int i = 0; i < a_model->GetMeshCount(); ++i)
+	{
+		OBJMesh* pMesh = a_model->GetMeshByIndex(i);
+		if (pMesh->m_indices.empty())
+		{
+			continue;
+		}
+		DrawCommand command;
+		command.count = (unsigned int)pMesh->m_indices.size();
+		command.instanceCount = 1;
+		command.firstIndex = (unsigned int)indices.size();
+		command.baseVertex = (int)vertices.size();
+		command.baseInstance = 0;
+		vertices.insert(vertices.end(), pMesh->m_vertices.begin(), pMesh->m_vertices.end());
+		indices.insert(indices.end(), pMesh->m_indices.begin(), pMesh->m_indices.end());
+
+		//No material to obtain lighting information from use defaults
+		DrawMaterial material = { { 0.25f, 0.25f, 0.25f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 1.f, 1.f, 64.f }, { 0, 0, 0 }, 0, 0,
+			{ { 1.f, 1.f, 0.f, 0.f }, { 1.f, 1.f, 0.f, 0.f }, { 1.f, 1.f, 0.f, 0.f } } };
+		DrawInfo info = { { 0, 0, 0 }, pMesh->m_boundsMin, pMesh->m_boundsMax, false, i };
+		OBJMaterial* pMaterial = pMesh->m_material;
+		if (pMaterial != nullptr)
+		{
+			memcpy(material.kA, &pMaterial->kA[0], sizeof(material.kA));
+			memcpy(material.kD, &pMaterial->kD[0], sizeof(material.kD));
+			memcpy(material.kS, &pMaterial->kS[0], sizeof(material.kS));
+			if (!m_bindlessTextures)
+			{
+				//With bindless handles the IDs stay at 0 so every draw shares one texture set and the queue never rebinds
+				memcpy(info.textureIDs, pMaterial->textureIDs, sizeof(info.textureIDs));
+			}
+			info.transparent = pMaterial->kD.a < 1.f;
+			SetMaterialTextures(material, pMaterial);
+		}
+		m_materials.push_back(material);
+		m_boundsMin = m_drawInfo.empty() ? info.boundsMin : glm::min(m_boundsMin, info.boundsMin);
+		m_boundsMax = m_drawInfo.empty() ? info.boundsMax : glm::max(m_boundsMax, info.boundsMax);
+		m_drawInfo.push_back(info);
+		m_commands.push_back(command);
+	}
+	if (m_commands.empty())
+	{
+		return;
+	}
+
+	//The vertex array records the attribute layout and the index buffer binding
+	glGenVertexArrays(1, &m_vertexArray);
+	GLState::BindVertexArray(m_vertexArray);
+
+	glGenBuffers(1, &m_vertexBuffer);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	BufferStorage(GL_ARRAY_BUFFER, vertices.size() * sizeof(OBJVertex), vertices.data());
+
+	glGenBuffers(1, &m_indexBuffer);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+	BufferStorage(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data());
+
+	glEnableVertexAttribArray(0);	//position
+	glEnableVertexAttribArray(1);	//normal
+	glEnableVertexAttribArray(2);	//uv coord
+
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), ((char*)0) + OBJVertex::PositionOffset);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(OBJVertex), ((char*)0) + OBJVertex::NormalOffset);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_TRUE, sizeof(OBJVertex), ((char*)0) + OBJVertex::UVCoordOffset);
+
+	//Unbind the vertex array first so the index buffer binding stays recorded in it
+	GLState::BindVertexArray(0);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &m_materialBuffer);
+	GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_materialBuffer);
+	//Dynamic so the texture state can be refreshed as streamed textures become ready
+	BufferStorage(GL_SHADER_STORAGE_BUFFER, m_materials.size() * sizeof(DrawMaterial), m_materials.data(), GL_DYNAMIC_STORAGE_BIT);
+	GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_gpuMemory = vertices.size() * sizeof(OBJVertex) + indices.size() * sizeof(unsigned int) + m_materials.size() * sizeof(DrawMaterial);
+}
+
+void ModelBuffers::SetMaterialTextures(DrawMaterial& a_material, const OBJMaterial* a_source) const
+{
+	TextureManager* pTM = TextureManager::GetInstance();
+	if (m_bindlessTextures)
+	{
+		for (unsigned int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; ++n)
+		{
+			a_material.textureHandles[n] = pTM->GetBindlessHandle(a_source->textureIDs[n]);
+		}
+	}
+	for (unsigned int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; ++n)
+	{
+		pTM->GetUVTransform(a_source->textureFileNames[n], a_material.uvTransforms[n]);
+	}
+	a_material.flags &= ~(uint32_t)NormalMapXY;
+	const Texture* normalMap = pTM->FindTexture(a_source->textureIDs[OBJMaterial::TextureTypes::NormalTexture]);
+	if (normalMap != nullptr && normalMap->IsCompressed() && normalMap->GetCompressedFormat() == TextureCompressor::BC5)
+	{
+		a_material.flags |= NormalMapXY;
+	}
+}
+
+void ModelBuffers::RefreshMaterials()
+{
+	unsigned int generation = TextureManager::GetInstance()->GetTextureGeneration();
+	if (generation == m_textureGeneration || m_materialBuffer == 0)
+	{
+		return;
+	}
+	m_textureGeneration = generation;
+	TextureManager* pTM = TextureManager::GetInstance();
+	bool changed = false;
+	for (size_t i = 0; i < m_materials.size(); ++i)
+	{
+		OBJMaterial* pMaterial = m_model->GetMeshByIndex(m_drawInfo[i].mesh)->m_material;
+		if (pMaterial == nullptr)
+		{
+			continue;
+		}
+		//Draws sharing the material pick up the new IDs whichever of them moved it
+		pTM->ReplaceFailedAtlasPages(pMaterial);
+		if (!m_bindlessTextures)
+		{
+			memcpy(m_drawInfo[i].textureIDs, pMaterial->textureIDs, sizeof(m_drawInfo[i].textureIDs));
+		}
+		DrawMaterial material = m_materials[i];
+		SetMaterialTextures(material, pMaterial);
+		if (memcmp(&material, &m_materials[i], sizeof(DrawMaterial)) != 0)
+		{
+			m_materials[i] = material;
+			changed = true;
+		}
+	}
+	if (changed)
+	{
+		GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_materialBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_materials.size() * sizeof(DrawMaterial), m_materials.data());
+		GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		s_uploadedBytes += m_materials.size() * sizeof(DrawMaterial);
+	}
+}
+
+ModelBuffers::~ModelBuffers()
+{
+	if (m_vertexArray != 0)
+	{
+		GLState::DeleteVertexArray(m_vertexArray);
+		GLState::DeleteBuffer(m_vertexBuffer);
+		GLState::DeleteBuffer(m_indexBuffer);
+		GLState::DeleteBuffer(m_materialBuffer);
+	}
+}
+
+void ModelBuffers::MarkTexturesUsed() const
+{
+	TextureManager* pTM = TextureManager::GetInstance();
+	for (const DrawInfo& info : m_drawInfo)
+	{
+		const OBJMaterial* pMaterial = m_model->GetMeshByIndex(info.mesh)->m_material;
+		if (pMaterial == nullptr)
+		{
+			continue;
+		}
+		for (unsigned int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; ++n)
+		{
+			pTM->MarkUsed(pMaterial->textureIDs[n]);
+		}
+	}
+}
+
+bool ModelBuffers::UseMultiDrawIndirect()
+{
+	//gl_DrawID is only available to the shader with shader draw parameters, the shader checks the same extension
+	return (GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect) && GLAD_GL_ARB_shader_draw_parameters;
+}
+
+void ModelBuffers::BufferStorage(unsigned int a_target, size_t a_size, const void* a_data, unsigned int a_flags)
+{
+	if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+	{
+		//No flags unless asked for - the contents are written once here and never mapped or updated
+		glBufferStorage(a_target, a_size, a_data, a_flags);
+	}
+	else
+	{
+		glBufferData(a_target, a_size, a_data, GL_STATIC_DRAW);
+	}
+	s_uploadedBytes += a_size;
+}
@@ -0,0 +1,276 @@
+#include "ModelCache.h"
+#include "TextureManager.h"
+#include "ModelBuffers.h"
+#include "OBJ_Loader.h"
+#include "OBJ_BatchLoader.h"
+
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+
+ModelCache::ModelCache(size_t a_budgetBytes) : m_entries(), m_lookup(), m_current(nullptr), m_budgetBytes(a_budgetBytes), m_usedBytes(0),
+	m_hits(0), m_misses(0), m_prefetchHits(0), m_prefetches()
+{
+}
+
+ModelCache::~ModelCache()
+{
+	//Prefetches that have not started are cancelled rather than loaded only to be thrown away, running ones are waited
+	//on as their model is deleted here
+	for (auto iter = m_prefetches.begin(); iter != m_prefetches.end(); ++iter)
+	{
+		if (!CancelOrWait(*iter->second))
+		{
+			delete iter->second->model;
+		}
+	}
+	m_prefetches.clear();
+	m_current = nullptr;
+	while (!m_entries.empty())
+	{
+		Remove(std::prev(m_entries.end()));
+	}
+}
+
+std::string ModelCache::CanonicalPath(const std::string& a_filename)
+{
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::weakly_canonical(a_filename, error);
+	if (error)
+	{
+		return a_filename;
+	}
+	return path.string();
+}
+
+OBJModel* ModelCache::Acquire(const std::string& a_filename)
+{
+	std::string key = CanonicalPath(a_filename);
+	auto lookupIter = m_lookup.find(key);
+	if (lookupIter != m_lookup.end())
+	{
+		++m_hits;
+		//Move to the front of the list as the most recently used
+		EntryList::iterator entry = lookupIter->second;
+		m_entries.splice(m_entries.begin(), m_entries, entry);
+		m_current = entry->model;
+		return m_current;
+	}
+
+	OBJModel* model = TakePrefetched(key);
+	if (model != nullptr)
+	{
+		++m_prefetchHits;
+	}
+	else
+	{
+		++m_misses;
+		model = new OBJModel();
+		if (!model->Load(a_filename))
+		{
+			//Leave the cache untouched so the caller can keep drawing the current model
+			delete model;
+			return nullptr;
+		}
+	}
+	m_current = Insert(key, model)->model;
+	Evict();
+	return m_current;
+}
+
+ModelBuffers* ModelCache::GetBuffers(const OBJModel* a_model) const
+{
+	for (auto iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+	{
+		if (iter->model == a_model)
+		{
+			return iter->buffers;
+		}
+	}
+	return nullptr;
+}
+
+ModelCache::EntryList::iterator ModelCache::Insert(const std::string& a_key, OBJModel* a_model)
+{
+	//The cached model holds its texture references for as long as it stays in the cache
+	TextureManager::GetInstance()->LoadMaterialTextures(a_model);
+	CacheEntry entry;
+	entry.key = a_key;
+	entry.model = a_model;
+	//Geometry is uploaded once here, drawing a cached model never touches its vertex data again
+	entry.buffers = new ModelBuffers(a_model);
+	entry.bytes = a_model->GetMemoryUsage().Total();
+	m_entries.push_front(entry);
+	m_lookup[a_key] = m_entries.begin();
+	m_usedBytes += entry.bytes;
+	return m_entries.begin();
+}
+
+void ModelCache::Remove(EntryList::iterator a_entry)
+{
+	TextureManager::GetInstance()->ReleaseMaterialTextures(a_entry->model);
+	delete a_entry->buffers;
+	delete a_entry->model;
+	m_usedBytes -= a_entry->bytes;
+	m_lookup.erase(a_entry->key);
+	m_entries.erase(a_entry);
+}
+
+void ModelCache::Evict()
+{
+	//Walk from the least recently used end, never evicting the model currently being drawn
+	auto iter = m_entries.end();
+	while (m_usedBytes > m_budgetBytes && iter != m_entries.begin())
+	{
+		--iter;
+		if (iter->model == m_current)
+		{
+			continue;
+		}
+		std::cout << "Model cache evicting: " << iter->key << std::endl;
+		auto evict = iter;
+		++iter;
+		Remove(evict);
+	}
+}
+
+void ModelCache::Clear()
+{
+	for (auto iter = m_entries.begin(); iter != m_entries.end();)
+	{
+		auto entry = iter++;
+		if (entry->model != m_current)
+		{
+			Remove(entry);
+		}
+	}
+}
+
+std::string ModelCache::GetNeighbour(const std::string& a_filename, int a_offset)
+{
+	std::filesystem::path directory = std::filesystem::path(a_filename).parent_path();
+	std::vector<std::string> files = OBJBatchLoader::FindOBJFiles(directory.empty() ? "." : directory.string());
+	if (files.empty())
+	{
+		return a_filename;
+	}
+	//Compare canonical paths as the directory listing may spell the path differently
+	std::string key = CanonicalPath(a_filename);
+	int index = 0;
+	for (int i = 0; i < (int)files.size(); ++i)
+	{
+		if (CanonicalPath(files[i]) == key)
+		{
+			index = i;
+			break;
+		}
+	}
+	int count = (int)files.size();
+	return files[(((index + a_offset) % count) + count) % count];
+}
+
+void ModelCache::PrefetchNeighbours(const std::string& a_filename, int a_range)
+{
+	for (int offset = -a_range; offset <= a_range; ++offset)
+	{
+		if (offset == 0) { continue; }
+		std::string filename = GetNeighbour(a_filename, offset);
+		std::string key = CanonicalPath(filename);
+		if (m_lookup.find(key) != m_lookup.end())
+		{
+			continue;	//Already cached
+		}
+		if (m_prefetches.find(key) != m_prefetches.end())
+		{
+			continue;	//Already being prefetched
+		}
+		std::shared_ptr<Prefetch> prefetch = std::make_shared<Prefetch>();
+		prefetch->state = Prefetch_Queued;
+		prefetch->model = nullptr;
+		m_prefetches[key] = prefetch;
+		//Only the CPU side parse happens on the worker, textures need the GL context and are loaded in Update
+		//The job keeps its prefetch (and so its counter) alive until it has finished
+		JobSystem::GetInstance()->Run([prefetch, filename]()
+		{
+			int queued = Prefetch_Queued;
+			if (!prefetch->state.compare_exchange_strong(queued, Prefetch_Running))
+			{
+				return;	//Cancelled before it started
+			}
+			OBJModel* model = new OBJModel();
+			model->SetLogging(false);
+			if (!model->Load(filename))
+			{
+				delete model;
+				model = nullptr;
+			}
+			prefetch->model = model;
+			prefetch->state = Prefetch_Complete;
+		}, &prefetch->job, JobSystem::LowPriority);
+	}
+}
+
+bool ModelCache::CancelOrWait(Prefetch& a_prefetch)
+{
+	int queued = Prefetch_Queued;
+	if (a_prefetch.state.compare_exchange_strong(queued, Prefetch_Cancelled))
+	{
+		return true;
+	}
+	JobSystem::GetInstance()->Wait(a_prefetch.job);
+	return false;
+}
+
+OBJModel* ModelCache::TakePrefetched(const std::string& a_key)
+{
+	auto iter = m_prefetches.find(a_key);
+	if (iter == m_prefetches.end())
+	{
+		return nullptr;
+	}
+	std::shared_ptr<Prefetch> prefetch = iter->second;
+	m_prefetches.erase(iter);
+	//A low priority job that has not started may sit behind other background work for a while, loading the file here
+	//is quicker than waiting for a worker to reach it. One that is already loading is finished rather than repeated
+	if (CancelOrWait(*prefetch))
+	{
+		return nullptr;
+	}
+	return prefetch->model;
+}
+
+void ModelCache::Update()
+{
+	//Cached models sample their textures as they finish streaming, whether they are shown or not
+	for (auto iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+	{
+		iter->buffers->RefreshMaterials();
+	}
+	//Promote one completed prefetch per frame so texture loading is spread across frames
+	for (auto iter = m_prefetches.begin(); iter != m_prefetches.end(); ++iter)
+	{
+		if (iter->second->state.load() != Prefetch_Complete)
+		{
+			continue;
+		}
+		std::string key = iter->first;
+		OBJModel* model = iter->second->model;
+		m_prefetches.erase(iter);
+		if (model == nullptr)
+		{
+			break;
+		}
+		//A prefetch is a guess, it must not push out a model that has actually been viewed. Checked before inserting as
+		//a prefetch at the least recently used end would be the first thing Evict removed
+		size_t bytes = model->GetMemoryUsage().Total();
+		if (m_lookup.find(key) != m_lookup.end() || m_usedBytes + bytes > m_budgetBytes)
+		{
+			delete model;
+			break;
+		}
+		//Prefetched models go in at the least recently used end so they are the first to go if space is needed
+		EntryList::iterator entry = Insert(key, model);
+		m_entries.splice(m_entries.end(), m_entries, entry);
+		break;
+	}
+}
@@ -4,21 +4,32 @@
 #include "Observer.h"
 #include "Utilities.h"
 #include "Skybox.h"
+#include "ModelCache.h"
+#include "ModelBuffers.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "GLState.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "TextureManager.h"
+#include "TextureStreamer.h"
+#include "Profiler.h"
 #include "OBJ_Loader.h"
+#include "OBJ_BatchLoader.h"
 #include <iostream>
+#include <chrono>
 
 //Including imgui header
 #include <imgui.h>
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_glfw.h>
 
-ModelRenderer::ModelRenderer()
+ModelRenderer::ModelRenderer() : m_depthProgram(0), m_renderQueue(nullptr), m_objProgramSlot(0), m_depthPrepass(false), m_renderOrderFrames(0), m_scene(nullptr), m_sceneRoot(0), m_sceneBuffers(nullptr), m_sceneGrid(0), m_sceneTinted(false), m_objModel(nullptr), m_objBuffers(nullptr), m_modelCache(nullptr), m_skybox(nullptr), m_drawTimeMs(0.f), m_frameUploadBytes(0), m_frameDrawCalls(0),
+	m_batchLoader(nullptr), m_batchRunning(false), m_batchComplete(false), m_batchUniqueTextures(0)
 {
+	m_renderOrderMs[0] = m_renderOrderMs[1] = 0.f;
 }
 
 ModelRenderer::~ModelRenderer()
@@ -30,6 +41,10 @@ bool ModelRenderer::OnCreate()
 	m_currentFile = "resource/models/OfficeChair.obj";
 	m_previousFile = m_currentFile;
 	m_scale = 1.f;
+	m_modelTranslation = glm::vec3(0.f);
+	m_modelRotation = glm::vec3(0.f);
+	m_instanceGrid = 1;
+	m_tintInstances = false;
 	m_renderSkybox = true;
 
 	Dispatcher* dp = Dispatcher::GetInstance();
@@ -43,13 +58,21 @@ bool ModelRenderer::OnCreate()
 	m_backgroundColour = glm::vec3(0.41f, 0.7f, 0.71f);
 	//Set the clear colour and enable depth testing and backface culling
 	glClearColor(m_backgroundColour.x, m_backgroundColour.y, m_backgroundColour.z, 1.f);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
+	GLState::Enable(GL_DEPTH_TEST);
+	GLState::Enable(GL_CULL_FACE);
 
 	//Create shader program
 	unsigned int vertexShader = ShaderUtil::LoadShader("resource/shaders/vertex.glsl", GL_VERTEX_SHADER);
 	unsigned int fragmentShader = ShaderUtil::LoadShader("resource/shaders/fragment.glsl", GL_FRAGMENT_SHADER);
 	m_uiProgram = ShaderUtil::CreateProgram(vertexShader, fragmentShader);
+	ShaderUtil::BindUniformBlock(m_uiProgram, "FrameData", ShaderUtil::FrameDataBinding);
+
+	//Create the per frame uniform buffer, every program reads the camera and light from it
+	glGenBuffers(1, &m_frameDataBuffer);
+	GLState::BindBuffer(GL_UNIFORM_BUFFER, m_frameDataBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+	GLState::BindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::BindBufferBase(GL_UNIFORM_BUFFER, ShaderUtil::FrameDataBinding, m_frameDataBuffer);
 
 	//Create a grid of lines to be drawn during our update
 	//Create a 10 x 10 square grid
@@ -67,9 +90,12 @@ bool ModelRenderer::OnCreate()
 		lines[j + 1].v1.position = glm::vec4(-10, 0.f, -10.f + i, 1.f);
 		lines[j + 1].v1.colour = (i == 10) ? glm::vec4(1.f, 1.f, 1.f, 1.f) : glm::vec4(0.f, 0.f, 0.f, 1.f);
 	}
+	//Create a vertex array to record the line vertex layout so the grid can be drawn without respecifying it
+	glGenVertexArrays(1, &m_lineVAO);
+	GLState::BindVertexArray(m_lineVAO);
 	//Create a vertex buffer to hold our line data
 	glGenBuffers(1, &m_lineVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
 
 	//fill vertex buffer with line data
 	glBufferData(GL_ARRAY_BUFFER, 42 * sizeof(Line), lines, GL_STATIC_DRAW);
@@ -86,7 +112,8 @@ bool ModelRenderer::OnCreate()
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), ((char*)0) + 16);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindVertexArray(0);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//Create a world-space matrix for a camera
 	m_cameraMatrix = glm::inverse(glm::lookAt(glm::vec3(10, 10, 10),
@@ -101,252 +128,598 @@ bool ModelRenderer::OnCreate()
 	m_skybox = new Skybox();
 	m_skybox->SetupSkybox();
 
-	m_objModel = new OBJModel();
-	if (m_objModel->Load(m_currentFile , m_scale))
-	{
-		TextureManager* pTM = TextureManager::GetInstance();
-		//Load in texture for model if any are present
-		for (int i = 0; i < m_objModel->GetMaterialCount(); i++)
-		{
-			OBJMaterial* mat = m_objModel->GetMaterialByIndex(i);
-			for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
-			{
-				if (mat->textureFileNames[n].size() > 0)
-				{
-					unsigned int textureID = pTM->LoadTexture(mat->textureFileNames[n].c_str());
-					mat->textureIDs[n] = textureID;
-				}
-			}
-		}
-
-		//Create OBJ shader program
-		unsigned int obj_vertexShader = ShaderUtil::LoadShader("resource/shaders/obj_vertex.glsl", GL_VERTEX_SHADER);
-		unsigned int obj_fragmentShader = ShaderUtil::LoadShader("resource/shaders/obj_fragment.glsl", GL_FRAGMENT_SHADER);
-		m_objProgram = ShaderUtil::CreateProgram(obj_vertexShader, obj_fragmentShader);
-		//Setup vertex and index buffer for OBJ rendering
-		glGenBuffers(2, m_objModelBuffer);
-		//Setup vertex buffer date
-		glBindBuffer(GL_ARRAY_BUFFER, m_objModelBuffer[0]);
-
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-	else
+	//Create OBJ shader program
+	unsigned int obj_vertexShader = ShaderUtil::LoadShader("resource/shaders/obj_vertex.glsl", GL_VERTEX_SHADER);
+	unsigned int obj_fragmentShader = ShaderUtil::LoadShader("resource/shaders/obj_fragment.glsl", GL_FRAGMENT_SHADER);
+	m_objProgram = ShaderUtil::CreateProgram(obj_vertexShader, obj_fragmentShader);
+	ShaderUtil::BindUniformBlock(m_objProgram, "FrameData", ShaderUtil::FrameDataBinding);
+	m_renderQueue = new RenderQueue();
+	RenderQueue::ProgramUniforms objUniforms;
+	objUniforms.program = m_objProgram;
+	objUniforms.drawBase = ShaderUtil::GetUniform<int>(m_objProgram, "DrawBase");
+	objUniforms.instanceBase = ShaderUtil::GetUniform<int>(m_objProgram, "InstanceBase");
+	m_objProgramSlot = m_renderQueue->AddProgram(objUniforms);
+	//The depth program reuses the obj vertex shader so its depth is identical to the shading pass
+	unsigned int depth_fragmentShader = ShaderUtil::LoadShader("resource/shaders/depth_fragment.glsl", GL_FRAGMENT_SHADER);
+	m_depthProgram = ShaderUtil::CreateProgram(obj_vertexShader, depth_fragmentShader);
+	ShaderUtil::BindUniformBlock(m_depthProgram, "FrameData", ShaderUtil::FrameDataBinding);
+	RenderQueue::ProgramUniforms depthUniforms;
+	depthUniforms.program = m_depthProgram;
+	depthUniforms.drawBase = ShaderUtil::GetUniform<int>(m_depthProgram, "DrawBase");
+	depthUniforms.instanceBase = ShaderUtil::GetUniform<int>(m_depthProgram, "InstanceBase");
+	m_renderQueue->SetDepthProgram(m_objProgramSlot, depthUniforms);
+	m_renderQueue->SetDepthPrepass(m_depthPrepass);
+	m_scene = new Scene();
+	//Sampler units never change so are set once, the render queue binds diffuse, specular and normal textures to units 0, 1 and 2
+	GLState::UseProgram(m_objProgram);
+	ShaderUtil::GetUniform<int>(m_objProgram, "DiffuseTexture").Set(0);
+	ShaderUtil::GetUniform<int>(m_objProgram, "SpecularTexture").Set(1);
+	ShaderUtil::GetUniform<int>(m_objProgram, "NormalTexture").Set(2);
+	GLState::UseProgram(0);
+
+	//Models are loaded through the cache, textures are loaded along with the model
+	m_modelCache = new ModelCache();
+	m_objModel = m_modelCache->Acquire(m_currentFile);
+	if (m_objModel == nullptr)
 	{
 		std::cout << "Failed to load Model" << std::endl;
 		return false;
 	}
+	m_objBuffers = m_modelCache->GetBuffers(m_objModel);
+	m_modelCache->PrefetchNeighbours(m_currentFile);
 
 	return  true;
 }
 
 void ModelRenderer::Update(float deltaTime)
 {
+	//Uploads are counted from here to the end of Draw, this covers prefetched models promoted by the cache
+	ModelBuffers::ResetUploadedBytes();
 	Utility::freeMovement(m_cameraMatrix, deltaTime, 10.f);
 	//Set yup an imgui window to control BG colour
 	ImGuiIO& io = ImGui::GetIO();
 	ImVec2 window_size = ImVec2(400.f, 300.f);
 	ImVec2 window_pos = ImVec2(io.DisplaySize.x * 0.01f, io.DisplaySize.y * 0.05f);
-	char pathBuffer[500] = { };
+	static char pathBuffer[500] = { };
 	if (ImGui::Begin("Model Render Options"))
 	{
-		static float scale = m_scale;
 		static bool checked = m_renderSkybox;
 		//Allows user to turn on an off the skybox
 		ImGui::Checkbox("Render Skybox", &checked);
+		//Switching the ordering restarts the timing average of the new ordering
+		if (ImGui::Checkbox("Depth Pre-pass, Skybox Last", &m_depthPrepass))
+		{
+			m_renderQueue->SetDepthPrepass(m_depthPrepass);
+			m_renderOrderFrames = 0;
+		}
 		//Allow to change background colouring
 		ImGui::ColorEdit3("Background Colour: ", glm::value_ptr(m_backgroundColour));
 		//Allow the user to input a obj model location
 		ImGui::InputText("File Path: ", pathBuffer, IM_ARRAYSIZE(pathBuffer));
-		//Allow the user to change the model scale
-		ImGui::SliderFloat("Model Scale: ", &scale, 0.1f, 10.f);
+		//Allow the user to change the model transform, this only changes the world matrix so applies immediately
+		ImGui::SliderFloat("Model Scale: ", &m_scale, 0.1f, 10.f);
+		ImGui::DragFloat3("Model Position: ", glm::value_ptr(m_modelTranslation), 0.1f);
+		ImGui::SliderFloat3("Model Rotation: ", glm::value_ptr(m_modelRotation), -180.f, 180.f);
+		//Instanced copies share the model's buffers, the number of draw calls stays the same as the grid grows
+		ImGui::SliderInt("Instance Grid: ", &m_instanceGrid, 1, 32);
+		ImGui::Checkbox("Tint Instances", &m_tintInstances);
 		if (glfwGetKey(m_window, GLFW_KEY_ENTER) == GLFW_PRESS)
 		{
-			m_scale = scale;
-			m_currentFile = pathBuffer;
-			std::fill_n(pathBuffer, IM_ARRAYSIZE(pathBuffer), ' ');
-			std::cout << m_currentFile << std::endl;
+			if (pathBuffer[0] != '\0')
+			{
+				m_currentFile = pathBuffer;
+				std::fill_n(pathBuffer, IM_ARRAYSIZE(pathBuffer), '\0');
+				std::cout << m_currentFile << std::endl;
+			}
+		}
+		//Flip through the other models in the same directory, neighbours are prefetched in the background
+		if (ImGui::Button("< Previous Model"))
+		{
+			m_currentFile = ModelCache::GetNeighbour(m_previousFile, -1);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Next Model >"))
+		{
+			m_currentFile = ModelCache::GetNeighbour(m_previousFile, 1);
 		}
+		ImGui::Text("%s", m_previousFile.c_str());
 		m_renderSkybox = checked;
 	}
 	ImGui::End();
+
+	showMemoryData();
+	showBatchLoader();
+
+	{
+		//Streamed textures are uploaded before the cache refreshes the materials sampling them
+		Profiler::CPUScope scope("Texture Streaming");
+		TextureManager::GetInstance()->Update();
+	}
+	m_modelCache->Update();
 }
 
 void ModelRenderer::Draw()
 {
-	if (m_currentFile != m_objModel->GetFilename())
+	std::chrono::high_resolution_clock::time_point drawStart = std::chrono::high_resolution_clock::now();
+	m_frameDrawCalls = 0;
+
+	if (m_currentFile != m_previousFile)
 	{
-		m_objModel->Unload();
-		if (m_objModel->Load(m_currentFile, (m_scale)))
+		Profiler::CPUScope scope("Model Load");
+		//Recently viewed models come straight from the cache, the previous model stays cached
+		OBJModel* model = m_modelCache->Acquire(m_currentFile);
+		if (model != nullptr)
 		{
-			TextureManager* pTM = TextureManager::GetInstance();
-			//Load in texture for model if any are present
-			for (int i = 0; i < m_objModel->GetMaterialCount(); i++)
-			{
-				OBJMaterial* mat = m_objModel->GetMaterialByIndex(i);
-				for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
-				{
-					if (mat->textureFileNames[n].size() > 0)
-					{
-						unsigned int textureID = pTM->LoadTexture(mat->textureFileNames[n].c_str());
-						mat->textureIDs[n] = textureID;
-					}
-				}
-			}
-
-			//Create OBJ shader program
-			unsigned int obj_vertexShader = ShaderUtil::LoadShader("resource/shaders/obj_vertex.glsl", GL_VERTEX_SHADER);
-			unsigned int obj_fragmentShader = ShaderUtil::LoadShader("resource/shaders/obj_fragment.glsl", GL_FRAGMENT_SHADER);
-			m_objProgram = ShaderUtil::CreateProgram(obj_vertexShader, obj_fragmentShader);
-			//Setup vertex and index buffer for OBJ rendering
-			glGenBuffers(2, m_objModelBuffer);
-			//Setup vertex buffer date
-			glBindBuffer(GL_ARRAY_BUFFER, m_objModelBuffer[0]);
-
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			m_objModel = model;
+			m_objBuffers = m_modelCache->GetBuffers(m_objModel);
 			m_previousFile = m_currentFile;
+			m_modelCache->PrefetchNeighbours(m_currentFile);
 		}
 		else
 		{
 			std::cout << "Failed to load Model" << std::endl;
-			m_objModel->Load(m_previousFile, m_scale);
 			m_currentFile = m_previousFile;
 		}
 	}
-
 	//Clear the backbuffer
 	glClearColor(m_backgroundColour.x, m_backgroundColour.y, m_backgroundColour.z, 1.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	//Get the view matrix from the world-space camera matrix
 	glm::mat4 viewMatrix = glm::inverse(m_cameraMatrix);
-	glm::mat4 projectionViewMatrix = m_projectionMatrix * viewMatrix;
 
-	//Render the skybox
-	if (m_renderSkybox)
+	//Camera and light are the same for every draw, one buffer write shares them with every program
+	FrameData frameData;
+	frameData.viewMatrix = viewMatrix;
+	frameData.projectionMatrix = m_projectionMatrix;
+	frameData.projectionViewMatrix = m_projectionMatrix * viewMatrix;
+	frameData.cameraPosition = m_cameraMatrix[3];
+	frameData.lightDirection = glm::normalize(glm::vec4(-10.f, -8.f, -10.f, 0.f));
+	GLState::BindBufferBase(GL_UNIFORM_BUFFER, ShaderUtil::FrameDataBinding, m_frameDataBuffer);
+	GLState::BindBuffer(GL_UNIFORM_BUFFER, m_frameDataBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData);
+
+	//Render the skybox first so the model draws over it, or last with the pre-pass so covered pixels are never shaded
+	if (m_renderSkybox && !m_depthPrepass)
 	{
-		m_skybox->RenderSkybox(viewMatrix, m_projectionMatrix);
+		Profiler::GPUScope gpuScope("Skybox");
+		m_skybox->RenderSkybox();
 	}
 
-	//Enable shaders
-	glUseProgram(m_uiProgram);
+	{
+		Profiler::GPUScope gpuScope("Grid");
+		//Enable shaders
+		GLState::UseProgram(m_uiProgram);
+
+		//The grid was uploaded in OnCreate, its vertex array holds the buffer and attribute layout
+		GLState::BindVertexArray(m_lineVAO);
+		glDrawArrays(GL_LINES, 0, 42 * 2);
+		++m_frameDrawCalls;
+	}
 
-	//Send the projection matrix to the vertex shader
-	//Ask the shader program for the location of the projection-view-matrix uniform variable
-	unsigned int projectionViewUniformLocation = glGetUniformLocation(m_uiProgram, "ProjectionViewMatrix");
-	//Send this location a pointer to our glm::mat4 (Send across float data)
-	glUniformMatrix4fv(projectionViewUniformLocation , 1, false, glm::value_ptr(projectionViewMatrix));
+	{
+		//The render queue times its own depth pre-pass and model passes
+		//Queue every mesh, the queue sorts them by state and depth and only binds what changes between draws
+		m_renderQueue->Begin(viewMatrix, m_projectionMatrix, 1000.f, (float)m_windowHeight);
+		if (m_objBuffers != m_sceneBuffers || m_instanceGrid != m_sceneGrid || m_tintInstances != m_sceneTinted)
+		{
+			Profiler::CPUScope scope("Scene Build");
+			BuildScene();
+		}
+		m_scene->SetLocalTransform(m_sceneRoot, m_modelTranslation, glm::radians(m_modelRotation), glm::vec3(m_scale));
+		{
+			Profiler::CPUScope scope("Scene Update");
+			m_scene->Update();
+		}
+		m_scene->Submit(*m_renderQueue, m_objProgramSlot, viewMatrix, m_projectionMatrix, (float)m_windowHeight);
+		m_renderQueue->ExecuteOpaque();
+		//With the pre-pass the sky fills what the opaque draws left uncovered, transparent surfaces then blend over it
+		if (m_renderSkybox && m_depthPrepass)
+		{
+			Profiler::GPUScope gpuScope("Skybox");
+			m_skybox->RenderSkybox();
+		}
+		m_renderQueue->ExecuteTransparent();
+		if (m_objBuffers != nullptr)
+		{
+			m_objBuffers->MarkTexturesUsed();
+		}
+	}
+	//GPU results lag a couple of frames behind so the first frames after switching still time the old ordering
+	Profiler* profiler = Profiler::GetInstance();
+	//A pass keeps its last result once it stops running so the pre-pass only counts while it is on
+	float orderMs = profiler->GetGPUTime("Skybox") + profiler->GetGPUTime("Model") + profiler->GetGPUTime("Transparent") + (m_depthPrepass ? profiler->GetGPUTime("Depth Pre-pass") : 0.f);
+	float& averageMs = m_renderOrderMs[m_depthPrepass ? 1 : 0];
+	if (++m_renderOrderFrames > 3)
+	{
+		averageMs = (m_renderOrderFrames == 4) ? orderMs : glm::mix(averageMs, orderMs, 0.05f);
+	}
+	m_frameDrawCalls += m_renderQueue->GetStats().drawCalls;
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glBufferData(GL_ARRAY_BUFFER, 42 * sizeof(Line), lines, GL_STATIC_DRAW);
-	//Enable vertex array, as we're sending an array of vertices
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	m_frameUploadBytes = ModelBuffers::GetUploadedBytes();
+	m_drawTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - drawStart).count();
+}
 
-	//Specify where our vertex array is, how many components each vertex has,
-	//the data type of each component and wether the data is normalised or not
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), ((char*)0) + 16);
+void ModelRenderer::BuildScene()
+{
+	m_scene->Clear();
+	m_sceneRoot = m_scene->CreateNode();
+	m_sceneBuffers = m_objBuffers;
+	m_sceneGrid = m_instanceGrid;
+	m_sceneTinted = m_tintInstances;
+	if (m_objBuffers == nullptr)
+	{
+		return;
+	}
+	//Copies are placed in model space under the root so the whole grid moves, turns and scales together
+	//Spacing by the model's footprint keeps neighbours from overlapping
+	glm::vec3 size = m_objBuffers->GetBoundsMax() - m_objBuffers->GetBoundsMin();
+	float spacing = std::max(size.x, size.z) * 1.25f;
+	float gridOffset = (m_instanceGrid - 1) * spacing * 0.5f;
+	for (int z = 0; z < m_instanceGrid; ++z)
+	{
+		for (int x = 0; x < m_instanceGrid; ++x)
+		{
+			Scene::NodeID node = m_scene->CreateNode(m_sceneRoot, m_objBuffers);
+			m_scene->SetLocalTransform(node, glm::vec3(x * spacing - gridOffset, 0.f, z * spacing - gridOffset), glm::vec3(0.f), glm::vec3(1.f));
+			if (m_tintInstances)
+			{
+				//Cheap hash of the grid position so each copy keeps its colour when the grid is resized
+				float hue = glm::fract((x * 73 + z * 151) * 0.6180339f);
+				m_scene->SetTint(node, glm::vec4(glm::rgbColor(glm::vec3(hue * 360.f, 0.5f, 1.f)), 1.f));
+			}
+		}
+	}
+}
 
-	glDrawArrays(GL_LINES, 0, 42 * 2);
+void ModelRenderer::showFrameStats()
+{
+	ImGui::Separator();
+	ImGui::Text("Draw CPU Time: %.3f ms (%u draw calls)", m_drawTimeMs, m_frameDrawCalls);
+	if (m_renderQueue != nullptr)
+	{
+		const RenderQueue::Stats& queueStats = m_renderQueue->GetStats();
+		ImGui::Text("Render Queue: %u meshes, %u drawn instanced (%s)", queueStats.draws, queueStats.instances,
+			ModelBuffers::UseMultiDrawIndirect() ? "multi-draw-indirect" : "per mesh draws");
+		ImGui::Text("  Binds: %u program  %u vertex array  %u material  %u texture",
+			queueStats.programBinds, queueStats.vertexArrayBinds, queueStats.materialBinds, queueStats.textureBinds);
+		ImGui::Text("  Binds Saved: %u", queueStats.bindsSaved);
+		Profiler* profiler = Profiler::GetInstance();
+		if (m_depthPrepass)
+		{
+			ImGui::Text("Depth Pre-pass: %.3f ms GPU (%u draw calls)  Shading: %.3f ms  Skybox: %.3f ms", profiler->GetGPUTime("Depth Pre-pass"),
+				queueStats.prepassDrawCalls, profiler->GetGPUTime("Model"), profiler->GetGPUTime("Skybox"));
+		}
+		else
+		{
+			ImGui::Text("Skybox First: %.3f ms GPU  Model: %.3f ms", profiler->GetGPUTime("Skybox"), profiler->GetGPUTime("Model"));
+		}
+		//Both orderings are kept so they can be compared after toggling, a zero has not been measured yet
+		ImGui::Text("  Skybox + Model GPU: %.3f ms skybox first, %.3f ms with pre-pass", m_renderOrderMs[0], m_renderOrderMs[1]);
+		if (profiler->HasPipelineStatistics())
+		{
+			//Fragment shader invocations show the overdraw the pre-pass removes
+			for (const Profiler::GPUPassResult& pass : profiler->GetGPUResults())
+			{
+				if (pass.name == "Skybox" || pass.name == "Model")
+				{
+					ImGui::Text("  %s Fragments Shaded: %llu", pass.name.c_str(), (unsigned long long)pass.fragmentInvocations);
+				}
+			}
+		}
+		ImGui::Text("  Textures: %s", (m_objBuffers != nullptr && m_objBuffers->UsesBindlessTextures()) ? "bindless handles" : "bound per draw");
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		FrustumCuller& culler = m_renderQueue->GetCuller();
+		const FrustumCuller::Stats& cullStats = culler.GetStats();
+		ImGui::Text("Culling: %u visible  %u frustum culled  %u small culled", cullStats.visible, cullStats.frustumCulled, cullStats.smallCulled);
+		bool cullEnabled = culler.IsEnabled();
+		if (ImGui::Checkbox("Cull Meshes", &cullEnabled))
+		{
+			culler.SetEnabled(cullEnabled);
+		}
+		float minPixels = culler.GetMinPixelSize();
+		if (ImGui::SliderFloat("Min Pixel Size", &minPixels, 0.f, 16.f, "%.1f px"))
+		{
+			culler.SetMinPixelSize(minPixels);
+		}
 
-	glUseProgram(0);
+		OcclusionCuller& occlusion = m_renderQueue->GetOcclusionCuller();
+		const OcclusionCuller::Stats& occlusionStats = occlusion.GetStats();
+		ImGui::Text("Occlusion: %u of %u tested occluded", occlusionStats.occluded, occlusionStats.tested);
+		ImGui::Text("  %u occluders (%u triangles) rasterized at %ux%u in %.3f ms", occlusionStats.occluders, occlusionStats.occluderTriangles,
+			OcclusionCuller::Width, OcclusionCuller::Height, occlusionStats.rasterMs);
+		bool occlusionEnabled = occlusion.IsEnabled();
+		if (ImGui::Checkbox("Occlusion Culling", &occlusionEnabled))
+		{
+			occlusion.SetEnabled(occlusionEnabled);
+		}
+	}
+	if (m_scene != nullptr)
+	{
+		const Scene::Stats& sceneStats = m_scene->GetStats();
+		ImGui::Text("Scene: %u nodes in %u levels, %u updated in %.3f ms, %u visible", sceneStats.nodes, sceneStats.levels,
+			sceneStats.updated, sceneStats.updateMs, sceneStats.visible);
+	}
+	ImGui::Text("Buffer Upload: %.1f KB/frame", m_frameUploadBytes / 1024.f);
+}
 
+ModelRenderer::MemoryStats ModelRenderer::GetMemoryStats() const
+{
+	MemoryStats stats = {};
+	if (m_objModel != nullptr)
+	{
+		stats.modelCPU = m_objModel->GetMemoryUsage();
+	}
+	if (m_objBuffers != nullptr)
+	{
+		stats.modelGPU = m_objBuffers->GetGPUMemory();
+	}
+	TextureManager* pTM = TextureManager::GetInstance();
+	stats.textureGPU = pTM->GetTotalGPUMemory();
+	stats.textureCount = pTM->GetTextureCount();
+	if (m_skybox != nullptr)
+	{
+		stats.skyboxGPU = m_skybox->GetGPUMemory();
+	}
+	if (m_modelCache != nullptr)
+	{
+		stats.modelCacheCPU = m_modelCache->GetUsedBytes();
+		stats.modelCacheEntries = m_modelCache->GetEntryCount();
+	}
+	return stats;
+}
 
+void ModelRenderer::showMemoryData()
+{
+	const float KB = 1024.f;
+	ImGuiIO& io = ImGui::GetIO();
+	//Sit the panel below the frame data overlay in the top left corner
+	ImGui::SetNextWindowPos(ImVec2(10.f, io.DisplaySize.y * 0.3f), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Memory Usage"))
+	{
+		MemoryStats stats = GetMemoryStats();
+		ImGui::Text("Model CPU: %.1f KB", stats.modelCPU.Total() / KB);
+		ImGui::Text("  Vertices: %.1f KB  Indices: %.1f KB", stats.modelCPU.vertexBytes / KB, stats.modelCPU.indexBytes / KB);
+		ImGui::Text("  Materials: %.1f KB  Meshes: %.1f KB", stats.modelCPU.materialBytes / KB, stats.modelCPU.meshBytes / KB);
+		ImGui::Text("  Peak Parse Buffers: %.1f KB", stats.modelCPU.parseBufferBytes / KB);
+		ImGui::Text("Texture GPU: %.1f KB (%u textures)", stats.textureGPU / KB, stats.textureCount);
+		TextureStreamer* streamer = TextureManager::GetInstance()->GetStreamer();
+		const TextureStreamer::Stats& streamStats = streamer->GetStats();
+		ImGui::Text("  Streaming: %u decoding, %u uploading, %u loaded, %u failed", streamStats.decoding, streamStats.uploading,
+			streamStats.completed, streamStats.failed);
+		ImGui::Text("  Uploaded: %.1f KB this frame, ring %.1f / %.1f KB", streamStats.frameBytes / KB, streamStats.ringBytes / KB, streamStats.ringSize / KB);
+		int budgetKB = (int)(streamer->GetFrameBudget() / 1024);
+		if (ImGui::SliderInt("Upload Budget (KB)", &budgetKB, 256, 32 * 1024))
+		{
+			streamer->SetFrameBudget((size_t)budgetKB * 1024);
+		}
+		TextureManager* pTM = TextureManager::GetInstance();
+		bool limitTextures = pTM->GetMemoryBudget() != 0;
+		if (ImGui::Checkbox("Limit Texture Memory", &limitTextures))
+		{
+			pTM->SetMemoryBudget(limitTextures ? TextureManager::DefaultMemoryBudget : 0);
+		}
+		if (limitTextures)
+		{
+			int textureBudgetMB = (int)(pTM->GetMemoryBudget() / (1024 * 1024));
+			if (ImGui::SliderInt("Texture Budget (MB)", &textureBudgetMB, 16, 2048))
+			{
+				pTM->SetMemoryBudget((size_t)textureBudgetMB * 1024 * 1024);
+			}
+		}
+		ImGui::Text("  Trimmed: %u  Evicted: %u  Not trimmable (bindless): %u", pTM->GetTrimmedCount(), pTM->GetEvictedCount(), pTM->GetPinnedCount());
+		ImGui::Text("  Atlas: %u textures in %u pages", pTM->GetAtlasEntryCount(), pTM->GetAtlasPageCount());
+		ImGui::Text("Skybox GPU: %.1f KB", stats.skyboxGPU / KB);
+		ImGui::Text("Model GPU: %.1f KB", stats.modelGPU / KB);
+		ImGui::Text("Model Cache CPU: %.1f KB (%u models)", stats.modelCacheCPU / KB, stats.modelCacheEntries);
+		if (m_modelCache != nullptr)
+		{
+			ImGui::Text("  Hits: %u  Prefetch Hits: %u  Misses: %u", m_modelCache->GetHitCount(), m_modelCache->GetPrefetchHitCount(), m_modelCache->GetMissCount());
+		}
+		ImGui::Separator();
+		//Per mesh breakdown
+		if (m_objModel != nullptr && ImGui::TreeNode("Meshes", "Meshes (%u)", m_objModel->GetMeshCount()))
+		{
+			for (unsigned int i = 0; i < m_objModel->GetMeshCount(); ++i)
+			{
+				OBJMesh* pMesh = m_objModel->GetMeshByIndex(i);
+				ImGui::Text("%s: %.1f KB (%u verts, %u indices)", pMesh->m_name.c_str(), pMesh->GetMemoryUsage() / KB,
+					(unsigned int)pMesh->m_vertices.size(), (unsigned int)pMesh->m_indices.size());
+			}
+			ImGui::TreePop();
+		}
+		//Per texture breakdown
+		if (ImGui::TreeNode("Textures", "Textures (%u)", stats.textureCount))
+		{
+			std::vector<TextureManager::TextureMemoryInfo> textureInfo;
+			TextureManager::GetInstance()->GetMemoryUsage(textureInfo);
+			for (auto iter = textureInfo.begin(); iter != textureInfo.end(); ++iter)
+			{
+				ImGui::Text("%s: %ux%u %s, %u mips from %u, %u refs, unused %u frames, %.1f KB", iter->filename.c_str(), iter->width, iter->height,
+					iter->format, iter->mipLevels, iter->baseLevel, iter->refCount, iter->framesUnused, iter->gpuBytes / KB);
+			}
+			ImGui::TreePop();
+		}
+	}
+	ImGui::End();
+}
 
-	glUseProgram(m_objProgram);
-	//Set the projection view matrix for this shader
-	projectionViewUniformLocation = glGetUniformLocation(m_objProgram, "ProjectionViewMatrix");
-	//Send this location a pointer to the glm::mat4 (send across float data)
-	glUniformMatrix4fv(projectionViewUniformLocation, 1, false, glm::value_ptr(projectionViewMatrix));
-	for (int i = 0; i < m_objModel->GetMeshCount(); ++i)
+void ModelRenderer::showBatchLoader()
+{
+	static char directoryBuffer[500] = "resource/models";
+	static bool recursive = true;
+	if (ImGui::Begin("Batch Load"))
 	{
-		//Get the Model Matrix Location from the shader program
-		int modelMatrixUniformLocation = glGetUniformLocation(m_objProgram, "ModelMatrix");
-		//Send the OBJ Model's world matrix data across to the shader program
-		glUniformMatrix4fv(modelMatrixUniformLocation, 1, false, glm::value_ptr(m_objModel->GetWorldMatrix()));
-
-		int cameraPositionUniformLocation = glGetUniformLocation(m_objProgram, "camPos");
-		glUniform4fv(cameraPositionUniformLocation, 1, glm::value_ptr(m_cameraMatrix[3]));
-
-		OBJMesh* pMesh = m_objModel->GetMeshByIndex(i);
-		//send material data to shader
-		int kA_location = glGetUniformLocation(m_objProgram, "kA");
-		int kD_location = glGetUniformLocation(m_objProgram, "kD");
-		int kS_location = glGetUniformLocation(m_objProgram, "kS");
-
-		OBJMaterial* pMaterial = pMesh->m_material;
-		if (pMaterial != nullptr)
-		{
-			//Send the OBJ Model's world matrix data across to the shader program
-			glUniform4fv(kA_location, 1, glm::value_ptr(pMaterial->kA));
-			glUniform4fv(kD_location, 1, glm::value_ptr(pMaterial->kD));
-			glUniform4fv(kS_location, 1, glm::value_ptr(pMaterial->kS));
-
-			//Get the location of the diffuse texture
-			int texUniformLoc = glGetUniformLocation(m_objProgram, "DiffuseTexture");
-			glUniform1i(texUniformLoc, 0); //Set diffuse texture to be GL_Texture0
-
-			glActiveTexture(GL_TEXTURE0); //Set the active texture unit to texture0
-			//bind the texture for diffuse for this material to the texture0
-			glBindTexture(GL_TEXTURE_2D, pMaterial->textureIDs[OBJMaterial::TextureTypes::DiffuseTexture]);
-
-			//Get the location of the specular texture
-			texUniformLoc = glGetUniformLocation(m_objProgram, "SpecularTexture");
-			glUniform1i(texUniformLoc, 1); //Set diffuse texture to be GL_Texture1
-
-			glActiveTexture(GL_TEXTURE1); //Set the active texture unit to texture1
-			//bind the texture for diffuse for this material to the texture0
-			glBindTexture(GL_TEXTURE_2D, pMaterial->textureIDs[OBJMaterial::TextureTypes::SpecularTexture]);
-
-			//Get the location of the normal texture
-			texUniformLoc = glGetUniformLocation(m_objProgram, "NormalTexture");
-			glUniform1i(texUniformLoc, 2); //Set diffuse texture to be GL_Texture2
-
-			glActiveTexture(GL_TEXTURE2); //Set the active texture unit to texture2
-			//bind the texture for diffuse for this material to the texture2
-			glBindTexture(GL_TEXTURE_2D, pMaterial->textureIDs[OBJMaterial::TextureTypes::NormalTexture]);
-		}
-		else //No material to obtain lighting information from use defaults
-		{
-			//Send the OBJ Model's world matrix data across to the shader program
-			glUniform4fv(kA_location, 1, glm::value_ptr(glm::vec4(0.25f, 0.25f, 0.25f, 1.f)));
-			glUniform4fv(kD_location, 1, glm::value_ptr(glm::vec4(1.f, 1.f, 1.f, 1.f)));
-			glUniform4fv(kS_location, 1, glm::value_ptr(glm::vec4(1.f, 1.f, 1.f, 64.f)));
-		}
-		glBindBuffer(GL_ARRAY_BUFFER, m_objModelBuffer[0]);
-		glBufferData(GL_ARRAY_BUFFER, pMesh->m_vertices.size() * sizeof(OBJVertex), pMesh->m_vertices.data(), GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_objModelBuffer[1]);
-		glEnableVertexAttribArray(0);	//position
-		glEnableVertexAttribArray(1);	//normal
-		glEnableVertexAttribArray(2);	//uv coord
-
-		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), ((char*)0) + OBJVertex::PositionOffset);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(OBJVertex), ((char*)0) + OBJVertex::NormalOffset);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_TRUE, sizeof(OBJVertex), ((char*)0) + OBJVertex::UVCoordOffset);
-
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, pMesh->m_indices.size() * sizeof(unsigned int), pMesh->m_indices.data(), GL_STATIC_DRAW);
-		glDrawElements(GL_TRIANGLES, pMesh->m_indices.size(), GL_UNSIGNED_INT, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		ImGui::InputText("Directory", directoryBuffer, IM_ARRAYSIZE(directoryBuffer));
+		ImGui::Checkbox("Recursive", &recursive);
+		if (!m_batchRunning)
+		{
+			if (ImGui::Button("Load Directory"))
+			{
+				//Parse the files on the batch loader's workers without blocking the render loop
+				if (m_batchLoader == nullptr)
+				{
+					m_batchLoader = new OBJBatchLoader();
+				}
+				m_batchResults.clear();
+				m_batchRunning = true;
+				m_batchComplete = false;
+				std::string directory = directoryBuffer;
+				m_batchThread = std::thread([this, directory]()
+				{
+					m_batchResults = m_batchLoader->LoadDirectory(directory, recursive);
+					m_batchComplete = true;
+				});
+			}
+		}
+		else if (m_batchComplete)
+		{
+			if (m_batchThread.joinable())
+			{
+				m_batchThread.join();
+				LoadBatchTextures();
+			}
+			if (ReleaseBatchTextures())
+			{
+				m_batchRunning = false;
+			}
+			else
+			{
+				ImGui::Text("Loading textures...");
+			}
+		}
+		else
+		{
+			ImGui::Text("Loading...");
+		}
+
+		if (!m_batchResults.empty() && !m_batchRunning)
+		{
+			ImGui::Text("%u files, %u unique textures", (unsigned int)m_batchResults.size(), m_batchUniqueTextures);
+			ImGui::Columns(4);
+			ImGui::Text("File"); ImGui::NextColumn();
+			ImGui::Text("Load (ms)"); ImGui::NextColumn();
+			ImGui::Text("Size (KB)"); ImGui::NextColumn();
+			ImGui::Text("Status"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (auto iter = m_batchResults.begin(); iter != m_batchResults.end(); ++iter)
+			{
+				ImGui::Text("%s", iter->filename.c_str()); ImGui::NextColumn();
+				ImGui::Text("%.2f", iter->loadTimeMs); ImGui::NextColumn();
+				ImGui::Text("%.1f", iter->modelBytes / 1024.f); ImGui::NextColumn();
+				ImGui::Text("%s", iter->error.empty() ? "OK" : iter->error.c_str()); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+		}
 	}
+	ImGui::End();
+}
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(2);
+void ModelRenderer::LoadBatchTextures()
+{
+	//Textures need the GL context so they are resolved here on the main thread
+	//All models go through the one TextureManager so textures shared between files are only loaded once
+	TextureManager* pTM = TextureManager::GetInstance();
+	unsigned int texturesBefore = pTM->GetTextureCount();
+	for (auto iter = m_batchResults.begin(); iter != m_batchResults.end(); ++iter)
+	{
+		if (iter->model != nullptr)
+		{
+			pTM->LoadMaterialTextures(iter->model);
+		}
+	}
+	m_batchUniqueTextures = pTM->GetTextureCount() - texturesBefore;
+}
 
-	glUseProgram(0);
+bool ModelRenderer::ReleaseBatchTextures()
+{
+	//The batch is a validation pass, but a streamed texture released before it is ready is dropped undecoded
+	//So the references are held until every texture has either arrived or failed
+	TextureManager* pTM = TextureManager::GetInstance();
+	TextureStreamer* pStreamer = pTM->GetStreamer();
+	for (auto iter = m_batchResults.begin(); iter != m_batchResults.end(); ++iter)
+	{
+		if (iter->model == nullptr)
+		{
+			continue;
+		}
+		for (unsigned int i = 0; i < iter->model->GetMaterialCount(); i++)
+		{
+			OBJMaterial* mat = iter->model->GetMaterialByIndex(i);
+			for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
+			{
+				const Texture* pTexture = pTM->FindTexture(mat->textureIDs[n]);
+				if (pTexture != nullptr && pStreamer->IsStreaming(pTexture))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	for (auto iter = m_batchResults.begin(); iter != m_batchResults.end(); ++iter)
+	{
+		if (iter->model == nullptr)
+		{
+			continue;
+		}
+		for (unsigned int i = 0; i < iter->model->GetMaterialCount(); i++)
+		{
+			OBJMaterial* mat = iter->model->GetMaterialByIndex(i);
+			for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
+			{
+				if (mat->textureFileNames[n].empty())
+				{
+					continue;
+				}
+				//Loaded without streaming a failure leaves no ID, streamed it leaves a texture the streamer gave up on
+				const Texture* pTexture = pTM->FindTexture(mat->textureIDs[n]);
+				if (pTexture == nullptr || pStreamer->HasFailed(pTexture))
+				{
+					iter->error += (iter->error.empty() ? "Missing texture: " : ", ") + mat->textureFileNames[n];
+				}
+			}
+		}
+		pTM->ReleaseMaterialTextures(iter->model);
+		delete iter->model;
+		iter->model = nullptr;
+	}
+	return true;
 }
 
 void ModelRenderer::Destroy()
 {
-	delete m_objModel;
-	delete[] lines;
-	glDeleteBuffers(1, &m_lineVBO);
+	if (m_batchThread.joinable())
+	{
+		m_batchThread.join();
+	}
+	delete m_batchLoader;
+	m_batchLoader = nullptr;
+	//Models of a batch whose textures were still streaming hold references that must go before the TextureManager
+	for (auto iter = m_batchResults.begin(); iter != m_batchResults.end(); ++iter)
+	{
+		if (iter->model != nullptr)
+		{
+			TextureManager::GetInstance()->ReleaseMaterialTextures(iter->model);
+			delete iter->model;
+			iter->model = nullptr;
+		}
+	}
+	//The cache owns the model and its texture references so must go before the TextureManager
+	delete m_modelCache;
+	m_modelCache = nullptr;
+	m_objModel = nullptr;
+	m_objBuffers = nullptr;
+	GLState::DeleteVertexArray(m_lineVAO);
+	GLState::DeleteBuffer(m_lineVBO);
+	GLState::DeleteBuffer(m_frameDataBuffer);
+	delete m_scene;
+	m_scene = nullptr;
+	m_sceneBuffers = nullptr;
+	delete m_renderQueue;
+	m_renderQueue = nullptr;
 	ShaderUtil::DeleteProgram(m_uiProgram);
 	ShaderUtil::DeleteProgram(m_objProgram);
+	ShaderUtil::DeleteProgram(m_depthProgram);
 	TextureManager::DestroyInstance();
 	ShaderUtil::DestroyInstance();
 }
@@ -360,6 +733,9 @@ void ModelRenderer::OnWindowResize(WindowResizeEvent* e)
 		//Create a perspective projection matrix with a 90 degree field-of-view and widescreen aspect ratio
 		m_projectionMatrix = glm::perspective(glm::pi<float>() * 0.25f, e->GetWidth() / (float)e->GetHeight(), 0.1f, 1000.0f);
 		glViewport(0, 0, e->GetWidth(), e->GetHeight());
+		//Culling measures projected size against the current viewport
+		m_windowWidth = e->GetWidth();
+		m_windowHeight = e->GetHeight();
 	}
 	e->Handled();
 }
\ No newline at end of file
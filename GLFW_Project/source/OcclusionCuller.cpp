@@ -0,0 +1,299 @@
+#include "OcclusionCuller.h"
+#include "OBJ_Loader.h"
+#include "OBJ_JobSystem.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+OcclusionCuller::OcclusionCuller() : m_projectionView(1.f), m_occluders(), m_triangles(), m_depth(),
+	m_enabled(true), m_occluderMinPixels(64.f), m_maxOccluderTriangles(16384),
+	m_maxOccluders(16), m_stats()
+{
+	//Allocate the full pyramid once, each level halves the last down to a single texel
+	unsigned int width = Width;
+	unsigned int height = Height;
+	m_depth.push_back(std::vector<float>(width * height, 1.f));
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+		m_depth.push_back(std::vector<float>(width * height, 1.f));
+	}
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::Begin(const glm::mat4& a_projectionView)
+{
+	m_projectionView = a_projectionView;
+	m_occluders.clear();
+	std::fill(m_depth[0].begin(), m_depth[0].end(), 1.f);
+	m_stats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const OBJMesh* a_mesh, const glm::mat4& a_worldMatrix)
+{
+	if (a_mesh == nullptr || a_mesh->m_indices.size() < 3)
+	{
+		return;
+	}
+	unsigned int firstTriangle = m_occluders.empty() ? 0 :
+		m_occluders.back().firstTriangle + (unsigned int)m_occluders.back().mesh->m_indices.size() / 3;
+	Occluder occluder = { a_mesh, m_projectionView * a_worldMatrix, firstTriangle };
+	m_occluders.push_back(occluder);
+}
+
+void OcclusionCuller::Rasterize()
+{
+	if (!m_enabled)
+	{
+		return;
+	}
+	auto rasterStart = std::chrono::high_resolution_clock::now();
+	size_t triangleCount = m_occluders.empty() ? 0 : m_occluders.back().firstTriangle + m_occluders.back().mesh->m_indices.size() / 3;
+	m_triangles.resize(triangleCount);
+
+	//Occluders write disjoint ranges of the triangle list so they transform in parallel without locking
+	JobSystem* jobSystem = JobSystem::GetInstance();
+	jobSystem->ParallelFor(0, (unsigned int)m_occluders.size(), 1, [this](unsigned int a_first, unsigned int a_last)
+	{
+		for (unsigned int i = a_first; i < a_last; ++i)
+		{
+			TransformOccluder(m_occluders[i]);
+		}
+	});
+
+	//Each band owns its rows of the depth buffer, every band walks every triangle and only fills its own rows
+	unsigned int bandCount = (Height + BandHeight - 1) / BandHeight;
+	jobSystem->ParallelFor(0, bandCount, 1, [this](unsigned int a_first, unsigned int a_last)
+	{
+		for (unsigned int band = a_first; band < a_last; ++band)
+		{
+			RasterizeBand(band * BandHeight, std::min((band + 1) * BandHeight, Height));
+		}
+	});
+	BuildPyramid();
+
+	m_stats.occluders = (unsigned int)m_occluders.size();
+	m_stats.occluderTriangles = (unsigned int)std::count_if(m_triangles.begin(), m_triangles.end(),
+		[](const ScreenTriangle& a_triangle) { return a_triangle.valid; });
+	m_stats.rasterMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - rasterStart).count();
+}
+
+void OcclusionCuller::TransformOccluder(const Occluder& a_occluder)
+{
+	//Vertices to clip space with one SSE multiply-add per matrix column
+	const std::vector<OBJVertex>& vertices = a_occluder.mesh->m_vertices;
+	std::vector<glm::vec4> clip(vertices.size());
+	const __m128 column0 = _mm_loadu_ps(&a_occluder.clipMatrix[0][0]);
+	const __m128 column1 = _mm_loadu_ps(&a_occluder.clipMatrix[1][0]);
+	const __m128 column2 = _mm_loadu_ps(&a_occluder.clipMatrix[2][0]);
+	const __m128 column3 = _mm_loadu_ps(&a_occluder.clipMatrix[3][0]);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const glm::vec4& position = vertices[i].position;
+		__m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(position.x)), _mm_mul_ps(column1, _mm_set1_ps(position.y))),
+			_mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(position.z)), column3));
+		_mm_storeu_ps(&clip[i][0], result);
+	}
+
+	const std::vector<unsigned int>& indices = a_occluder.mesh->m_indices;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		ScreenTriangle& triangle = m_triangles[a_occluder.firstTriangle + i / 3];
+		triangle.valid = true;
+		for (unsigned int v = 0; v < 3; ++v)
+		{
+			const glm::vec4& p = clip[indices[i + v]];
+			//Dropping a triangle that crosses the near plane only loses occlusion, it never hides anything visible
+			if (p.w <= 0.f || p.z < -p.w)
+			{
+				triangle.valid = false;
+				break;
+			}
+			triangle.x[v] = (p.x / p.w * 0.5f + 0.5f) * Width;
+			triangle.y[v] = (p.y / p.w * 0.5f + 0.5f) * Height;
+			triangle.z[v] = std::min(p.z / p.w * 0.5f + 0.5f, 1.f);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeBand(unsigned int a_firstRow, unsigned int a_lastRow)
+{
+	float* depth = m_depth[0].data();
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	for (const ScreenTriangle& triangle : m_triangles)
+	{
+		if (!triangle.valid)
+		{
+			continue;
+		}
+		//Pixel bounds of the triangle clipped to this band, x is aligned down so rows are walked four pixels at a time
+		float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+		float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+		float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+		float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+		int startX = std::max(0, (int)floorf(minX)) & ~3;
+		int endX = std::min((int)Width - 1, (int)ceilf(maxX));
+		int startY = std::max((int)a_firstRow, (int)floorf(minY));
+		int endY = std::min((int)a_lastRow - 1, (int)ceilf(maxY));
+		if (startX > endX || startY > endY)
+		{
+			continue;
+		}
+
+		//Edge functions E(x, y) = A * x + B * y + C, positive inside for counter clockwise triangles
+		//Edge i is opposite vertex i so normalising by the area turns the edges into barycentric weights
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		for (unsigned int e = 0; e < 3; ++e)
+		{
+			unsigned int a = (e + 1) % 3;
+			unsigned int b = (e + 2) % 3;
+			edgeA[e] = triangle.y[a] - triangle.y[b];
+			edgeB[e] = triangle.x[b] - triangle.x[a];
+			edgeC[e] = triangle.x[a] * triangle.y[b] - triangle.y[a] * triangle.x[b];
+		}
+		float area = edgeC[0] + edgeC[1] + edgeC[2];
+		if (area == 0.f)
+		{
+			continue;
+		}
+		//Occluders are treated as double sided, flip clockwise triangles so inside is always positive
+		float sign = area < 0.f ? -1.f : 1.f;
+		float inverseArea = 1.f / fabsf(area);
+		float depthA = 0.f;
+		float depthB = 0.f;
+		float depthC = 0.f;
+		for (unsigned int e = 0; e < 3; ++e)
+		{
+			edgeA[e] *= sign;
+			edgeB[e] *= sign;
+			edgeC[e] *= sign;
+			depthA += edgeA[e] * triangle.z[e] * inverseArea;
+			depthB += edgeB[e] * triangle.z[e] * inverseArea;
+			depthC += edgeC[e] * triangle.z[e] * inverseArea;
+		}
+
+		const __m128 stepX = _mm_set1_ps(4.f);
+		const __m128 pixelX = _mm_add_ps(_mm_set1_ps((float)startX), laneOffsets);
+		for (int y = startY; y <= endY; ++y)
+		{
+			//Pixel centres are sampled, matching the coverage rule of the GPU
+			float centreY = y + 0.5f;
+			__m128 x = pixelX;
+			float* row = depth + y * Width;
+			for (int px = startX; px <= endX; px += 4)
+			{
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), x), _mm_set1_ps(edgeB[0] * centreY + edgeC[0]));
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), x), _mm_set1_ps(edgeB[1] * centreY + edgeC[1]));
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), x), _mm_set1_ps(edgeB[2] * centreY + edgeC[2]));
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside) != 0)
+				{
+					__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), x), _mm_set1_ps(depthB * centreY + depthC));
+					__m128 current = _mm_loadu_ps(row + px);
+					__m128 nearest = _mm_min_ps(current, z);
+					_mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+				}
+				x = _mm_add_ps(x, stepX);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+	unsigned int sourceWidth = Width;
+	unsigned int sourceHeight = Height;
+	for (size_t level = 1; level < m_depth.size(); ++level)
+	{
+		const std::vector<float>& source = m_depth[level - 1];
+		std::vector<float>& target = m_depth[level];
+		unsigned int width = std::max(1u, sourceWidth / 2);
+		unsigned int height = std::max(1u, sourceHeight / 2);
+		for (unsigned int y = 0; y < height; ++y)
+		{
+			//Once a dimension reaches one texel both taps read the same row or column
+			unsigned int y0 = std::min(y * 2, sourceHeight - 1);
+			unsigned int y1 = std::min(y * 2 + 1, sourceHeight - 1);
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				unsigned int x0 = std::min(x * 2, sourceWidth - 1);
+				unsigned int x1 = std::min(x * 2 + 1, sourceWidth - 1);
+				target[y * width + x] = std::max(std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+					std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+		sourceWidth = width;
+		sourceHeight = height;
+	}
+}
+
+bool OcclusionCuller::IsOccluded(const glm::vec3& a_centre, const glm::vec3& a_extent)
+{
+	if (!m_enabled || m_occluders.empty())
+	{
+		return false;
+	}
+	++m_stats.tested;
+	//Screen rectangle and nearest depth of the eight corners
+	float minX = (float)Width;
+	float maxX = 0.f;
+	float minY = (float)Height;
+	float maxY = 0.f;
+	float minZ = 1.f;
+	for (unsigned int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 offset((corner & 1) ? a_extent.x : -a_extent.x, (corner & 2) ? a_extent.y : -a_extent.y, (corner & 4) ? a_extent.z : -a_extent.z);
+		glm::vec4 p = m_projectionView * glm::vec4(a_centre + offset, 1.f);
+		if (p.w <= 0.f || p.z < -p.w)
+		{
+			//Boxes reaching the near plane are always drawn
+			return false;
+		}
+		float x = (p.x / p.w * 0.5f + 0.5f) * Width;
+		float y = (p.y / p.w * 0.5f + 0.5f) * Height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, p.z / p.w * 0.5f + 0.5f);
+	}
+	int startX = std::max(0, (int)floorf(minX));
+	int endX = std::min((int)Width - 1, (int)floorf(maxX));
+	int startY = std::max(0, (int)floorf(minY));
+	int endY = std::min((int)Height - 1, (int)floorf(maxY));
+	if (startX > endX || startY > endY)
+	{
+		return false;
+	}
+
+	//Pick the level where the rectangle spans at most four texels on each side
+	unsigned int level = 0;
+	while (level + 1 < m_depth.size() && std::max(endX - startX, endY - startY) >> level > 3)
+	{
+		++level;
+	}
+	unsigned int levelWidth = std::max(1u, Width >> level);
+	unsigned int levelHeight = std::max(1u, Height >> level);
+	const std::vector<float>& depth = m_depth[level];
+	for (unsigned int y = std::min((unsigned int)startY >> level, levelHeight - 1); y <= std::min((unsigned int)endY >> level, levelHeight - 1); ++y)
+	{
+		for (unsigned int x = std::min((unsigned int)startX >> level, levelWidth - 1); x <= std::min((unsigned int)endX >> level, levelWidth - 1); ++x)
+		{
+			//The farthest occluder depth in the texel is still behind the nearest point of the box
+			if (depth[y * levelWidth + x] >= minZ)
+			{
+				return false;
+			}
+		}
+	}
+	++m_stats.occluded;
+	return true;
+}
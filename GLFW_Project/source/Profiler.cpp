@@ -0,0 +1,273 @@
+#include "Profiler.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+//Set up static pointer for Singleton object
+Profiler* Profiler::m_instance = nullptr;
+
+Profiler* Profiler::CreateInstance()
+{
+	if (nullptr == m_instance)
+	{
+		m_instance = new Profiler();
+	}
+	return m_instance;
+}
+
+Profiler* Profiler::GetInstance()
+{
+	if (nullptr == m_instance)
+	{
+		return Profiler::CreateInstance();
+	}
+	return m_instance;
+}
+
+void Profiler::DestroyInstance()
+{
+	if (nullptr != m_instance)
+	{
+		delete m_instance;
+		m_instance = nullptr;
+	}
+}
+
+Profiler::Profiler() : m_records(), m_openScopes(), m_cpuResults(), m_cpuHistory(), m_gpuPasses(), m_gpuResults(), m_activePass(-1),
+	m_gpuPassDepth(0), m_pipelineStatistics(GLAD_GL_VERSION_4_6 || GLAD_GL_ARB_pipeline_statistics_query), m_frameStart(Clock::now()),
+	m_frameMs(0.f), m_frameHistory(HistoryLength, 0.f), m_historyOffset(0), m_frameIndex(0)
+{
+}
+
+Profiler::~Profiler()
+{
+	for (GPUPass& pass : m_gpuPasses)
+	{
+		glDeleteQueries(8, &pass.queries[0][0]);
+	}
+}
+
+void Profiler::BeginFrame()
+{
+	m_frameStart = Clock::now();
+	m_records.clear();
+	m_openScopes.clear();
+	//The queries this frame reuses were issued two frames ago, read them back if the GPU has finished with them
+	unsigned int set = (unsigned int)(m_frameIndex % 2);
+	for (GPUPass& pass : m_gpuPasses)
+	{
+		if (pass.pending[set])
+		{
+			ResolveGPUPass(pass, set);
+		}
+	}
+}
+
+void Profiler::EndFrame()
+{
+	while (!m_openScopes.empty())
+	{
+		EndScope();
+	}
+	m_frameMs = std::chrono::duration<float, std::milli>(Clock::now() - m_frameStart).count();
+
+	//Records are in the order scopes were entered so the results come out depth first
+	m_cpuResults.clear();
+	for (int i = 0; i < (int)m_records.size(); ++i)
+	{
+		std::string path = GetPath(i);
+		auto iter = std::find_if(m_cpuResults.begin(), m_cpuResults.end(), [&path](const CPUScopeResult& a_result) { return a_result.path == path; });
+		if (iter != m_cpuResults.end())
+		{
+			++iter->calls;
+			iter->ms += m_records[i].ms;
+			continue;
+		}
+		unsigned int depth = 0;
+		for (int parent = m_records[i].parent; parent != -1; parent = m_records[parent].parent)
+		{
+			++depth;
+		}
+		CPUScopeResult result = { m_records[i].name, path, depth, 1, m_records[i].ms };
+		m_cpuResults.push_back(result);
+	}
+
+	//Write this frame's sample over the oldest one, scopes that did not run record zero
+	for (const CPUScopeResult& result : m_cpuResults)
+	{
+		auto iter = std::find_if(m_cpuHistory.begin(), m_cpuHistory.end(),
+			[&result](const std::pair<std::string, std::vector<float>>& a_history) { return a_history.first == result.path; });
+		if (iter == m_cpuHistory.end())
+		{
+			m_cpuHistory.push_back(std::make_pair(result.path, std::vector<float>(HistoryLength, 0.f)));
+		}
+	}
+	for (auto& history : m_cpuHistory)
+	{
+		history.second[m_historyOffset] = GetCPUTime(history.first);
+	}
+	m_gpuResults.clear();
+	for (GPUPass& pass : m_gpuPasses)
+	{
+		pass.history[m_historyOffset] = pass.result.ms;
+		m_gpuResults.push_back(pass.result);
+	}
+	m_frameHistory[m_historyOffset] = m_frameMs;
+	m_historyOffset = (m_historyOffset + 1) % HistoryLength;
+	++m_frameIndex;
+}
+
+void Profiler::BeginScope(const char* a_name)
+{
+	ScopeRecord record = { a_name, m_openScopes.empty() ? -1 : m_openScopes.back(), Clock::now(), 0.f };
+	m_openScopes.push_back((int)m_records.size());
+	m_records.push_back(record);
+}
+
+void Profiler::EndScope()
+{
+	if (m_openScopes.empty())
+	{
+		return;
+	}
+	ScopeRecord& record = m_records[m_openScopes.back()];
+	record.ms = std::chrono::duration<float, std::milli>(Clock::now() - record.start).count();
+	m_openScopes.pop_back();
+}
+
+void Profiler::BeginGPUPass(const char* a_name)
+{
+	//Only one query per target can be active so nested passes count towards the outermost pass
+	if (m_gpuPassDepth++ > 0)
+	{
+		return;
+	}
+	auto iter = std::find_if(m_gpuPasses.begin(), m_gpuPasses.end(), [a_name](const GPUPass& a_pass) { return a_pass.name == a_name; });
+	if (iter == m_gpuPasses.end())
+	{
+		GPUPass pass = {};
+		pass.name = a_name;
+		glGenQueries(8, &pass.queries[0][0]);
+		pass.result.name = a_name;
+		pass.history.assign(HistoryLength, 0.f);
+		m_gpuPasses.push_back(pass);
+		iter = m_gpuPasses.end() - 1;
+	}
+	unsigned int set = (unsigned int)(m_frameIndex % 2);
+	if (iter->pending[set])
+	{
+		//The GPU is more than a frame behind, skip timing rather than waiting for the old result
+		m_activePass = -1;
+		return;
+	}
+	m_activePass = (int)(iter - m_gpuPasses.begin());
+	glBeginQuery(GL_TIME_ELAPSED, iter->queries[set][0]);
+	if (m_pipelineStatistics)
+	{
+		glBeginQuery(GL_VERTICES_SUBMITTED, iter->queries[set][1]);
+		glBeginQuery(GL_PRIMITIVES_SUBMITTED, iter->queries[set][2]);
+		glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, iter->queries[set][3]);
+	}
+}
+
+void Profiler::EndGPUPass()
+{
+	if (m_gpuPassDepth == 0 || --m_gpuPassDepth > 0 || m_activePass == -1)
+	{
+		return;
+	}
+	GPUPass& pass = m_gpuPasses[m_activePass];
+	glEndQuery(GL_TIME_ELAPSED);
+	if (m_pipelineStatistics)
+	{
+		glEndQuery(GL_VERTICES_SUBMITTED);
+		glEndQuery(GL_PRIMITIVES_SUBMITTED);
+		glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+	}
+	unsigned int set = (unsigned int)(m_frameIndex % 2);
+	pass.pending[set] = true;
+	m_activePass = -1;
+}
+
+void Profiler::ResolveGPUPass(GPUPass& a_pass, unsigned int a_set)
+{
+	//Queries complete in order so the last one being available means they all are
+	GLint available = 0;
+	glGetQueryObjectiv(a_pass.queries[a_set][m_pipelineStatistics ? 3 : 0], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return;
+	}
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(a_pass.queries[a_set][0], GL_QUERY_RESULT, &elapsed);
+	a_pass.result.ms = elapsed / 1000000.f;
+	if (m_pipelineStatistics)
+	{
+		GLuint64 statistics[3] = {};
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			glGetQueryObjectui64v(a_pass.queries[a_set][i + 1], GL_QUERY_RESULT, &statistics[i]);
+		}
+		a_pass.result.verticesSubmitted = statistics[0];
+		a_pass.result.primitivesSubmitted = statistics[1];
+		a_pass.result.fragmentInvocations = statistics[2];
+	}
+	a_pass.pending[a_set] = false;
+}
+
+std::string Profiler::GetPath(int a_record) const
+{
+	std::string path = m_records[a_record].name;
+	for (int parent = m_records[a_record].parent; parent != -1; parent = m_records[parent].parent)
+	{
+		path = std::string(m_records[parent].name) + "/" + path;
+	}
+	return path;
+}
+
+float Profiler::GetCPUTime(const std::string& a_path) const
+{
+	for (const CPUScopeResult& result : m_cpuResults)
+	{
+		if (result.path == a_path)
+		{
+			return result.ms;
+		}
+	}
+	return 0.f;
+}
+
+float Profiler::GetGPUTime(const std::string& a_pass) const
+{
+	for (const GPUPassResult& result : m_gpuResults)
+	{
+		if (result.name == a_pass)
+		{
+			return result.ms;
+		}
+	}
+	return 0.f;
+}
+
+const float* Profiler::GetCPUHistory(const std::string& a_path) const
+{
+	for (const auto& history : m_cpuHistory)
+	{
+		if (history.first == a_path)
+		{
+			return history.second.data();
+		}
+	}
+	return nullptr;
+}
+
+const float* Profiler::GetGPUHistory(const std::string& a_pass) const
+{
+	for (const GPUPass& pass : m_gpuPasses)
+	{
+		if (pass.name == a_pass)
+		{
+			return pass.history.data();
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,500 @@
+#include "RenderQueue.h"
+#include "OBJ_Loader.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <glad/glad.h>
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cstring>
+
+RenderQueue::RenderQueue() : m_depthPrepass(false), m_opaqueCount(0), m_culler(), m_occlusionCuller(), m_projectionView(1.f), m_viewMatrix(1.f), m_farPlane(1000.f),
+	m_commandBuffer(0), m_drawBuffer(0), m_instanceBuffer(0), m_commandBufferSize(0), m_drawBufferSize(0), m_instanceBufferSize(0), m_stats()
+{
+	glGenBuffers(1, &m_commandBuffer);
+	glGenBuffers(1, &m_drawBuffer);
+	glGenBuffers(1, &m_instanceBuffer);
+}
+
+RenderQueue::~RenderQueue()
+{
+	GLState::DeleteBuffer(m_commandBuffer);
+	GLState::DeleteBuffer(m_drawBuffer);
+	GLState::DeleteBuffer(m_instanceBuffer);
+}
+
+unsigned int RenderQueue::AddProgram(const ProgramUniforms& a_program)
+{
+	m_programs.push_back(a_program);
+	m_depthPrograms.push_back(ProgramUniforms());
+	m_depthPrograms.back().program = 0;
+	return (unsigned int)m_programs.size() - 1;
+}
+
+void RenderQueue::SetDepthProgram(unsigned int a_programSlot, const ProgramUniforms& a_depthProgram)
+{
+	if (a_programSlot < m_depthPrograms.size())
+	{
+		m_depthPrograms[a_programSlot] = a_depthProgram;
+	}
+}
+
+void RenderQueue::Begin(const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_farPlane, float a_viewportHeight)
+{
+	m_viewMatrix = a_viewMatrix;
+	m_farPlane = a_farPlane;
+	m_items.clear();
+	m_submissions.clear();
+	m_instances.clear();
+	m_boxSubmission.clear();
+	m_boxDepth.clear();
+	m_frameModels.clear();
+	m_culler.Begin(a_viewMatrix, a_projectionMatrix, a_viewportHeight);
+	m_projectionView = a_projectionMatrix * a_viewMatrix;
+	m_stats = Stats();
+}
+
+uint64_t RenderQueue::MakeKey(Pass a_pass, unsigned int a_program, unsigned int a_textureSet, unsigned int a_model, float a_depth)
+{
+	//Depth is a 0-1 distance along the view direction quantised to 24 bits
+	uint64_t depth = (uint64_t)(glm::clamp(a_depth, 0.f, 1.f) * 16777215.f);
+	if (a_pass == TransparentPass)
+	{
+		//Transparent surfaces blend back-to-front whatever their state, depth goes above it and state only groups
+		//draws at the same depth
+		depth = 16777215 - depth;
+		return ((uint64_t)(a_pass & 0x3) << 62) | (depth << 38) | ((uint64_t)(a_program & 0x3F) << 32) |
+			((uint64_t)(a_textureSet & 0xFFFF) << 16) | ((uint64_t)(a_model & 0xFF) << 8);
+	}
+	return ((uint64_t)(a_pass & 0x3) << 62) | ((uint64_t)(a_program & 0x3F) << 56) | ((uint64_t)(a_textureSet & 0xFFFF) << 40) |
+		((uint64_t)(a_model & 0xFF) << 32) | (depth << 8);
+}
+
+unsigned int RenderQueue::GetTextureSet(const unsigned int* a_textureIDs)
+{
+	std::array<unsigned int, 3> textures = { a_textureIDs[0], a_textureIDs[1], a_textureIDs[2] };
+	auto iter = m_textureSets.find(textures);
+	if (iter != m_textureSets.end())
+	{
+		return iter->second;
+	}
+	//IDs only need to be unique among live texture sets, start again once the key field is exhausted
+	if (m_textureSets.size() > 0xFFFF)
+	{
+		m_textureSets.clear();
+	}
+	unsigned int id = (unsigned int)m_textureSets.size();
+	m_textureSets[textures] = id;
+	return id;
+}
+
+void RenderQueue::SubmitInstanced(unsigned int a_programSlot, const ModelBuffers* a_buffers, const Instance* a_instances, unsigned int a_instanceCount)
+{
+	if (a_buffers == nullptr || a_instances == nullptr || a_instanceCount == 0 || a_programSlot >= m_programs.size())
+	{
+		return;
+	}
+	unsigned int modelSlot = (unsigned int)(std::find(m_frameModels.begin(), m_frameModels.end(), a_buffers) - m_frameModels.begin());
+	if (modelSlot == m_frameModels.size())
+	{
+		m_frameModels.push_back(a_buffers);
+	}
+	Submission submission = { a_buffers, a_programSlot, modelSlot, (unsigned int)m_instances.size(), a_instanceCount, (unsigned int)m_boxDepth.size() };
+	unsigned int submissionIndex = (unsigned int)m_submissions.size();
+	m_submissions.push_back(submission);
+
+	//Normals are transformed by the inverse transpose so they stay perpendicular under non-uniform scale
+	for (unsigned int i = 0; i < a_instanceCount; ++i)
+	{
+		InstanceData data;
+		glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(a_instances[i].worldMatrix));
+		memcpy(data.worldMatrix, glm::value_ptr(a_instances[i].worldMatrix), sizeof(data.worldMatrix));
+		for (unsigned int column = 0; column < 3; ++column)
+		{
+			memcpy(&data.normalMatrix[column * 4], glm::value_ptr(normalMatrix[column]), sizeof(float) * 3);
+			data.normalMatrix[column * 4 + 3] = 0.f;
+		}
+		memcpy(data.tint, glm::value_ptr(a_instances[i].tint), sizeof(data.tint));
+		m_instances.push_back(data);
+	}
+
+	for (unsigned int draw = 0; draw < a_buffers->GetDrawCount(); ++draw)
+	{
+		const ModelBuffers::DrawInfo& info = a_buffers->GetDrawInfo(draw);
+		glm::vec4 localCentre((info.boundsMin + info.boundsMax) * 0.5f, 1.f);
+		glm::vec3 localExtent = (info.boundsMax - info.boundsMin) * 0.5f;
+		for (unsigned int i = 0; i < a_instanceCount; ++i)
+		{
+			const glm::mat4& worldMatrix = a_instances[i].worldMatrix;
+			//The absolute rotation and scale maps a model space half extent to the half extent of the enclosing world box
+			glm::mat3 absWorld = glm::mat3(glm::abs(worldMatrix[0]), glm::abs(worldMatrix[1]), glm::abs(worldMatrix[2]));
+			glm::vec3 centre = glm::vec3(worldMatrix * localCentre);
+			m_culler.Add(centre, absWorld * localExtent);
+			//Sort on the view space depth of the centre of the mesh bounds
+			m_boxDepth.push_back(-(m_viewMatrix * glm::vec4(centre, 1.f)).z / m_farPlane);
+			m_boxSubmission.push_back(submissionIndex);
+		}
+	}
+	m_stats.draws += a_buffers->GetDrawCount() * a_instanceCount;
+}
+
+void RenderQueue::BuildItems()
+{
+	m_items.clear();
+	m_sorted.clear();
+	m_frameInstances.clear();
+	for (const Submission& submission : m_submissions)
+	{
+		for (unsigned int draw = 0; draw < submission.buffers->GetDrawCount(); ++draw)
+		{
+			const ModelBuffers::DrawInfo& info = submission.buffers->GetDrawInfo(draw);
+			//Surviving instances of the mesh are packed together so one instanced draw covers them all
+			unsigned int firstInstance = (unsigned int)m_frameInstances.size();
+			unsigned int firstBox = submission.firstBox + draw * submission.instanceCount;
+			float nearest = 1.f;
+			float farthest = 0.f;
+			for (unsigned int i = 0; i < submission.instanceCount; ++i)
+			{
+				unsigned int box = firstBox + i;
+				if (!m_culler.IsVisible(box) || m_occluded[box] != 0)
+				{
+					continue;
+				}
+				m_frameInstances.push_back(m_instances[submission.firstInstance + i]);
+				nearest = std::min(nearest, m_boxDepth[box]);
+				farthest = std::max(farthest, m_boxDepth[box]);
+			}
+			unsigned int instanceCount = (unsigned int)m_frameInstances.size() - firstInstance;
+			if (instanceCount == 0)
+			{
+				continue;
+			}
+			//Instances of one draw can not be ordered against each other, transparent draws go back-to-front by their farthest copy
+			RenderItem item = { submission.buffers, draw, submission.program, firstInstance, instanceCount };
+			SortEntry entry;
+			entry.key = MakeKey(info.transparent ? TransparentPass : OpaquePass, submission.program, GetTextureSet(info.textureIDs),
+				submission.modelSlot, info.transparent ? farthest : nearest);
+			entry.item = (unsigned int)m_items.size();
+			m_items.push_back(item);
+			m_sorted.push_back(entry);
+			m_stats.instances += instanceCount;
+		}
+	}
+}
+
+void RenderQueue::RadixSort(std::vector<SortEntry>& a_entries, std::vector<SortEntry>& a_scratch)
+{
+	a_scratch.resize(a_entries.size());
+	//Bits that differ between any two keys, digits with no differing bits are already sorted
+	uint64_t differing = 0;
+	for (const SortEntry& entry : a_entries)
+	{
+		differing |= entry.key ^ a_entries[0].key;
+	}
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		if (((differing >> shift) & 0xFF) == 0)
+		{
+			continue;
+		}
+		unsigned int offsets[256] = {};
+		for (const SortEntry& entry : a_entries)
+		{
+			++offsets[(entry.key >> shift) & 0xFF];
+		}
+		unsigned int total = 0;
+		for (unsigned int& offset : offsets)
+		{
+			unsigned int count = offset;
+			offset = total;
+			total += count;
+		}
+		for (const SortEntry& entry : a_entries)
+		{
+			a_scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+		}
+		a_entries.swap(a_scratch);
+	}
+}
+
+void RenderQueue::ExecuteOpaque()
+{
+	m_occluded.assign(m_boxDepth.size(), 0);
+	{
+		Profiler::CPUScope scope("Culling");
+		m_culler.Cull();
+		CullOccluded();
+	}
+	BuildItems();
+	m_opaqueCount = 0;
+	if (m_sorted.empty())
+	{
+		return;
+	}
+	{
+		Profiler::CPUScope scope("Sort");
+		RadixSort(m_sorted, m_scratch);
+	}
+
+	//Lay the commands out in sorted order so each run of matching state is one contiguous indirect range
+	m_commands.resize(m_sorted.size());
+	m_drawMaterials.resize(m_sorted.size());
+	for (size_t i = 0; i < m_sorted.size(); ++i)
+	{
+		const RenderItem& item = m_items[m_sorted[i].item];
+		m_commands[i] = item.buffers->GetDrawCommand(item.draw);
+		m_commands[i].instanceCount = item.instanceCount;
+		m_commands[i].baseInstance = item.firstInstance;
+		m_drawMaterials[i] = item.draw;
+	}
+	//Orphan and refill the per frame buffers, the driver hands back fresh storage if the GPU is still reading the old one
+	const bool multiDraw = ModelBuffers::UseMultiDrawIndirect();
+	if (multiDraw)
+	{
+		size_t commandBytes = m_commands.size() * sizeof(ModelBuffers::DrawCommand);
+		m_commandBufferSize = std::max(m_commandBufferSize, commandBytes);
+		GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandBufferSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandBytes, m_commands.data());
+		ModelBuffers::AddUploadedBytes(commandBytes);
+	}
+	size_t drawBytes = m_drawMaterials.size() * sizeof(unsigned int);
+	m_drawBufferSize = std::max(m_drawBufferSize, drawBytes);
+	GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_drawBufferSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawBytes, m_drawMaterials.data());
+	GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_drawBuffer);
+	ModelBuffers::AddUploadedBytes(drawBytes);
+	size_t instanceBytes = m_frameInstances.size() * sizeof(InstanceData);
+	m_instanceBufferSize = std::max(m_instanceBufferSize, instanceBytes);
+	GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_instanceBufferSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceBytes, m_frameInstances.data());
+	GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_instanceBuffer);
+	ModelBuffers::AddUploadedBytes(instanceBytes);
+
+	//The pass is the top of the key so every opaque entry comes before the first transparent one
+	m_opaqueCount = 0;
+	while (m_opaqueCount < m_sorted.size() && GetPass(m_sorted[m_opaqueCount].key) == OpaquePass)
+	{
+		++m_opaqueCount;
+	}
+	if (m_depthPrepass)
+	{
+		Profiler::GPUScope gpuScope("Depth Pre-pass");
+		DrawDepthPrepass(m_opaqueCount);
+	}
+
+	{
+		Profiler::GPUScope gpuScope("Model");
+		DrawShaded(0, m_opaqueCount);
+	}
+	//Whatever draws before the transparent pass starts from the default depth state
+	GLState::DepthFunc(GL_LESS);
+	GLState::DepthMask(true);
+}
+
+void RenderQueue::ExecuteTransparent()
+{
+	//Timed even when empty so the pass does not keep reporting an old frame's time
+	Profiler::GPUScope gpuScope("Transparent");
+	if (m_opaqueCount < m_sorted.size())
+	{
+		//Anything drawn since the opaque pass may have moved these, the cache skips them if it did not
+		if (ModelBuffers::UseMultiDrawIndirect())
+		{
+			GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		}
+		GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_drawBuffer);
+		GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_instanceBuffer);
+		DrawShaded(m_opaqueCount, (unsigned int)m_sorted.size());
+	}
+	GLState::Disable(GL_BLEND);
+	GLState::DepthFunc(GL_LESS);
+	GLState::DepthMask(true);
+
+	//Binding everything per draw would be a program, vertex array, material buffer and three textures each time
+	unsigned int naiveBinds = (unsigned int)m_sorted.size() * 6;
+	unsigned int issuedBinds = m_stats.programBinds + m_stats.vertexArrayBinds + m_stats.materialBinds + m_stats.textureBinds;
+	m_stats.bindsSaved = naiveBinds - issuedBinds;
+
+	//Bindings are left in place for whatever draws next this frame, ImGui invalidates the cache before the next one
+	m_sorted.clear();
+	m_opaqueCount = 0;
+}
+
+void RenderQueue::DrawShaded(unsigned int a_first, unsigned int a_last)
+{
+	//Walk the sorted draws only binding what differs from the previous draw
+	const RenderItem* previous = nullptr;
+	unsigned int runStart = a_first;
+	for (unsigned int i = a_first; i < a_last; ++i)
+	{
+		const RenderItem& item = m_items[m_sorted[i].item];
+		const ModelBuffers::DrawInfo& info = item.buffers->GetDrawInfo(item.draw);
+		bool programChanged = (previous == nullptr || previous->program != item.program);
+		bool buffersChanged = (previous == nullptr || previous->buffers != item.buffers);
+		const unsigned int* previousTextures = (previous != nullptr) ? previous->buffers->GetDrawInfo(previous->draw).textureIDs : nullptr;
+		bool texturesChanged = (previousTextures == nullptr || !std::equal(info.textureIDs, info.textureIDs + 3, previousTextures));
+		if (previous != nullptr && (programChanged || buffersChanged || texturesChanged))
+		{
+			DrawShadedRun(runStart, i);
+			runStart = i;
+		}
+
+		const ProgramUniforms& program = m_programs[item.program];
+		if (programChanged)
+		{
+			GLState::UseProgram(program.program);
+			++m_stats.programBinds;
+		}
+		if (buffersChanged)
+		{
+			GLState::BindVertexArray(item.buffers->GetVertexArray());
+			GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, item.buffers->GetMaterialBuffer());
+			++m_stats.vertexArrayBinds;
+			++m_stats.materialBinds;
+		}
+		for (unsigned int unit = 0; unit < 3; ++unit)
+		{
+			//Texture units 0, 1 and 2 hold the diffuse, specular and normal textures
+			if (previousTextures == nullptr || previousTextures[unit] != info.textureIDs[unit])
+			{
+				GLState::BindTexture(unit, GL_TEXTURE_2D, info.textureIDs[unit]);
+				++m_stats.textureBinds;
+			}
+		}
+		previous = &item;
+	}
+	if (a_first < a_last)
+	{
+		DrawShadedRun(runStart, a_last);
+	}
+}
+
+void RenderQueue::CullOccluded()
+{
+	m_occlusionCuller.Begin(m_projectionView);
+	if (!m_occlusionCuller.IsEnabled())
+	{
+		return;
+	}
+	//Big on screen and cheap to rasterize makes a good occluder, transparent surfaces hide nothing
+	std::vector<unsigned int> candidates;
+	for (unsigned int box = 0; box < m_boxDepth.size(); ++box)
+	{
+		const Submission& submission = m_submissions[m_boxSubmission[box]];
+		unsigned int draw = (box - submission.firstBox) / submission.instanceCount;
+		const ModelBuffers::DrawInfo& info = submission.buffers->GetDrawInfo(draw);
+		if (m_culler.IsVisible(box) && !info.transparent && m_culler.GetProjectedSize(box) >= m_occlusionCuller.GetOccluderMinPixels() &&
+			submission.buffers->GetDrawCommand(draw).count / 3 <= m_occlusionCuller.GetMaxOccluderTriangles())
+		{
+			candidates.push_back(box);
+		}
+	}
+	if (candidates.size() > m_occlusionCuller.GetMaxOccluders())
+	{
+		std::partial_sort(candidates.begin(), candidates.begin() + m_occlusionCuller.GetMaxOccluders(), candidates.end(),
+			[this](unsigned int a_lhs, unsigned int a_rhs) { return m_culler.GetProjectedSize(a_lhs) > m_culler.GetProjectedSize(a_rhs); });
+		candidates.resize(m_occlusionCuller.GetMaxOccluders());
+	}
+	if (candidates.empty())
+	{
+		return;
+	}
+	Profiler::CPUScope scope("Occlusion");
+	for (unsigned int box : candidates)
+	{
+		const Submission& submission = m_submissions[m_boxSubmission[box]];
+		unsigned int draw = (box - submission.firstBox) / submission.instanceCount;
+		unsigned int instance = (box - submission.firstBox) % submission.instanceCount;
+		const OBJMesh* mesh = submission.buffers->GetModel()->GetMeshByIndex(submission.buffers->GetDrawInfo(draw).mesh);
+		m_occlusionCuller.AddOccluder(mesh, glm::make_mat4(m_instances[submission.firstInstance + instance].worldMatrix));
+	}
+	m_occlusionCuller.Rasterize();
+
+	for (unsigned int box = 0; box < m_boxDepth.size(); ++box)
+	{
+		if (m_culler.IsVisible(box) && m_occlusionCuller.IsOccluded(m_culler.GetCentre(box), m_culler.GetExtent(box)))
+		{
+			m_occluded[box] = 1;
+		}
+	}
+}
+
+void RenderQueue::DrawDepthPrepass(unsigned int a_opaqueCount)
+{
+	GLState::ColorMask(false);
+	GLState::DepthMask(true);
+	GLState::DepthFunc(GL_LESS);
+	//Textures do not affect depth so runs only break where the program or geometry changes
+	unsigned int runStart = 0;
+	for (unsigned int i = 1; i <= a_opaqueCount; ++i)
+	{
+		const RenderItem& first = m_items[m_sorted[runStart].item];
+		if (i < a_opaqueCount && m_items[m_sorted[i].item].program == first.program && m_items[m_sorted[i].item].buffers == first.buffers)
+		{
+			continue;
+		}
+		const ProgramUniforms& depthProgram = m_depthPrograms[first.program];
+		if (depthProgram.program != 0)
+		{
+			GLState::UseProgram(depthProgram.program);
+			GLState::BindVertexArray(first.buffers->GetVertexArray());
+			unsigned int drawCalls = m_stats.drawCalls;
+			DrawRun(runStart, i, depthProgram);
+			m_stats.prepassDrawCalls += m_stats.drawCalls - drawCalls;
+		}
+		runStart = i;
+	}
+	GLState::ColorMask(true);
+}
+
+void RenderQueue::DrawShadedRun(unsigned int a_first, unsigned int a_last)
+{
+	const RenderItem& item = m_items[m_sorted[a_first].item];
+	if (GetPass(m_sorted[a_first].key) == TransparentPass)
+	{
+		//Tested against the opaque depth but not written, so a transparent surface never hides one drawn after it
+		GLState::Enable(GL_BLEND);
+		GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GLState::DepthFunc(GL_LESS);
+		GLState::DepthMask(false);
+	}
+	else if (m_depthPrepass && m_depthPrograms[item.program].program != 0)
+	{
+		//Depth is already final, only the nearest surface of each pixel passes and nothing needs writing
+		GLState::Disable(GL_BLEND);
+		GLState::DepthFunc(GL_EQUAL);
+		GLState::DepthMask(false);
+	}
+	else
+	{
+		GLState::Disable(GL_BLEND);
+		GLState::DepthFunc(GL_LESS);
+		GLState::DepthMask(true);
+	}
+	DrawRun(a_first, a_last, m_programs[item.program]);
+}
+
+void RenderQueue::DrawRun(unsigned int a_first, unsigned int a_last, const ProgramUniforms& a_program)
+{
+	if (ModelBuffers::UseMultiDrawIndirect())
+	{
+		//gl_DrawID restarts at zero for each call so DrawBase points it at the run's first entry in the draw buffer
+		a_program.drawBase.Set((int)a_first);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, ((char*)0) + a_first * sizeof(ModelBuffers::DrawCommand), a_last - a_first, 0);
+		++m_stats.drawCalls;
+	}
+	else
+	{
+		for (unsigned int i = a_first; i < a_last; ++i)
+		{
+			const ModelBuffers::DrawCommand& command = m_commands[i];
+			a_program.drawBase.Set((int)i);
+			a_program.instanceBase.Set((int)command.baseInstance);
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, ((char*)0) + command.firstIndex * sizeof(unsigned int),
+				command.instanceCount, command.baseVertex, command.baseInstance);
+			++m_stats.drawCalls;
+		}
+	}
+}
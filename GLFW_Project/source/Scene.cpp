@@ -0,0 +1,311 @@
+#include "Scene.h"
+#include "ModelBuffers.h"
+#include "OBJ_JobSystem.h"
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+namespace
+{
+	//Levels smaller than this are updated on the calling thread, handing them to the pool costs more than it saves
+	const unsigned int ParallelLevelSize = 1024;
+	const unsigned int MinChunkSize = 256;
+
+	template<typename T>
+	void Permute(std::vector<T>& a_values, const std::vector<unsigned int>& a_order)
+	{
+		std::vector<T> permuted;
+		permuted.reserve(a_order.size());
+		for (unsigned int slot : a_order)
+		{
+			permuted.push_back(a_values[slot]);
+		}
+		a_values.swap(permuted);
+	}
+}
+
+Scene::Scene() : m_levelStart(), m_orderDirty(false), m_culler(), m_stats()
+{
+	//Nodes are never too small to submit, the render queue applies its own projected size test to each mesh
+	m_culler.SetMinPixelSize(0.f);
+}
+
+Scene::~Scene()
+{
+}
+
+Scene::NodeID Scene::CreateNode(NodeID a_parent, const ModelBuffers* a_model)
+{
+	unsigned int parentSlot = IsValid(a_parent) ? m_slotOf[a_parent] : InvalidNode;
+	unsigned int depth = (parentSlot != InvalidNode) ? m_depth[parentSlot] + 1 : 0;
+	NodeID id = (NodeID)m_slotOf.size();
+	//Appending keeps the slots sorted as long as the new node is no shallower than the last one
+	if (!m_depth.empty() && depth < m_depth.back())
+	{
+		m_orderDirty = true;
+	}
+	m_slotOf.push_back((unsigned int)m_parent.size());
+	m_parent.push_back(parentSlot);
+	m_depth.push_back(depth);
+	m_translation.push_back(glm::vec3(0.f));
+	m_rotation.push_back(glm::vec3(0.f));
+	m_scale.push_back(glm::vec3(1.f));
+	m_tint.push_back(glm::vec4(1.f));
+	m_world.push_back(glm::mat4(1.f));
+	m_boundsMin.push_back(glm::vec3(0.f));
+	m_boundsMax.push_back(glm::vec3(0.f));
+	m_model.push_back(a_model);
+	m_dirty.push_back(1);
+	m_removed.push_back(0);
+	m_idOf.push_back(id);
+	if (!m_orderDirty)
+	{
+		//Extend the level ranges in place
+		if (m_levelStart.size() < depth + 2)
+		{
+			m_levelStart.resize(depth + 2, m_levelStart.empty() ? 0 : m_levelStart.back());
+		}
+		m_levelStart.back() = (unsigned int)m_parent.size();
+	}
+	return id;
+}
+
+void Scene::RemoveNode(NodeID a_node)
+{
+	if (IsValid(a_node))
+	{
+		//Children are found and dropped with it when the hierarchy is next re-sorted
+		m_removed[m_slotOf[a_node]] = 1;
+		m_orderDirty = true;
+	}
+}
+
+void Scene::Clear()
+{
+	m_parent.clear();
+	m_depth.clear();
+	m_translation.clear();
+	m_rotation.clear();
+	m_scale.clear();
+	m_tint.clear();
+	m_world.clear();
+	m_boundsMin.clear();
+	m_boundsMax.clear();
+	m_model.clear();
+	m_dirty.clear();
+	m_removed.clear();
+	m_idOf.clear();
+	m_slotOf.clear();
+	m_levelStart.clear();
+	m_orderDirty = false;
+}
+
+void Scene::SetLocalTransform(NodeID a_node, const glm::vec3& a_translation, const glm::vec3& a_rotation, const glm::vec3& a_scale)
+{
+	if (!IsValid(a_node))
+	{
+		return;
+	}
+	unsigned int slot = m_slotOf[a_node];
+	if (m_translation[slot] != a_translation || m_rotation[slot] != a_rotation || m_scale[slot] != a_scale)
+	{
+		m_translation[slot] = a_translation;
+		m_rotation[slot] = a_rotation;
+		m_scale[slot] = a_scale;
+		m_dirty[slot] = 1;
+	}
+}
+
+void Scene::SetModel(NodeID a_node, const ModelBuffers* a_model)
+{
+	if (IsValid(a_node))
+	{
+		//Bounds depend on the model
+		m_model[m_slotOf[a_node]] = a_model;
+		m_dirty[m_slotOf[a_node]] = 1;
+	}
+}
+
+void Scene::SetTint(NodeID a_node, const glm::vec4& a_tint)
+{
+	if (IsValid(a_node))
+	{
+		m_tint[m_slotOf[a_node]] = a_tint;
+	}
+}
+
+void Scene::Reorder()
+{
+	//Stable so siblings keep their creation order, parents always sort ahead of their children
+	std::vector<unsigned int> order(m_parent.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](unsigned int a_lhs, unsigned int a_rhs) { return m_depth[a_lhs] < m_depth[a_rhs]; });
+	std::vector<unsigned int> kept;
+	kept.reserve(order.size());
+	for (unsigned int slot : order)
+	{
+		if (m_parent[slot] != InvalidNode && m_removed[m_parent[slot]])
+		{
+			m_removed[slot] = 1;
+		}
+		if (!m_removed[slot])
+		{
+			kept.push_back(slot);
+		}
+	}
+
+	std::vector<unsigned int> newSlot(m_parent.size(), InvalidNode);
+	for (unsigned int i = 0; i < kept.size(); ++i)
+	{
+		newSlot[kept[i]] = i;
+	}
+	for (unsigned int slot = 0; slot < m_parent.size(); ++slot)
+	{
+		m_slotOf[m_idOf[slot]] = newSlot[slot];
+	}
+	Permute(m_parent, kept);
+	for (unsigned int& parent : m_parent)
+	{
+		parent = (parent != InvalidNode) ? newSlot[parent] : InvalidNode;
+	}
+	Permute(m_depth, kept);
+	Permute(m_translation, kept);
+	Permute(m_rotation, kept);
+	Permute(m_scale, kept);
+	Permute(m_tint, kept);
+	Permute(m_world, kept);
+	Permute(m_boundsMin, kept);
+	Permute(m_boundsMax, kept);
+	Permute(m_model, kept);
+	Permute(m_dirty, kept);
+	Permute(m_removed, kept);
+	Permute(m_idOf, kept);
+
+	m_levelStart.clear();
+	for (unsigned int slot = 0; slot < m_depth.size(); ++slot)
+	{
+		while (m_levelStart.size() <= m_depth[slot])
+		{
+			m_levelStart.push_back(slot);
+		}
+	}
+	m_levelStart.push_back((unsigned int)m_depth.size());
+	m_orderDirty = false;
+}
+
+unsigned int Scene::UpdateRange(unsigned int a_first, unsigned int a_last)
+{
+	unsigned int updated = 0;
+	for (unsigned int slot = a_first; slot < a_last; ++slot)
+	{
+		unsigned int parent = m_parent[slot];
+		//Parents are a level up so their dirty flag already says whether their world matrix changed this update
+		if (!m_dirty[slot] && (parent == InvalidNode || !m_dirty[parent]))
+		{
+			continue;
+		}
+		m_dirty[slot] = 1;
+		glm::mat4 local = glm::translate(glm::mat4(1.f), m_translation[slot]);
+		local = glm::rotate(local, m_rotation[slot].y, glm::vec3(0.f, 1.f, 0.f));
+		local = glm::rotate(local, m_rotation[slot].x, glm::vec3(1.f, 0.f, 0.f));
+		local = glm::rotate(local, m_rotation[slot].z, glm::vec3(0.f, 0.f, 1.f));
+		local = glm::scale(local, m_scale[slot]);
+		m_world[slot] = (parent != InvalidNode) ? m_world[parent] * local : local;
+
+		const ModelBuffers* model = m_model[slot];
+		if (model != nullptr)
+		{
+			const glm::mat4& world = m_world[slot];
+			glm::mat3 absWorld = glm::mat3(glm::abs(world[0]), glm::abs(world[1]), glm::abs(world[2]));
+			glm::vec3 centre = glm::vec3(world * glm::vec4((model->GetBoundsMin() + model->GetBoundsMax()) * 0.5f, 1.f));
+			glm::vec3 extent = absWorld * ((model->GetBoundsMax() - model->GetBoundsMin()) * 0.5f);
+			m_boundsMin[slot] = centre - extent;
+			m_boundsMax[slot] = centre + extent;
+		}
+		++updated;
+	}
+	return updated;
+}
+
+void Scene::Update()
+{
+	auto updateStart = std::chrono::high_resolution_clock::now();
+	if (m_orderDirty)
+	{
+		Reorder();
+	}
+	std::atomic<unsigned int> updated(0);
+	unsigned int levels = m_levelStart.empty() ? 0 : (unsigned int)m_levelStart.size() - 1;
+	for (unsigned int level = 0; level < levels; ++level)
+	{
+		unsigned int first = m_levelStart[level];
+		unsigned int last = m_levelStart[level + 1];
+		if (last - first < ParallelLevelSize)
+		{
+			updated += UpdateRange(first, last);
+			continue;
+		}
+		//Nodes in a level only read their parents in the level above, so chunks of a level can not race
+		JobSystem::GetInstance()->ParallelFor(first, last, MinChunkSize,
+			[this, &updated](unsigned int a_first, unsigned int a_last) { updated += UpdateRange(a_first, a_last); });
+	}
+	std::fill(m_dirty.begin(), m_dirty.end(), 0);
+
+	m_stats.nodes = (unsigned int)m_parent.size();
+	m_stats.levels = levels;
+	m_stats.updated = updated;
+	m_stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - updateStart).count();
+}
+
+void Scene::Submit(RenderQueue& a_queue, unsigned int a_programSlot, const glm::mat4& a_viewMatrix, const glm::mat4& a_projectionMatrix, float a_viewportHeight)
+{
+	m_culler.Begin(a_viewMatrix, a_projectionMatrix, a_viewportHeight);
+	m_cullSlots.clear();
+	for (unsigned int slot = 0; slot < m_model.size(); ++slot)
+	{
+		if (m_model[slot] != nullptr)
+		{
+			m_culler.Add((m_boundsMin[slot] + m_boundsMax[slot]) * 0.5f, (m_boundsMax[slot] - m_boundsMin[slot]) * 0.5f);
+			m_cullSlots.push_back(slot);
+		}
+	}
+	m_culler.Cull();
+
+	//Batches persist between frames so their instance vectors keep their capacity
+	for (auto& batch : m_batches)
+	{
+		batch.second.clear();
+	}
+	m_stats.visible = 0;
+	for (unsigned int i = 0; i < m_cullSlots.size(); ++i)
+	{
+		if (!m_culler.IsVisible(i))
+		{
+			continue;
+		}
+		unsigned int slot = m_cullSlots[i];
+		auto batch = std::find_if(m_batches.begin(), m_batches.end(),
+			[this, slot](const std::pair<const ModelBuffers*, std::vector<RenderQueue::Instance>>& a_batch) { return a_batch.first == m_model[slot]; });
+		if (batch == m_batches.end())
+		{
+			m_batches.push_back(std::make_pair(m_model[slot], std::vector<RenderQueue::Instance>()));
+			batch = m_batches.end() - 1;
+		}
+		RenderQueue::Instance instance = { m_world[slot], m_tint[slot] };
+		batch->second.push_back(instance);
+		++m_stats.visible;
+	}
+	for (auto iter = m_batches.begin(); iter != m_batches.end();)
+	{
+		if (iter->second.empty())
+		{
+			//Forget models that are no longer drawn so a freed model's pointer is never submitted
+			iter = m_batches.erase(iter);
+			continue;
+		}
+		a_queue.SubmitInstanced(a_programSlot, iter->first, iter->second.data(), (unsigned int)iter->second.size());
+		++iter;
+	}
+}
@@ -1,6 +1,9 @@
 #include "ShaderUtil.h"
 #include "Utilities.h"
+#include "GLState.h"
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 
 //Static Instance of ShaderUtil
@@ -57,7 +60,7 @@ ShaderUtil::~ShaderUtil()
 	//Destroy and programs that are still dangling about
 	for(auto iter = mPrograms.begin(); iter != mPrograms.end(); ++iter)
 	{
-		glDeleteProgram(*iter);
+		GLState::DeleteProgram(*iter);
 	}
 }
 
@@ -155,6 +158,8 @@ unsigned int ShaderUtil::CreateProgramInternal(const int& a_vertexShader, const
 	}
 	//add the program to the shader program vector
 	mPrograms.push_back(handle);
+	//Resolve every uniform now so draw code never has to look them up by name
+	ReflectProgram(handle);
 	return handle; //Return the program ID
 }
 
@@ -171,9 +176,177 @@ void ShaderUtil::DeleteProgramInternal(unsigned int a_program)
 	{
 		if (*iter == a_program) //If we find the program we are looking for
 		{
-			glDeleteProgram(*iter);	//Delete the program
+			GLState::DeleteProgram(*iter);	//Delete the program
 			mPrograms.erase(iter);	//Remove this item from the programs vector
+			mProgramInfo.erase(a_program);
 			break;					//Break out of the for loop
 		}
 	}
-}
\ No newline at end of file
+}
+void ShaderUtil::ReflectProgram(unsigned int a_program)
+{
+	ShaderProgramInfo& info = mProgramInfo[a_program];
+	info.uniforms.clear();
+	info.blocks.clear();
+	char name[256];
+	if (GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_program_interface_query)
+	{
+		//Uniforms, block members report a location of -1 and are reached through their block instead
+		int count = 0;
+		glGetProgramInterfaceiv(a_program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+		const GLenum uniformProperties[] = { GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+		for (int i = 0; i < count; ++i)
+		{
+			int values[3] = {};
+			glGetProgramResourceiv(a_program, GL_UNIFORM, i, 3, uniformProperties, 3, nullptr, values);
+			if (values[0] < 0)
+			{
+				continue;
+			}
+			glGetProgramResourceName(a_program, GL_UNIFORM, i, sizeof(name), nullptr, name);
+			info.uniforms[name] = { values[0], (unsigned int)values[1], values[2] };
+		}
+		//Uniform blocks and shader storage blocks
+		const GLenum blockInterfaces[] = { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK };
+		const GLenum blockProperties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+		for (GLenum blockInterface : blockInterfaces)
+		{
+			if (blockInterface == GL_SHADER_STORAGE_BLOCK && !(GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_shader_storage_buffer_object))
+			{
+				continue;
+			}
+			glGetProgramInterfaceiv(a_program, blockInterface, GL_ACTIVE_RESOURCES, &count);
+			for (int i = 0; i < count; ++i)
+			{
+				int values[2] = {};
+				glGetProgramResourceiv(a_program, blockInterface, i, 2, blockProperties, 2, nullptr, values);
+				glGetProgramResourceName(a_program, blockInterface, i, sizeof(name), nullptr, name);
+				info.blocks[name] = { (unsigned int)i, values[0], values[1], blockInterface == GL_SHADER_STORAGE_BLOCK };
+			}
+		}
+	}
+	else
+	{
+		//Older contexts only have the active uniform queries
+		int count = 0;
+		glGetProgramiv(a_program, GL_ACTIVE_UNIFORMS, &count);
+		for (int i = 0; i < count; ++i)
+		{
+			int size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(a_program, i, sizeof(name), nullptr, &size, &type, name);
+			int location = glGetUniformLocation(a_program, name);
+			if (location >= 0)
+			{
+				info.uniforms[name] = { location, type, size };
+			}
+		}
+		glGetProgramiv(a_program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		for (int i = 0; i < count; ++i)
+		{
+			int binding = 0;
+			int dataSize = 0;
+			glGetActiveUniformBlockName(a_program, i, sizeof(name), nullptr, name);
+			glGetActiveUniformBlockiv(a_program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+			glGetActiveUniformBlockiv(a_program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+			info.blocks[name] = { (unsigned int)i, binding, dataSize, false };
+		}
+	}
+	//Arrays are reported as "name[0]", register them under their plain name as well
+	std::vector<std::pair<std::string, ShaderUniformInfo>> arrays;
+	for (auto iter = info.uniforms.begin(); iter != info.uniforms.end(); ++iter)
+	{
+		const std::string& uniformName = iter->first;
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+		{
+			arrays.push_back(std::make_pair(uniformName.substr(0, uniformName.size() - 3), iter->second));
+		}
+	}
+	info.uniforms.insert(arrays.begin(), arrays.end());
+}
+
+const ShaderProgramInfo* ShaderUtil::GetProgramInfo(unsigned int a_program)
+{
+	ShaderUtil* instance = ShaderUtil::GetInstance();
+	auto iter = instance->mProgramInfo.find(a_program);
+	return (iter != instance->mProgramInfo.end()) ? &iter->second : nullptr;
+}
+
+const ShaderUniformInfo* ShaderUtil::FindUniform(unsigned int a_program, const char* a_name)
+{
+	const ShaderProgramInfo* info = GetProgramInfo(a_program);
+	if (info == nullptr)
+	{
+		return nullptr;
+	}
+	auto iter = info->uniforms.find(a_name);
+	return (iter != info->uniforms.end()) ? &iter->second : nullptr;
+}
+
+const ShaderBlockInfo* ShaderUtil::FindBlock(unsigned int a_program, const char* a_name)
+{
+	const ShaderProgramInfo* info = GetProgramInfo(a_program);
+	if (info == nullptr)
+	{
+		return nullptr;
+	}
+	auto iter = info->blocks.find(a_name);
+	return (iter != info->blocks.end()) ? &iter->second : nullptr;
+}
+
+bool ShaderUtil::BindUniformBlock(unsigned int a_program, const char* a_name, unsigned int a_binding)
+{
+	ShaderUtil* instance = ShaderUtil::GetInstance();
+	auto programIter = instance->mProgramInfo.find(a_program);
+	if (programIter == instance->mProgramInfo.end())
+	{
+		return false;
+	}
+	auto blockIter = programIter->second.blocks.find(a_name);
+	if (blockIter == programIter->second.blocks.end() || blockIter->second.storage)
+	{
+		return false;
+	}
+	glUniformBlockBinding(a_program, blockIter->second.index, a_binding);
+	//Keep the reflected binding in step with the program
+	blockIter->second.binding = (int)a_binding;
+	return true;
+}
+
+void ShaderUtil::ReportTypeMismatch(unsigned int a_program, const char* a_name)
+{
+	std::cout << "Uniform " << a_name << " in program " << a_program << " does not match the requested handle type" << std::endl;
+}
+
+//Typed uniform handles
+template<> void ShaderUniform<int>::Set(const int& a_value) const { glUniform1i(m_location, a_value); }
+template<> void ShaderUniform<unsigned int>::Set(const unsigned int& a_value) const { glUniform1ui(m_location, a_value); }
+template<> void ShaderUniform<float>::Set(const float& a_value) const { glUniform1f(m_location, a_value); }
+template<> void ShaderUniform<glm::vec2>::Set(const glm::vec2& a_value) const { glUniform2fv(m_location, 1, glm::value_ptr(a_value)); }
+template<> void ShaderUniform<glm::vec3>::Set(const glm::vec3& a_value) const { glUniform3fv(m_location, 1, glm::value_ptr(a_value)); }
+template<> void ShaderUniform<glm::vec4>::Set(const glm::vec4& a_value) const { glUniform4fv(m_location, 1, glm::value_ptr(a_value)); }
+template<> void ShaderUniform<glm::mat3>::Set(const glm::mat3& a_value) const { glUniformMatrix3fv(m_location, 1, GL_FALSE, glm::value_ptr(a_value)); }
+template<> void ShaderUniform<glm::mat4>::Set(const glm::mat4& a_value) const { glUniformMatrix4fv(m_location, 1, GL_FALSE, glm::value_ptr(a_value)); }
+
+template<> bool ShaderUniform<int>::Accepts(unsigned int a_type)
+{
+	//Samplers and images are set through their texture unit
+	switch (a_type)
+	{
+	case GL_INT: case GL_BOOL:
+	case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_CUBE_MAP_ARRAY:
+	case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_IMAGE_2D: case GL_IMAGE_2D_ARRAY:
+		return true;
+	default:
+		return false;
+	}
+}
+template<> bool ShaderUniform<unsigned int>::Accepts(unsigned int a_type) { return a_type == GL_UNSIGNED_INT || a_type == GL_BOOL; }
+template<> bool ShaderUniform<float>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT; }
+template<> bool ShaderUniform<glm::vec2>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT_VEC2; }
+template<> bool ShaderUniform<glm::vec3>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT_VEC3; }
+template<> bool ShaderUniform<glm::vec4>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT_VEC4; }
+template<> bool ShaderUniform<glm::mat3>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT_MAT3; }
+template<> bool ShaderUniform<glm::mat4>::Accepts(unsigned int a_type) { return a_type == GL_FLOAT_MAT4; }
@@ -7,6 +7,7 @@
 
 #include "Texture.h"
 #include "ShaderUtil.h"
+#include "GLState.h"
 
 //Constructor and Destructor
 Skybox::Skybox() : m_SkyboxVBO(0), m_SkyboxVAO(0), m_SkyboxShader(0)
@@ -27,6 +28,11 @@ void Skybox::SetupSkybox()
     unsigned int vertexShader = ShaderUtil::LoadShader("resource/shaders/SB_vertex.glsl", GL_VERTEX_SHADER);
     unsigned int fragmentShader = ShaderUtil::LoadShader("resource/shaders/SB_fragment.glsl", GL_FRAGMENT_SHADER);
     m_SkyboxShader = ShaderUtil::CreateProgram(vertexShader, fragmentShader);
+    ShaderUtil::BindUniformBlock(m_SkyboxShader, "FrameData", ShaderUtil::FrameDataBinding);
+    //The cubemap is always sampled from texture unit 0
+    GLState::UseProgram(m_SkyboxShader);
+    ShaderUtil::GetUniform<int>(m_SkyboxShader, "CubeMap").Set(0);
+    GLState::UseProgram(0);
     //Delete shaders once program is created
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
@@ -78,37 +84,41 @@ void Skybox::SetupSkybox()
 
     glGenBuffers(1, &m_SkyboxVBO);
     glGenVertexArrays(1, &m_SkyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_SkyboxVBO);
-    glBindVertexArray(m_SkyboxVAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, m_SkyboxVBO);
+    GLState::BindVertexArray(m_SkyboxVAO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 }
 
-void Skybox::RenderSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+bool Skybox::IsReady() const
 {
-    glDepthMask(GL_FALSE);
-    glUseProgram(m_SkyboxShader);
-
-    int skyboxLocation = glGetUniformLocation(m_SkyboxShader, "CubeMap");
-    glUniform1i(skyboxLocation, 0);
-
-    glm::mat4 viewMat = glm::mat4(glm::mat3(viewMatrix)); //Remove translation from view matrix
-
-    //Pass view and projection matrix to the skybox shader
-    int projectionLocation = glGetUniformLocation(m_SkyboxShader, "ProjectionMatrix");
-    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    return m_SkyboxTexture->IsReady();
+}
 
-    int viewLocation = glGetUniformLocation(m_SkyboxShader, "View");
-    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, glm::value_ptr(viewMat));
+size_t Skybox::GetGPUMemory() const
+{
+    //36 vertices of 3 floats each make up the skybox cube
+    return 36 * 3 * sizeof(float) + m_SkyboxTexture->GetGPUMemory();
+}
 
-    glBindVertexArray(m_SkyboxVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_SkyboxTexture->GetCubeMapTexture());
+void Skybox::RenderSkybox()
+{
+    //Until the faces have finished loading the clear colour stands in for the sky
+    if (!m_SkyboxTexture->Update())
+    {
+        return;
+    }
+    //The cube sits on the far plane so it needs GL_LEQUAL to pass against a cleared depth buffer
+    GLState::DepthFunc(GL_LEQUAL);
+    GLState::DepthMask(false);
+    GLState::UseProgram(m_SkyboxShader);
+
+    GLState::BindVertexArray(m_SkyboxVAO);
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, m_SkyboxTexture->GetCubeMapTexture());
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
 
     //Return the depth function to default and stop using Skybox shaders
-    glDepthMask(GL_TRUE); 
-    glUseProgram(0);
+    GLState::DepthFunc(GL_LESS);
+    GLState::DepthMask(true);
 }
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include "Texture.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
 #include <stb_image.h>
 #include <iostream>
 #include <glad/glad.h>
 
 //Constructor
-Texture::Texture() : m_filename(), m_width(0), m_height(0), m_textureID(0)
+Texture::Texture() : m_filename(), m_width(0), m_height(0), m_mipLevels(0), m_baseLevel(0), m_textureID(0), m_bindlessHandle(0), m_ready(false),
+	m_compressed(false), m_compressedFormat(TextureCompressor::BC1), m_gpuBytes(0)
 {
 }
 //Destructor
@@ -12,43 +16,231 @@ Texture::~Texture()
 {
 	unload();
 }
-//Function to load texture from a file
-bool Texture::Load(std::string a_filepath)
+
+bool Texture::Decode(const std::string& a_filepath, TextureCompressor::Usage a_usage, bool a_compress, TextureImage& a_image)
+{
+	MappedFile source;
+	if (!source.Open(a_filepath))
+	{
+		return false;
+	}
+	//The cache is keyed by the source bytes so hashing is the only work a cache hit does on the source
+	uint64_t sourceHash = 0;
+	std::string cachePath;
+	TextureCompressor::CompressedImage compressed;
+	if (a_compress)
+	{
+		sourceHash = TextureCompressor::HashBytes(source.GetData(), source.GetSize());
+		cachePath = TextureCompressor::GetCachePath(sourceHash, a_usage);
+		if (TextureCompressor::ReadCache(cachePath, sourceHash, compressed))
+		{
+			a_image.compressed = true;
+			a_image.format = compressed.format;
+			a_image.width = compressed.width;
+			a_image.height = compressed.height;
+			a_image.levels = std::move(compressed.levels);
+			return true;
+		}
+	}
+	//Set per thread so decodes running on other threads keep their own setting
+	stbi_set_flip_vertically_on_load_thread(true);
+	int width = 0, height = 0, channels = 0;
+	unsigned char* imageData = stbi_load_from_memory(source.GetData(), (int)source.GetSize(), &width, &height, &channels, 4);
+	if (imageData == nullptr)
+	{
+		return false;
+	}
+	a_image.width = width;
+	a_image.height = height;
+	//Every level is built here on the decoding thread so the GL thread never runs glGenerateMipmap
+	std::vector<TextureCompressor::MipLevel> levels;
+	MipGenerator::Generate(imageData, width, height, MipGenerator::GetMode(a_usage), MipGenerator::KaiserFilter, levels);
+	if (a_compress)
+	{
+		//The compressed chain is what gets cached, so cache hits skip mip generation as well
+		TextureCompressor::Compress(levels, TextureCompressor::ChooseFormat(imageData, width, height, a_usage), compressed);
+		if (!TextureCompressor::WriteCache(cachePath, sourceHash, compressed))
+		{
+			std::cout << "Failed to write compressed texture cache: " << cachePath << std::endl;
+		}
+		a_image.compressed = true;
+		a_image.format = compressed.format;
+		a_image.levels = std::move(compressed.levels);
+	}
+	else
+	{
+		a_image.compressed = false;
+		a_image.format = TextureCompressor::BC1;
+		a_image.levels = std::move(levels);
+	}
+	stbi_image_free(imageData);
+	return true;
+}
+
+bool Texture::ReadDimensions(const std::string& a_filepath, unsigned int& a_width, unsigned int& a_height)
+{
+	MappedFile source;
+	int width = 0, height = 0, channels = 0;
+	if (!source.Open(a_filepath) || !stbi_info_from_memory(source.GetData(), (int)source.GetSize(), &width, &height, &channels))
+	{
+		return false;
+	}
+	a_width = width;
+	a_height = height;
+	return true;
+}
+
+bool Texture::DecodePixels(const std::string& a_filepath, std::vector<unsigned char>& a_pixels, unsigned int& a_width, unsigned int& a_height)
 {
+	MappedFile source;
+	if (!source.Open(a_filepath))
+	{
+		return false;
+	}
+	stbi_set_flip_vertically_on_load_thread(true);
 	int width = 0, height = 0, channels = 0;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* imageData = stbi_load(a_filepath.c_str(), &width, &height, &channels, 4);
-	if (imageData != nullptr)
-	{
-		m_filename = a_filepath;
-		m_width = width;
-		m_height = height;
-		glGenTextures(1, &m_textureID);
-		glBindTexture(GL_TEXTURE_2D, m_textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		stbi_image_free(imageData);
-		std::cout << "Successfully loaded Image File: " << a_filepath << std::endl;
-		return true;
-	}
-	std::cout << "Failed to open Image File: " << a_filepath << std::endl;
-	return false;
+	unsigned char* imageData = stbi_load_from_memory(source.GetData(), (int)source.GetSize(), &width, &height, &channels, 4);
+	if (imageData == nullptr)
+	{
+		return false;
+	}
+	a_pixels.assign(imageData, imageData + (size_t)width * height * 4);
+	a_width = width;
+	a_height = height;
+	stbi_image_free(imageData);
+	return true;
+}
+
+//Function to load texture from a file
+bool Texture::Load(std::string a_filepath, TextureCompressor::Usage a_usage, bool a_compress)
+{
+	TextureImage image;
+	if (!Decode(a_filepath, a_usage, a_compress, image))
+	{
+		std::cout << "Failed to open Image File: " << a_filepath << std::endl;
+		return false;
+	}
+	CreatePlaceholder(a_filepath);
+	for (unsigned int level = (unsigned int)image.levels.size(); level-- > 0;)
+	{
+		UploadLevel(image, level, image.levels[level].data.data());
+	}
+	std::cout << "Successfully loaded Image File: " << a_filepath << " (" << GetFormatName() << ")" << std::endl;
+	return true;
+}
+
+void Texture::CreatePlaceholder(const std::string& a_filepath)
+{
+	//Mid grey reads as a plain surface whichever slot the texture fills
+	static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+	m_filename = a_filepath;
+	m_width = 1;
+	m_height = 1;
+	m_mipLevels = 1;
+	m_baseLevel = 0;
+	m_ready = false;
+	m_compressed = false;
+	m_gpuBytes = sizeof(placeholder);
+	//Mutable storage, the decoded levels replace the placeholder in place so the ID handed out never changes
+	glGenTextures(1, &m_textureID);
+	GLState::BindTexture(GL_TEXTURE_2D, m_textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::UploadLevel(const TextureImage& a_image, unsigned int a_level, const void* a_pixels)
+{
+	const TextureCompressor::MipLevel& mip = a_image.levels[a_level];
+	unsigned int lastLevel = (unsigned int)a_image.levels.size() - 1;
+	GLState::BindTexture(GL_TEXTURE_2D, m_textureID);
+	if (a_level == lastLevel && !m_ready)
+	{
+		//First level of the real image, the placeholder stays in level 0 until level 0 is replaced but is outside
+		//the base to max level range from here on so is never sampled
+		m_width = a_image.width;
+		m_height = a_image.height;
+		m_mipLevels = lastLevel + 1;
+		m_baseLevel = m_mipLevels;
+		m_compressed = a_image.compressed;
+		m_compressedFormat = a_image.format;
+		m_gpuBytes = 0;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+		if (m_compressed && m_compressedFormat == TextureCompressor::BC4)
+		{
+			//Single channel maps sample as grey like the RGBA8 texture they replace
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+		}
+	}
+	if (m_compressed)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, a_level, TextureCompressor::GetGLFormat(m_compressedFormat), mip.width, mip.height, 0,
+			(GLsizei)mip.data.size(), a_pixels);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, a_level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, a_pixels);
+	}
+	//Sample from the largest level uploaded so far, the texture sharpens as the larger levels arrive
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, a_level);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+	m_gpuBytes += mip.data.size();
+	m_baseLevel = a_level;
+	//Levels streamed back in after a trim leave the texture ready throughout
+	m_ready = m_ready || (a_level == 0);
+}
+
+bool Texture::Trim(unsigned int a_baseLevel)
+{
+	if (!m_ready || m_bindlessHandle != 0 || a_baseLevel <= m_baseLevel || a_baseLevel >= m_mipLevels)
+	{
+		return false;
+	}
+	GLState::BindTexture(GL_TEXTURE_2D, m_textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, a_baseLevel);
+	for (unsigned int level = m_baseLevel; level < a_baseLevel; ++level)
+	{
+		//A zero sized level releases its memory, it is outside the base to max level range so the texture stays complete
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		size_t w = (m_width >> level) > 0 ? (m_width >> level) : 1;
+		size_t h = (m_height >> level) > 0 ? (m_height >> level) : 1;
+		m_gpuBytes -= m_compressed ? ((w + 3) / 4) * ((h + 3) / 4) * TextureCompressor::GetBlockBytes(m_compressedFormat) : w * h * 4;
+	}
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+	m_baseLevel = a_baseLevel;
+	return true;
 }
 
 void Texture::unload()
 {
-	glDeleteTextures(1, &m_textureID);
+	if (m_bindlessHandle != 0)
+	{
+		glMakeTextureHandleNonResidentARB(m_bindlessHandle);
+		m_bindlessHandle = 0;
+	}
+	GLState::DeleteTexture(m_textureID);
+}
+
+uint64_t Texture::GetBindlessHandle()
+{
+	if (m_bindlessHandle == 0 && m_ready && GLAD_GL_ARB_bindless_texture)
+	{
+		m_bindlessHandle = glGetTextureHandleARB(m_textureID);
+		glMakeTextureHandleResidentARB(m_bindlessHandle);
+	}
+	return m_bindlessHandle;
 }
 
 //CubeMap Constructor & Destructor
-CubeMap::CubeMap() : m_skyboxFaces(), m_cubemapTextureID(0)
+CubeMap::CubeMap() : m_skyboxFaces(), m_decodeJobs(), m_cancelled(false), m_cubemapTextureID(0), m_gpuMemory(0), m_ready(false), m_failed(false)
 {
-	std::vector<std::string> m_skyboxFaces
+	m_skyboxFaces =
 	{
 		"resource/skybox/right.jpg",
 		"resource/skybox/left.jpg",
@@ -57,43 +249,150 @@ CubeMap::CubeMap() : m_skyboxFaces(), m_cubemapTextureID(0)
 		"resource/skybox/front.jpg",
 		"resource/skybox/back.jpg"
 	};
-	m_cubemapTextureID = LoadCubeMap(m_skyboxFaces);
+	LoadCubeMap(m_skyboxFaces);
 }
 CubeMap::~CubeMap()
 {
+	FinishLoading();
+	GLState::DeleteTexture(m_cubemapTextureID);
 }
 
 //Function to LoadCubeMap textures
-unsigned int CubeMap::LoadCubeMap(std::vector<std::string> faces)
+void CubeMap::LoadCubeMap(const std::vector<std::string>& faces)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		m_faces[i].data = nullptr;
+		m_faces[i].width = 0;
+		m_faces[i].height = 0;
+		m_faces[i].state = FacePending;
+	}
+	if (faces.size() != 6)
+	{
+		std::cout << "Cubemap needs 6 faces but was given " << faces.size() << std::endl;
+		m_failed = true;
+		return;
+	}
+	//One job per face
+	JobSystem* jobSystem = JobSystem::GetInstance();
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		jobSystem->Run([this, i]() { DecodeFace(i); }, &m_decodeJobs, JobSystem::LowPriority);
+	}
+}
 
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
+void CubeMap::DecodeFace(unsigned int a_face)
+{
+	CubeFace& face = m_faces[a_face];
+	if (m_cancelled)
+	{
+		face.state = FaceFailed;
+		return;
+	}
+	MappedFile file;
+	if (file.Open(m_skyboxFaces[a_face]))
 	{
-		const char* filename = (faces[i]).c_str();
-		unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-		if (data)
+		//Cubemap faces are not flipped, set per thread so texture loads on other threads are unaffected
+		stbi_set_flip_vertically_on_load_thread(false);
+		int channels = 0;
+		face.data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &face.width, &face.height, &channels, 3);
+	}
+	face.state = (face.data != nullptr) ? FaceDecoded : FaceFailed;
+}
+
+bool CubeMap::Update()
+{
+	if (m_ready || m_failed)
+	{
+		return m_ready;
+	}
+	unsigned int uploaded = 0;
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		int state = m_faces[i].state;
+		if (state == FaceFailed)
+		{
+			std::cout << "Cubemap Texture failed to load at path: " << m_skyboxFaces[i] << std::endl;
+			m_failed = true;
+			FinishLoading();
+			return false;
+		}
+		if (state == FaceDecoded)
 		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-			);
-			std::cout << "Cubemap Texture loaded at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
+			//One face per frame, the remaining faces are picked up by the next calls
+			if (!UploadFace(i))
+			{
+				m_failed = true;
+				FinishLoading();
+			}
+			return false;
 		}
-		else
+		if (state == FaceUploaded)
 		{
-			std::cout << "Cubemap Texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
+			++uploaded;
 		}
 	}
+	if (uploaded < 6)
+	{
+		return false;
+	}
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTextureID);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	FinishLoading();
+	m_ready = true;
+	return true;
+}
 
-	return textureID;
-}
\ No newline at end of file
+bool CubeMap::UploadFace(unsigned int a_face)
+{
+	CubeFace& face = m_faces[a_face];
+	if (m_cubemapTextureID == 0)
+	{
+		//Every face shares the first decoded face's size, cubemap faces must be square
+		if (face.width != face.height)
+		{
+			std::cout << "Cubemap Texture is not square at path: " << m_skyboxFaces[a_face] << std::endl;
+			return false;
+		}
+		glGenTextures(1, &m_cubemapTextureID);
+		GLState::BindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTextureID);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_RGB8, face.width, face.height);
+	}
+	GLint size = 0;
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTextureID);
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+	if (face.width != size || face.height != size)
+	{
+		std::cout << "Cubemap Texture size does not match the other faces at path: " << m_skyboxFaces[a_face] << std::endl;
+		return false;
+	}
+	//Rows of RGB data are only 4 byte aligned for some widths
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + a_face, 0, 0, 0, face.width, face.height, GL_RGB, GL_UNSIGNED_BYTE, face.data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	m_gpuMemory += (size_t)face.width * face.height * 3;
+	stbi_image_free(face.data);
+	face.data = nullptr;
+	face.state = FaceUploaded;
+	std::cout << "Cubemap Texture loaded at path: " << m_skyboxFaces[a_face] << std::endl;
+	return true;
+}
+
+void CubeMap::FinishLoading()
+{
+	//Faces already being decoded are finished, the rest are dropped
+	m_cancelled = true;
+	JobSystem::GetInstance()->Wait(m_decodeJobs);
+	for (CubeFace& face : m_faces)
+	{
+		if (face.data != nullptr)
+		{
+			stbi_image_free(face.data);
+			face.data = nullptr;
+		}
+	}
+}
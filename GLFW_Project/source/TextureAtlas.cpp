@@ -0,0 +1,127 @@
+#include "TextureAtlas.h"
+#include "Texture.h"
+#include "MipGenerator.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+//ImGui compiles its copy of the packer static to its own translation unit, so this one gets its own as well
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+
+namespace
+{
+	unsigned int AlignToGutter(unsigned int a_size)
+	{
+		return (a_size + TextureAtlas::Gutter - 1) / TextureAtlas::Gutter * TextureAtlas::Gutter;
+	}
+}
+
+void TextureAtlas::Pack(const std::vector<Placement>& a_images, TextureCompressor::Usage a_usage, std::vector<Page>& a_pages)
+{
+	//Every rectangle is a multiple of the gutter so the skyline packer only ever places them on multiples of it too
+	std::vector<stbrp_rect> remaining(a_images.size());
+	for (size_t i = 0; i < a_images.size(); ++i)
+	{
+		remaining[i].id = (int)i;
+		remaining[i].w = AlignToGutter(a_images[i].width + Gutter * 2);
+		remaining[i].h = AlignToGutter(a_images[i].height + Gutter * 2);
+	}
+	std::vector<stbrp_node> nodes(PageSize);
+	while (!remaining.empty())
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, PageSize, PageSize, nodes.data(), (int)nodes.size());
+		stbrp_pack_rects(&context, remaining.data(), (int)remaining.size());
+		Page page;
+		page.usage = a_usage;
+		std::vector<stbrp_rect> unpacked;
+		for (const stbrp_rect& rect : remaining)
+		{
+			if (rect.was_packed)
+			{
+				Placement placement = a_images[rect.id];
+				placement.x = rect.x + Gutter;
+				placement.y = rect.y + Gutter;
+				page.placements.push_back(placement);
+			}
+			else
+			{
+				unpacked.push_back(rect);
+			}
+		}
+		if (page.placements.empty())
+		{
+			//Only possible for an image larger than a page, which MaxEntrySize rules out
+			break;
+		}
+		a_pages.push_back(std::move(page));
+		remaining.swap(unpacked);
+	}
+}
+
+bool TextureAtlas::BuildPage(const Page& a_page, bool a_compress, TextureImage& a_image)
+{
+	//Opaque black between textures so colour pages are not given an alpha channel by the gaps
+	std::vector<unsigned char> pixels((size_t)PageSize * PageSize * 4, 0);
+	for (size_t i = 3; i < pixels.size(); i += 4)
+	{
+		pixels[i] = 255;
+	}
+	std::vector<unsigned char> imageData;
+	for (const Placement& placement : a_page.placements)
+	{
+		unsigned int width = 0, height = 0;
+		if (!Texture::DecodePixels(placement.filename, imageData, width, height))
+		{
+			//Its rectangle would stay black, fail the page so nothing samples a texture that is not there
+			std::cout << "Failed to open Image File: " << placement.filename << std::endl;
+			return false;
+		}
+		//The file may have changed since it was measured, never write outside the space it was given
+		int w = (int)std::min(width, placement.width);
+		int h = (int)std::min(height, placement.height);
+		int gutter = (int)Gutter;
+		for (int y = -gutter; y < h + gutter; ++y)
+		{
+			//Gutters wrap around to the opposite edge so filtering across a repeat seam blends the right texels
+			int sourceY = (y % h + h) % h;
+			unsigned char* row = pixels.data() + ((size_t)(placement.y + y) * PageSize + placement.x) * 4;
+			for (int x = -gutter; x < w + gutter; ++x)
+			{
+				int sourceX = (x % w + w) % w;
+				memcpy(row + x * 4, imageData.data() + ((size_t)sourceY * width + sourceX) * 4, 4);
+			}
+		}
+	}
+
+	//Box filtered so each level reaches exactly one texel of the level above, the gutter halves per level
+	std::vector<TextureCompressor::MipLevel> levels;
+	MipGenerator::Generate(pixels.data(), PageSize, PageSize, MipGenerator::GetMode(a_page.usage), MipGenerator::BoxFilter, levels);
+	levels.resize(std::min((size_t)PageMipLevels, levels.size()));
+	a_image.width = PageSize;
+	a_image.height = PageSize;
+	if (a_compress)
+	{
+		TextureCompressor::CompressedImage compressed;
+		TextureCompressor::Compress(levels, TextureCompressor::ChooseFormat(pixels.data(), PageSize, PageSize, a_page.usage), compressed);
+		a_image.compressed = true;
+		a_image.format = compressed.format;
+		a_image.levels = std::move(compressed.levels);
+	}
+	else
+	{
+		a_image.compressed = false;
+		a_image.format = TextureCompressor::BC1;
+		a_image.levels = std::move(levels);
+	}
+	return true;
+}
+
+void TextureAtlas::GetUVTransform(const Placement& a_placement, float* a_transform)
+{
+	a_transform[0] = (float)a_placement.width / PageSize;
+	a_transform[1] = (float)a_placement.height / PageSize;
+	a_transform[2] = (float)a_placement.x / PageSize;
+	a_transform[3] = (float)a_placement.y / PageSize;
+}
@@ -0,0 +1,488 @@
+#include "TextureCompressor.h"
+#include "MappedFile.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+const char* TextureCompressor::CacheDirectory = "cache/textures";
+
+namespace
+{
+	//Laid out like KTX2: identifier, image description, then an offset and size for every mip level
+	const unsigned char CacheIdentifier[12] = { 0xAB, 'O', 'B', 'J', ' ', 'B', 'C', 'n', 0xBB, '\r', '\n', 0x1A };
+
+	typedef struct CacheHeader
+	{
+		unsigned char identifier[12];
+		uint32_t version;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint64_t sourceHash;
+	}CacheHeader;
+
+	typedef struct CacheLevel
+	{
+		uint64_t offset;
+		uint64_t size;
+	}CacheLevel;
+
+	const char* UsageNames[TextureCompressor::Usage_Count] = { "colour", "single", "normal" };
+
+	uint16_t Quantise565(const float* a_colour)
+	{
+		unsigned int r = (unsigned int)(std::min(std::max(a_colour[0], 0.f), 255.f) * 31.f / 255.f + 0.5f);
+		unsigned int g = (unsigned int)(std::min(std::max(a_colour[1], 0.f), 255.f) * 63.f / 255.f + 0.5f);
+		unsigned int b = (unsigned int)(std::min(std::max(a_colour[2], 0.f), 255.f) * 31.f / 255.f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void Expand565(uint16_t a_colour, int* a_output)
+	{
+		int r = (a_colour >> 11) & 0x1F;
+		int g = (a_colour >> 5) & 0x3F;
+		int b = a_colour & 0x1F;
+		a_output[0] = (r << 3) | (r >> 2);
+		a_output[1] = (g << 2) | (g >> 4);
+		a_output[2] = (b << 3) | (b >> 2);
+	}
+
+	//Choose the nearest of the four palette entries for every pixel, returns the summed squared error
+	int FitBC1Indices(const float (*a_colours)[3], uint16_t a_colour0, uint16_t a_colour1, unsigned char* a_indices)
+	{
+		int palette[4][3];
+		Expand565(a_colour0, palette[0]);
+		Expand565(a_colour1, palette[1]);
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		int totalError = 0;
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			int bestError = 0x7FFFFFFF;
+			for (unsigned char p = 0; p < 4; ++p)
+			{
+				int error = 0;
+				for (unsigned int c = 0; c < 3; ++c)
+				{
+					int difference = (int)a_colours[i][c] - palette[p][c];
+					error += difference * difference;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					a_indices[i] = p;
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+	}
+
+	//Least squares endpoints for a fixed set of indices, returns false if the indices do not constrain both endpoints
+	bool RefineBC1Endpoints(const float (*a_colours)[3], const unsigned char* a_indices, float* a_endpoint0, float* a_endpoint1)
+	{
+		static const float Weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		float ax[3] = {}, bx[3] = {};
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			float a = Weights[a_indices[i]];
+			float b = 1.f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (unsigned int c = 0; c < 3; ++c)
+			{
+				ax[c] += a * a_colours[i][c];
+				bx[c] += b * a_colours[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+		{
+			return false;
+		}
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			a_endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+			a_endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+		}
+		return true;
+	}
+
+	void WriteBC1(uint16_t a_colour0, uint16_t a_colour1, const unsigned char* a_indices, unsigned char* a_output)
+	{
+		uint32_t bits = 0;
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			bits |= (uint32_t)a_indices[i] << (i * 2);
+		}
+		a_output[0] = (unsigned char)(a_colour0 & 0xFF);
+		a_output[1] = (unsigned char)(a_colour0 >> 8);
+		a_output[2] = (unsigned char)(a_colour1 & 0xFF);
+		a_output[3] = (unsigned char)(a_colour1 >> 8);
+		std::memcpy(a_output + 4, &bits, 4);
+	}
+}
+
+TextureCompressor::Format TextureCompressor::ChooseFormat(const unsigned char* a_rgba, unsigned int a_width, unsigned int a_height, Usage a_usage)
+{
+	switch (a_usage)
+	{
+	case SingleChannelUsage:	return BC4;
+	case NormalUsage:			return BC5;
+	default:
+		break;
+	}
+	//Alpha only needs storing when something is not fully opaque
+	size_t pixels = (size_t)a_width * a_height;
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		if (a_rgba[i * 4 + 3] != 255)
+		{
+			return BC3;
+		}
+	}
+	return BC1;
+}
+
+void TextureCompressor::Compress(const std::vector<MipLevel>& a_levels, Format a_format, CompressedImage& a_image)
+{
+	a_image.format = a_format;
+	a_image.width = a_levels.front().width;
+	a_image.height = a_levels.front().height;
+	a_image.levels.clear();
+	const unsigned int blockBytes = GetBlockBytes(a_format);
+	for (const MipLevel& source : a_levels)
+	{
+		const std::vector<unsigned char>& pixels = source.data;
+		unsigned int width = source.width;
+		unsigned int height = source.height;
+		MipLevel level;
+		level.width = width;
+		level.height = height;
+		unsigned int blocksWide = (width + 3) / 4;
+		unsigned int blocksHigh = (height + 3) / 4;
+		level.data.resize((size_t)blocksWide * blocksHigh * blockBytes);
+		unsigned char* output = level.data.data();
+		for (unsigned int by = 0; by < blocksHigh; ++by)
+		{
+			for (unsigned int bx = 0; bx < blocksWide; ++bx)
+			{
+				//Blocks hanging over the edge of small levels repeat the edge pixels
+				unsigned char block[64];
+				unsigned char red[16], green[16], alpha[16];
+				for (unsigned int i = 0; i < 16; ++i)
+				{
+					unsigned int x = std::min(bx * 4 + (i & 3), width - 1);
+					unsigned int y = std::min(by * 4 + (i >> 2), height - 1);
+					std::memcpy(block + i * 4, &pixels[((size_t)y * width + x) * 4], 4);
+					red[i] = block[i * 4];
+					green[i] = block[i * 4 + 1];
+					alpha[i] = block[i * 4 + 3];
+				}
+				switch (a_format)
+				{
+				case BC1:
+					EncodeBC1(block, output);
+					break;
+				case BC3:
+					EncodeBC4(alpha, output);
+					EncodeBC1(block, output + 8);
+					break;
+				case BC4:
+					EncodeBC4(red, output);
+					break;
+				case BC5:
+					EncodeBC4(red, output);
+					EncodeBC4(green, output + 8);
+					break;
+				default:
+					break;
+				}
+				output += blockBytes;
+			}
+		}
+		a_image.levels.push_back(std::move(level));
+	}
+}
+
+void TextureCompressor::EncodeBC1(const unsigned char* a_block, unsigned char* a_output)
+{
+	float colours[16][3];
+	float mean[3] = {};
+	float minimum[3] = { 255.f, 255.f, 255.f };
+	float maximum[3] = {};
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			colours[i][c] = a_block[i * 4 + c];
+			mean[c] += colours[i][c] / 16.f;
+			minimum[c] = std::min(minimum[c], colours[i][c]);
+			maximum[c] = std::max(maximum[c], colours[i][c]);
+		}
+	}
+
+	//Principal axis of the colours by power iteration on their covariance, starting from the bounding box diagonal
+	float covariance[6] = {};
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		float r = colours[i][0] - mean[0], g = colours[i][1] - mean[1], b = colours[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+	float axis[3] = { maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] };
+	for (unsigned int iteration = 0; iteration < 4; ++iteration)
+	{
+		float next[3] =
+		{
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+		};
+		float largest = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+		if (largest < 1e-6f)
+		{
+			break;
+		}
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			axis[c] = next[c] / largest;
+		}
+	}
+	float axisLengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	float endpoint0[3] = { mean[0], mean[1], mean[2] };
+	float endpoint1[3] = { mean[0], mean[1], mean[2] };
+	if (axisLengthSq > 1e-6f)
+	{
+		//The extremes of the colours projected on the axis become the endpoints
+		float minProjection = 0.f, maxProjection = 0.f;
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			float projection = ((colours[i][0] - mean[0]) * axis[0] + (colours[i][1] - mean[1]) * axis[1] + (colours[i][2] - mean[2]) * axis[2]) / axisLengthSq;
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			endpoint0[c] = mean[c] + axis[c] * maxProjection;
+			endpoint1[c] = mean[c] + axis[c] * minProjection;
+		}
+	}
+
+	uint16_t colour0 = Quantise565(endpoint0);
+	uint16_t colour1 = Quantise565(endpoint1);
+	unsigned char indices[16] = {};
+	if (colour0 == colour1)
+	{
+		//A single colour, every index picks colour0
+		WriteBC1(colour0, colour1, indices, a_output);
+		return;
+	}
+	int error = FitBC1Indices(colours, colour0, colour1, indices);
+
+	//One least squares pass usually pulls the endpoints closer to the colours than the extremes do
+	unsigned char refinedIndices[16];
+	if (RefineBC1Endpoints(colours, indices, endpoint0, endpoint1))
+	{
+		uint16_t refined0 = Quantise565(endpoint0);
+		uint16_t refined1 = Quantise565(endpoint1);
+		if (refined0 != refined1)
+		{
+			int refinedError = FitBC1Indices(colours, refined0, refined1, refinedIndices);
+			if (refinedError < error)
+			{
+				colour0 = refined0;
+				colour1 = refined1;
+				std::memcpy(indices, refinedIndices, 16);
+			}
+		}
+	}
+
+	//colour0 must be the larger for the four colour mode, swapping the endpoints swaps indices 0 with 1 and 2 with 3
+	if (colour0 < colour1)
+	{
+		std::swap(colour0, colour1);
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			indices[i] ^= 1;
+		}
+	}
+	WriteBC1(colour0, colour1, indices, a_output);
+}
+
+void TextureCompressor::EncodeBC4(const unsigned char* a_values, unsigned char* a_output)
+{
+	unsigned char minimum = 255, maximum = 0;
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		minimum = std::min(minimum, a_values[i]);
+		maximum = std::max(maximum, a_values[i]);
+	}
+	std::memset(a_output, 0, 8);
+	a_output[0] = maximum;
+	a_output[1] = minimum;
+	if (maximum == minimum)
+	{
+		return;
+	}
+	//Eight value mode, the endpoints then six evenly spaced values between them
+	int palette[8] = { maximum, minimum };
+	for (int i = 2; i < 8; ++i)
+	{
+		palette[i] = ((8 - i) * maximum + (i - 1) * minimum + 3) / 7;
+	}
+	uint64_t bits = 0;
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		int bestError = 256;
+		uint64_t bestIndex = 0;
+		for (unsigned int p = 0; p < 8; ++p)
+		{
+			int error = std::abs((int)a_values[i] - palette[p]);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestIndex = p;
+			}
+		}
+		bits |= bestIndex << (i * 3);
+	}
+	for (unsigned int i = 0; i < 6; ++i)
+	{
+		a_output[2 + i] = (unsigned char)(bits >> (i * 8));
+	}
+}
+
+unsigned int TextureCompressor::GetGLFormat(Format a_format)
+{
+	switch (a_format)
+	{
+	case BC1:	return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BC3:	return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BC4:	return GL_COMPRESSED_RED_RGTC1;
+	case BC5:	return GL_COMPRESSED_RG_RGTC2;
+	default:	return 0;
+	}
+}
+
+const char* TextureCompressor::GetFormatName(Format a_format)
+{
+	static const char* Names[Format_Count] = { "BC1", "BC3", "BC4", "BC5" };
+	return (a_format < Format_Count) ? Names[a_format] : "Unknown";
+}
+
+uint64_t TextureCompressor::HashBytes(const unsigned char* a_data, size_t a_size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < a_size; ++i)
+	{
+		hash ^= a_data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string TextureCompressor::GetCachePath(uint64_t a_sourceHash, Usage a_usage)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx_%s.bcn", (unsigned long long)a_sourceHash, UsageNames[a_usage < Usage_Count ? a_usage : ColourUsage]);
+	return std::string(CacheDirectory) + name;
+}
+
+bool TextureCompressor::ReadCache(const std::string& a_path, uint64_t a_sourceHash, CompressedImage& a_image)
+{
+	MappedFile file;
+	if (!file.Open(a_path) || file.GetSize() < sizeof(CacheHeader))
+	{
+		return false;
+	}
+	CacheHeader header;
+	std::memcpy(&header, file.GetData(), sizeof(CacheHeader));
+	if (std::memcmp(header.identifier, CacheIdentifier, sizeof(CacheIdentifier)) != 0 || header.version != CacheVersion ||
+		header.sourceHash != a_sourceHash || header.format >= Format_Count || header.levelCount == 0 || header.levelCount > 32 ||
+		file.GetSize() < sizeof(CacheHeader) + header.levelCount * sizeof(CacheLevel))
+	{
+		return false;
+	}
+	a_image.format = (Format)header.format;
+	a_image.width = header.width;
+	a_image.height = header.height;
+	a_image.levels.resize(header.levelCount);
+	const unsigned int blockBytes = GetBlockBytes(a_image.format);
+	for (unsigned int i = 0; i < header.levelCount; ++i)
+	{
+		CacheLevel entry;
+		std::memcpy(&entry, file.GetData() + sizeof(CacheHeader) + i * sizeof(CacheLevel), sizeof(CacheLevel));
+		MipLevel& level = a_image.levels[i];
+		level.width = std::max(1u, header.width >> i);
+		level.height = std::max(1u, header.height >> i);
+		uint64_t expectedSize = (uint64_t)((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes;
+		if (entry.size != expectedSize || entry.offset > file.GetSize() || entry.size > file.GetSize() - entry.offset)
+		{
+			return false;
+		}
+		level.data.assign(file.GetData() + entry.offset, file.GetData() + entry.offset + entry.size);
+	}
+	return true;
+}
+
+bool TextureCompressor::WriteCache(const std::string& a_path, uint64_t a_sourceHash, const CompressedImage& a_image)
+{
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(a_path).parent_path(), error);
+	//Textures with identical contents share a cache entry so a per thread name keeps concurrent writers apart
+	std::string temporaryPath = a_path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		CacheHeader header = {};
+		std::memcpy(header.identifier, CacheIdentifier, sizeof(CacheIdentifier));
+		header.version = CacheVersion;
+		header.format = a_image.format;
+		header.width = a_image.width;
+		header.height = a_image.height;
+		header.levelCount = (uint32_t)a_image.levels.size();
+		header.sourceHash = a_sourceHash;
+		file.write((const char*)&header, sizeof(header));
+		uint64_t offset = sizeof(CacheHeader) + a_image.levels.size() * sizeof(CacheLevel);
+		for (const MipLevel& level : a_image.levels)
+		{
+			CacheLevel entry = { offset, level.data.size() };
+			file.write((const char*)&entry, sizeof(entry));
+			offset += level.data.size();
+		}
+		for (const MipLevel& level : a_image.levels)
+		{
+			file.write((const char*)level.data.data(), level.data.size());
+		}
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(temporaryPath, a_path, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
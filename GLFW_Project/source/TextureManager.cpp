@@ -1,5 +1,25 @@
 #include "TextureManager.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
+#include "TextureAtlas.h"
+#include "OBJ_Loader.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+namespace
+{
+	//Textures drawn within this many frames are never trimmed while something references them
+	const unsigned int TrimAfterFrames = 300;
+	//Trimmed textures keep the levels no larger than this on either side
+	const unsigned int TrimmedSize = 256;
+	//Each texture slot holds a different kind of map, which decides how it is filtered and compressed
+	const TextureCompressor::Usage SlotUsage[OBJMaterial::TextureTypes::TextureTypes_Count] =
+	{
+		TextureCompressor::ColourUsage, TextureCompressor::SingleChannelUsage, TextureCompressor::NormalUsage
+	};
+}
 
 //Set up static pointer for Singleton object
 TextureManager* TextureManager::m_instance = nullptr;
@@ -31,24 +51,207 @@ void TextureManager::DestroyInstance()
 	}
 }
 
-TextureManager::TextureManager() : m_pTextureMap()
+TextureManager::TextureManager() : m_pTextureMap(), m_idLookup(), m_atlasEntries(), m_atlasPagesCreated(0), m_failedPages(), m_failuresSeen(0), m_streamer(nullptr), m_placeholder(nullptr), m_textureGeneration(0),
+	m_frame(0), m_budgetBytes(DefaultMemoryBudget), m_trimmedCount(0), m_evictedCount(0), m_pinnedCount(0), m_bindless(GLAD_GL_ARB_bindless_texture != 0), m_compress(GLAD_GL_EXT_texture_compression_s3tc != 0), m_streaming(true), m_atlas(true)
+{
+	m_streamer = new TextureStreamer();
+	//The same mid grey streamed textures show, as a finished single level texture so it can have a handle
+	TextureImage image = { false, TextureCompressor::BC1, 1, 1, { { 1, 1, { 128, 128, 128, 255 } } } };
+	m_placeholder = new Texture();
+	m_placeholder->CreatePlaceholder("placeholder");
+	m_placeholder->UploadLevel(image, 0, image.levels[0].data.data());
+}
+
+void TextureManager::SetBindlessTextures(bool a_enabled)
+{
+	//Models already loaded keep the mode they were loaded with
+	m_bindless = a_enabled && GLAD_GL_ARB_bindless_texture;
+}
+
+void TextureManager::SetCompressedTextures(bool a_enabled)
 {
+	//RGTC is core but the colour formats need S3TC
+	m_compress = a_enabled && GLAD_GL_EXT_texture_compression_s3tc;
 }
 
 TextureManager::~TextureManager()
 {
+	//Stop the decode workers before the textures they were loading go
+	delete m_streamer;
+	m_streamer = nullptr;
+	delete m_placeholder;
+	m_placeholder = nullptr;
+	for (auto dictIter = m_pTextureMap.begin(); dictIter != m_pTextureMap.end(); ++dictIter)
+	{
+		delete dictIter->second.pTexture;
+	}
 	m_pTextureMap.clear();
+	m_idLookup.clear();
+	m_atlasEntries.clear();
+}
+
+void TextureManager::Update()
+{
+	++m_frame;
+	if (m_streamer->Update() > 0)
+	{
+		++m_textureGeneration;
+	}
+	//Only look for failed pages when the streamer has had a new failure
+	if (m_streamer->GetStats().failed != m_failuresSeen)
+	{
+		m_failuresSeen = m_streamer->GetStats().failed;
+		if (SplitFailedAtlasPages())
+		{
+			++m_textureGeneration;
+		}
+	}
+	EnforceBudget();
+}
+
+bool TextureManager::SplitFailedAtlasPages()
+{
+	bool failed = false;
+	for (auto atlasIter = m_atlasEntries.begin(); atlasIter != m_atlasEntries.end();)
+	{
+		const Texture* pPage = FindTexture(atlasIter->second.page);
+		//A ready page that failed to restore trimmed levels still samples the levels it kept
+		if (pPage == nullptr || pPage->IsReady() || !m_streamer->HasFailed(pPage))
+		{
+			++atlasIter;
+			continue;
+		}
+		//One unreadable file fails the whole page, on their own only that file is lost
+		if (m_failedPages.insert(atlasIter->second.page).second)
+		{
+			std::cout << "Atlas page " << atlasIter->second.page << " failed to build, loading its textures on their own" << std::endl;
+		}
+		failed = true;
+		atlasIter = m_atlasEntries.erase(atlasIter);
+	}
+	//A page no material has taken a reference to yet can go straight away
+	for (auto pageIter = m_failedPages.begin(); pageIter != m_failedPages.end();)
+	{
+		auto lookupIter = m_idLookup.find(*pageIter);
+		++pageIter;
+		if (lookupIter != m_idLookup.end() && lookupIter->second->second.refCount == 0)
+		{
+			EraseTexture(lookupIter->second);
+		}
+	}
+	return failed;
+}
+
+bool TextureManager::ReplaceFailedAtlasPages(OBJMaterial* a_material)
+{
+	bool changed = false;
+	for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
+	{
+		unsigned int page = a_material->textureIDs[n];
+		if (page == 0 || m_failedPages.find(page) == m_failedPages.end())
+		{
+			continue;
+		}
+		//Take the new reference first, the page is erased once its last reference is released
+		a_material->textureIDs[n] = LoadTexture(a_material->textureFileNames[n].c_str(), SlotUsage[n]);
+		a_material->textureHandles[n] = (m_bindless && a_material->textureIDs[n] != 0) ? GetBindlessHandle(a_material->textureIDs[n]) : 0;
+		ReleaseTexture(page);
+		changed = true;
+	}
+	return changed;
+}
+
+void TextureManager::EnforceBudget()
+{
+	m_pinnedCount = 0;
+	size_t totalBytes = GetTotalGPUMemory();
+	if (m_budgetBytes == 0 || totalBytes <= m_budgetBytes)
+	{
+		return;
+	}
+	//Unreferenced textures and ones no model has drawn for a while, least recently used first
+	std::vector<TextureMap::iterator> candidates;
+	for (auto dictIter = m_pTextureMap.begin(); dictIter != m_pTextureMap.end(); ++dictIter)
+	{
+		const TextureRef& texRef = dictIter->second;
+		if (texRef.refCount == 0 || m_frame - texRef.lastUsedFrame > TrimAfterFrames)
+		{
+			candidates.push_back(dictIter);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const TextureMap::iterator& a_lhs, const TextureMap::iterator& a_rhs)
+		{ return a_lhs->second.lastUsedFrame < a_rhs->second.lastUsedFrame; });
+
+	//Trimming first keeps a small copy resident, so coming back to a model shows its textures straight away
+	for (auto iter = candidates.begin(); iter != candidates.end() && totalBytes > m_budgetBytes; ++iter)
+	{
+		Texture* pTexture = (*iter)->second.pTexture;
+		if (m_streamer->IsStreaming(pTexture))
+		{
+			continue;
+		}
+		if (pTexture->HasBindlessHandle())
+		{
+			//Bindless materials sample it through a handle that fixed its levels, it stays whole until it is evicted
+			++m_pinnedCount;
+			continue;
+		}
+		unsigned int width = 0, height = 0;
+		pTexture->GetDimensions(width, height);
+		unsigned int baseLevel = 0;
+		while (baseLevel + 1 < pTexture->GetMipLevels() && std::max(width >> baseLevel, height >> baseLevel) > TrimmedSize)
+		{
+			++baseLevel;
+		}
+		size_t bytesBefore = pTexture->GetGPUMemory();
+		if (pTexture->Trim(baseLevel))
+		{
+			totalBytes -= bytesBefore - pTexture->GetGPUMemory();
+			++m_trimmedCount;
+		}
+	}
+	//Then evict outright, only textures nothing references can go as the IDs held by models must stay valid
+	for (auto iter = candidates.begin(); iter != candidates.end() && totalBytes > m_budgetBytes; ++iter)
+	{
+		if ((*iter)->second.refCount == 0)
+		{
+			totalBytes -= (*iter)->second.pTexture->GetGPUMemory();
+			EraseTexture(*iter);
+			++m_evictedCount;
+		}
+	}
+}
+
+void TextureManager::EraseTexture(TextureMap::iterator a_entry)
+{
+	Texture* pTexture = a_entry->second.pTexture;
+	for (auto atlasIter = m_atlasEntries.begin(); atlasIter != m_atlasEntries.end();)
+	{
+		atlasIter = (atlasIter->second.page == pTexture->GetTextureID()) ? m_atlasEntries.erase(atlasIter) : std::next(atlasIter);
+	}
+	m_streamer->Cancel(pTexture);
+	m_failedPages.erase(pTexture->GetTextureID());
+	m_idLookup.erase(pTexture->GetTextureID());
+	delete pTexture;
+	m_pTextureMap.erase(a_entry);
 }
 
 //Use an std map as a texture directory and reference counting
-unsigned int TextureManager::LoadTexture(const char* a_filename)
+unsigned int TextureManager::LoadTexture(const char* a_filename, TextureCompressor::Usage a_usage)
 {
 	if (a_filename != nullptr)
 	{
+		//A packed texture is a reference to its page
+		auto atlasIter = m_atlasEntries.find(a_filename);
+		if (atlasIter != m_atlasEntries.end())
+		{
+			++m_idLookup[atlasIter->second.page]->second.refCount;
+			return atlasIter->second.page;
+		}
 		auto dictionaryIter = m_pTextureMap.find(a_filename);
 		if (dictionaryIter != m_pTextureMap.end())
 		{
-			//Texture is already in map, increment ref and return texture ID
+			//Texture is already in map (possibly unreferenced but still resident), increment ref and return texture ID
 			TextureRef& texRef = (TextureRef&)(dictionaryIter->second);
 			++texRef.refCount;
 			return texRef.pTexture->GetTextureID();
@@ -56,39 +259,205 @@ unsigned int TextureManager::LoadTexture(const char* a_filename)
 		else
 		{
 			//Texture is not dictionary load in from file
-			Texture* pTexture = new Texture();
-			if (pTexture->Load(a_filename))
+			return AddTexture(a_filename, TextureStreamer::DecodeFile(a_filename, a_usage, m_compress), 1);
+		}
+	}
+	return 0;
+}
+
+unsigned int TextureManager::AddTexture(const std::string& a_name, std::function<bool(TextureImage&)> a_decode, unsigned int a_refCount)
+{
+	//The placeholder gives the texture its ID, the real levels replace it in the same texture once decoded
+	Texture* pTexture = new Texture();
+	pTexture->CreatePlaceholder(a_name);
+	if (m_streaming)
+	{
+		m_streamer->Request(pTexture, a_decode);
+	}
+	else
+	{
+		TextureImage image;
+		if (!a_decode(image) || image.levels.empty())
+		{
+			std::cout << "Failed to open Image File: " << a_name << std::endl;
+			delete pTexture;
+			return 0;
+		}
+		for (unsigned int level = (unsigned int)image.levels.size(); level-- > 0;)
+		{
+			pTexture->UploadLevel(image, level, image.levels[level].data.data());
+		}
+		std::cout << "Successfully loaded Image File: " << a_name << " (" << pTexture->GetFormatName() << ")" << std::endl;
+	}
+	TextureRef texRef = { pTexture, a_refCount, m_frame, std::move(a_decode) };
+	m_idLookup[pTexture->GetTextureID()] = m_pTextureMap.insert(std::make_pair(a_name, texRef)).first;
+	return pTexture->GetTextureID();
+}
+
+void TextureManager::PackMaterialTextures(OBJModel* a_model)
+{
+	//Small textures not held yet, grouped by usage as a page is filtered and compressed for a single usage
+	std::vector<TextureAtlas::Placement> candidates[TextureCompressor::Usage_Count];
+	std::set<std::string> seen;
+	for (unsigned int i = 0; i < a_model->GetMaterialCount(); i++)
+	{
+		OBJMaterial* mat = a_model->GetMaterialByIndex(i);
+		for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
+		{
+			const std::string& filename = mat->textureFileNames[n];
+			if (filename.empty() || !seen.insert(filename).second ||
+				m_pTextureMap.find(filename) != m_pTextureMap.end() || m_atlasEntries.find(filename) != m_atlasEntries.end())
 			{
-				//Successful Load
-				TextureRef texRef = { pTexture, 1 };
-				m_pTextureMap[a_filename] = texRef;
-				return pTexture->GetTextureID();
+				continue;
 			}
-			else
+			//Only the header is read here, the texture itself is decoded with the rest of the page
+			TextureAtlas::Placement placement = { filename, 0, 0, 0, 0 };
+			if (Texture::ReadDimensions(filename, placement.width, placement.height) && placement.width > 0 && placement.height > 0 &&
+				placement.width <= TextureAtlas::MaxEntrySize && placement.height <= TextureAtlas::MaxEntrySize)
 			{
-				delete pTexture;
-				return 0;
+				candidates[SlotUsage[n]].push_back(placement);
 			}
 		}
 	}
-	return 0;
+	for (unsigned int usage = 0; usage < TextureCompressor::Usage_Count; ++usage)
+	{
+		std::vector<TextureAtlas::Page> pages;
+		TextureAtlas::Pack(candidates[usage], (TextureCompressor::Usage)usage, pages);
+		for (const TextureAtlas::Page& page : pages)
+		{
+			//A page holding one texture saves nothing, that texture is loaded on its own
+			if (page.placements.size() < 2)
+			{
+				continue;
+			}
+			bool compress = m_compress;
+			std::string name = "atlas/" + std::to_string(m_atlasPagesCreated++);
+			unsigned int pageID = AddTexture(name, [page, compress](TextureImage& a_image) { return TextureAtlas::BuildPage(page, compress, a_image); }, 0);
+			if (pageID == 0)
+			{
+				continue;
+			}
+			for (const TextureAtlas::Placement& placement : page.placements)
+			{
+				AtlasEntry entry;
+				entry.page = pageID;
+				TextureAtlas::GetUVTransform(placement, entry.uvTransform);
+				m_atlasEntries[placement.filename] = entry;
+			}
+		}
+	}
+}
+
+void TextureManager::GetUVTransform(const std::string& a_filename, float* a_transform) const
+{
+	auto atlasIter = m_atlasEntries.find(a_filename);
+	if (atlasIter != m_atlasEntries.end())
+	{
+		std::copy(atlasIter->second.uvTransform, atlasIter->second.uvTransform + 4, a_transform);
+		return;
+	}
+	a_transform[0] = 1.f;
+	a_transform[1] = 1.f;
+	a_transform[2] = 0.f;
+	a_transform[3] = 0.f;
+}
+
+unsigned int TextureManager::GetAtlasPageCount() const
+{
+	std::set<unsigned int> pages;
+	for (auto atlasIter = m_atlasEntries.begin(); atlasIter != m_atlasEntries.end(); ++atlasIter)
+	{
+		pages.insert(atlasIter->second.page);
+	}
+	return (unsigned int)pages.size();
 }
 
 void TextureManager::ReleaseTexture(unsigned int a_texture)
 {
-	for (auto dictionaryIter = m_pTextureMap.begin();
-		dictionaryIter != m_pTextureMap.end(); ++dictionaryIter)
+	auto lookupIter = m_idLookup.find(a_texture);
+	if (lookupIter == m_idLookup.end())
 	{
-		TextureRef& texRef = (TextureRef&)(dictionaryIter->second);
-		if (a_texture == texRef.pTexture->GetTextureID())
+		return;
+	}
+	TextureRef& texRef = lookupIter->second->second;
+	if (texRef.refCount > 0 && --texRef.refCount == 0 && !texRef.pTexture->IsReady())
+	{
+		//Nothing has been uploaded worth keeping, stop streaming it now
+		EraseTexture(lookupIter->second);
+	}
+}
+
+const Texture* TextureManager::FindTexture(unsigned int a_texture) const
+{
+	auto lookupIter = m_idLookup.find(a_texture);
+	return (lookupIter != m_idLookup.end()) ? lookupIter->second->second.pTexture : nullptr;
+}
+
+void TextureManager::MarkUsed(unsigned int a_texture)
+{
+	auto lookupIter = m_idLookup.find(a_texture);
+	if (lookupIter == m_idLookup.end())
+	{
+		return;
+	}
+	TextureRef& texRef = lookupIter->second->second;
+	texRef.lastUsedFrame = m_frame;
+	Texture* pTexture = texRef.pTexture;
+	//A restore that failed is not retried every frame, the texture keeps sampling the levels it has
+	if (pTexture->IsReady() && pTexture->GetBaseLevel() > 0 && !m_streamer->IsStreaming(pTexture) && !m_streamer->HasFailed(pTexture))
+	{
+		//Trimmed, stream the dropped levels back in, the decode function gives the format the texture already has
+		m_streamer->Request(pTexture, texRef.decode);
+	}
+}
+
+uint64_t TextureManager::GetBindlessHandle(unsigned int a_texture)
+{
+	Texture* pTexture = const_cast<Texture*>(FindTexture(a_texture));
+	if (!m_bindless || pTexture == nullptr)
+	{
+		return 0;
+	}
+	//A handle freezes the texture's parameters so one is only taken once every level is uploaded
+	return pTexture->IsReady() ? pTexture->GetBindlessHandle() : m_placeholder->GetBindlessHandle();
+}
+
+void TextureManager::LoadMaterialTextures(OBJModel* a_model)
+{
+	if (m_atlas)
+	{
+		PackMaterialTextures(a_model);
+	}
+	//Load in texture for model if any are present
+	for (unsigned int i = 0; i < a_model->GetMaterialCount(); i++)
+	{
+		OBJMaterial* mat = a_model->GetMaterialByIndex(i);
+		for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
 		{
-			//Pre decrement will happen prior to this call to ==
-			if (--texRef.refCount == 0)
+			if (mat->textureFileNames[n].size() > 0)
 			{
-				delete texRef.pTexture;
-				texRef.pTexture = nullptr;
-				m_pTextureMap.erase(dictionaryIter);
-				break;
+				mat->textureIDs[n] = LoadTexture(mat->textureFileNames[n].c_str(), SlotUsage[n]);
+				if (m_bindless && mat->textureIDs[n] != 0)
+				{
+					mat->textureHandles[n] = GetBindlessHandle(mat->textureIDs[n]);
+				}
+			}
+		}
+	}
+}
+
+void TextureManager::ReleaseMaterialTextures(OBJModel* a_model)
+{
+	for (unsigned int i = 0; i < a_model->GetMaterialCount(); i++)
+	{
+		OBJMaterial* mat = a_model->GetMaterialByIndex(i);
+		for (int n = 0; n < OBJMaterial::TextureTypes::TextureTypes_Count; n++)
+		{
+			if (mat->textureIDs[n] != 0)
+			{
+				ReleaseTexture(mat->textureIDs[n]);
+				mat->textureIDs[n] = 0;
+				mat->textureHandles[n] = 0;
 			}
 		}
 	}
@@ -110,4 +479,37 @@ unsigned int TextureManager::GetTexture(const char* a_filename)
 		return texRef.pTexture->GetTextureID();
 	}
 	return 0;
+}
+
+size_t TextureManager::GetMemoryUsage(std::vector<TextureMemoryInfo>& a_info) const
+{
+	size_t totalBytes = 0;
+	a_info.clear();
+	a_info.reserve(m_pTextureMap.size());
+	for (auto dictIter = m_pTextureMap.begin(); dictIter != m_pTextureMap.end(); ++dictIter)
+	{
+		const TextureRef& texRef = dictIter->second;
+		TextureMemoryInfo info;
+		info.filename = dictIter->first;
+		texRef.pTexture->GetDimensions(info.width, info.height);
+		info.mipLevels = texRef.pTexture->GetMipLevels();
+		info.baseLevel = texRef.pTexture->GetBaseLevel();
+		info.refCount = texRef.refCount;
+		info.framesUnused = m_frame - texRef.lastUsedFrame;
+		info.gpuBytes = texRef.pTexture->GetGPUMemory();
+		info.format = texRef.pTexture->GetFormatName();
+		totalBytes += info.gpuBytes;
+		a_info.push_back(info);
+	}
+	return totalBytes;
+}
+
+size_t TextureManager::GetTotalGPUMemory() const
+{
+	size_t totalBytes = 0;
+	for (auto dictIter = m_pTextureMap.begin(); dictIter != m_pTextureMap.end(); ++dictIter)
+	{
+		totalBytes += dictIter->second.pTexture->GetGPUMemory();
+	}
+	return totalBytes;
 }
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "TextureStreamer.h"
+#include "GLState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+
+TextureStreamer::TextureStreamer(size_t a_ringBytes, size_t a_frameBudgetBytes) : m_decodeJobs(), m_decodedMutex(), m_decoded(), m_requests(), m_uploads(),
+	m_ringBuffer(0), m_ringData(nullptr), m_ringSize(0), m_ringHead(0), m_ringUsed(0), m_ringFrameBytes(0), m_ringFrames(),
+	m_frameBudget(a_frameBudgetBytes), m_stats()
+{
+	if ((GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) && a_ringBytes > 0)
+	{
+		//Mapped once for the life of the streamer, coherent so copies into it need no explicit flush
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &m_ringBuffer);
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ringBuffer);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, a_ringBytes, nullptr, flags);
+		m_ringData = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, a_ringBytes, flags);
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (m_ringData != nullptr)
+		{
+			m_ringSize = a_ringBytes;
+		}
+		else
+		{
+			std::cout << "Failed to map the texture upload ring, textures will upload from client memory" << std::endl;
+			GLState::DeleteBuffer(m_ringBuffer);
+			m_ringBuffer = 0;
+		}
+	}
+	m_stats.ringSize = m_ringSize;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	//Decodes already running finish into requests nobody reads, the ones not started yet return straight away
+	for (auto iter = m_requests.begin(); iter != m_requests.end(); ++iter)
+	{
+		iter->second->cancelled = true;
+	}
+	JobSystem::GetInstance()->Wait(m_decodeJobs);
+
+	for (auto iter = m_ringFrames.begin(); iter != m_ringFrames.end(); ++iter)
+	{
+		glDeleteSync((GLsync)iter->fence);
+	}
+	if (m_ringBuffer != 0)
+	{
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ringBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		GLState::DeleteBuffer(m_ringBuffer);
+	}
+}
+
+void TextureStreamer::Request(Texture* a_texture, DecodeFunction a_decode)
+{
+	RequestPtr request = std::make_shared<StreamRequest>();
+	request->texture = a_texture;
+	request->filename = a_texture->GetFileName();
+	request->decode = std::move(a_decode);
+	request->cancelled = false;
+	request->success = false;
+	request->nextLevel = 0;
+	m_requests[a_texture] = request;
+	m_failed.erase(a_texture);
+	//A background job so decodes never hold up a frame's jobs
+	JobSystem::GetInstance()->Run([this, request]() { Decode(request); }, &m_decodeJobs, JobSystem::LowPriority);
+}
+
+TextureStreamer::DecodeFunction TextureStreamer::DecodeFile(const std::string& a_filename, TextureCompressor::Usage a_usage, bool a_compress)
+{
+	return [a_filename, a_usage, a_compress](TextureImage& a_image) { return Texture::Decode(a_filename, a_usage, a_compress, a_image); };
+}
+
+bool TextureStreamer::IsStreaming(const Texture* a_texture) const
+{
+	return m_requests.find(const_cast<Texture*>(a_texture)) != m_requests.end();
+}
+
+void TextureStreamer::Cancel(Texture* a_texture)
+{
+	m_failed.erase(a_texture);
+	auto iter = m_requests.find(a_texture);
+	if (iter == m_requests.end())
+	{
+		return;
+	}
+	//The worker may still hold the request, it only ever reads the copied file name so the texture can go
+	iter->second->cancelled = true;
+	auto upload = std::find(m_uploads.begin(), m_uploads.end(), iter->second);
+	if (upload != m_uploads.end())
+	{
+		m_uploads.erase(upload);
+	}
+	m_requests.erase(iter);
+}
+
+void TextureStreamer::Decode(RequestPtr a_request)
+{
+	//Textures released before their decode started are skipped
+	if (a_request->cancelled)
+	{
+		return;
+	}
+	a_request->success = a_request->decode(a_request->image);
+	std::lock_guard<std::mutex> lock(m_decodedMutex);
+	m_decoded.push_back(a_request);
+}
+
+unsigned int TextureStreamer::Update()
+{
+	RetireFrames();
+	{
+		std::lock_guard<std::mutex> lock(m_decodedMutex);
+		for (auto iter = m_decoded.begin(); iter != m_decoded.end(); ++iter)
+		{
+			RequestPtr request = *iter;
+			if (request->cancelled)
+			{
+				continue;
+			}
+			if (!request->success || request->image.levels.empty())
+			{
+				//The texture keeps its placeholder
+				std::cout << "Failed to open Image File: " << request->filename << std::endl;
+				++m_stats.failed;
+				m_failed.insert(request->texture);
+				m_requests.erase(request->texture);
+				continue;
+			}
+			//A trimmed texture only needs the levels above the ones it kept
+			request->nextLevel = (unsigned int)request->image.levels.size();
+			if (request->texture->IsReady())
+			{
+				request->nextLevel = std::min(request->nextLevel, request->texture->GetBaseLevel());
+			}
+			m_uploads.push_back(request);
+		}
+		m_decoded.clear();
+	}
+
+	size_t uploadedBytes = 0;
+	unsigned int readyCount = 0;
+	bool ringBound = false;
+	while (!m_uploads.empty())
+	{
+		RequestPtr request = m_uploads.front();
+		if (request->nextLevel == 0)
+		{
+			//Nothing was missing
+			m_requests.erase(request->texture);
+			m_uploads.pop_front();
+			continue;
+		}
+		unsigned int level = request->nextLevel - 1;
+		TextureCompressor::MipLevel& mip = request->image.levels[level];
+		size_t size = mip.data.size();
+		//Always upload something, otherwise a level larger than the budget would never go up
+		if (uploadedBytes > 0 && uploadedBytes + size > m_frameBudget)
+		{
+			break;
+		}
+		size_t offset = 0;
+		if (m_ringData != nullptr && size <= m_ringSize)
+		{
+			if (!Allocate(size, offset))
+			{
+				//The GPU is still reading the rest of the ring, carry on next frame
+				break;
+			}
+			memcpy(m_ringData + offset, mip.data.data(), size);
+			if (!ringBound)
+			{
+				GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ringBuffer);
+				ringBound = true;
+			}
+			//With a pixel unpack buffer bound the pointer is an offset into it
+			request->texture->UploadLevel(request->image, level, (const void*)(uintptr_t)offset);
+		}
+		else
+		{
+			//No ring, or a level too large to ever fit in it, upload straight from the decoded copy
+			if (ringBound)
+			{
+				GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				ringBound = false;
+			}
+			request->texture->UploadLevel(request->image, level, mip.data.data());
+		}
+		uploadedBytes += size;
+		//The GL has its own copy now, free the level rather than hold the whole chain until the last level
+		std::vector<unsigned char>().swap(mip.data);
+		if (--request->nextLevel == 0)
+		{
+			std::cout << "Successfully loaded Image File: " << request->filename << " (" << request->texture->GetFormatName() << ")" << std::endl;
+			++readyCount;
+			m_requests.erase(request->texture);
+			m_uploads.pop_front();
+		}
+	}
+	if (ringBound)
+	{
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	if (m_ringFrameBytes > 0)
+	{
+		RingFrame frame = { m_ringFrameBytes, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+		m_ringFrames.push_back(frame);
+		m_ringFrameBytes = 0;
+	}
+
+	m_stats.uploading = (unsigned int)m_uploads.size();
+	m_stats.decoding = (unsigned int)m_requests.size() - m_stats.uploading;
+	m_stats.completed += readyCount;
+	m_stats.frameBytes = uploadedBytes;
+	m_stats.ringBytes = m_ringUsed;
+	return readyCount;
+}
+
+bool TextureStreamer::Allocate(size_t a_size, size_t& a_offset)
+{
+	//Offsets are kept 16 byte aligned, bytes skipped for alignment or at the end of the ring count against the frame
+	size_t offset = (m_ringHead + 15) & ~(size_t)15;
+	if (offset + a_size > m_ringSize)
+	{
+		offset = 0;
+	}
+	size_t consumed = (offset >= m_ringHead) ? (offset - m_ringHead + a_size) : (m_ringSize - m_ringHead + a_size);
+	if (m_ringUsed + consumed > m_ringSize)
+	{
+		return false;
+	}
+	a_offset = offset;
+	m_ringHead = offset + a_size;
+	m_ringUsed += consumed;
+	m_ringFrameBytes += consumed;
+	return true;
+}
+
+void TextureStreamer::RetireFrames()
+{
+	//Frames are retired oldest first, the first unsignalled fence means every later frame is still in use too
+	while (!m_ringFrames.empty())
+	{
+		GLsync fence = (GLsync)m_ringFrames.front().fence;
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+		glDeleteSync(fence);
+		m_ringUsed -= m_ringFrames.front().bytes;
+		m_ringFrames.pop_front();
+	}
+	//An idle ring starts again from the front so a large level does not have to wrap
+	if (m_ringUsed == 0)
+	{
+		m_ringHead = 0;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+class OBJModel;
+
+//Result of loading a single file as part of a batch
+typedef struct OBJBatchResult
+{
+	std::string filename;
+	OBJModel* model;		//Loaded model, nullptr if the load failed or the completion callback took ownership
+	bool success;
+	double loadTimeMs;		//Wall clock time spent in OBJModel::Load
+	double waitTimeMs;		//Time the file was held back waiting for the memory budget before it was queued
+	size_t fileBytes;		//Size of the file on disk
+	size_t modelBytes;		//CPU memory of the loaded model
+	std::string error;
+}OBJBatchResult;
+
+//Loads many OBJ files concurrently as background jobs on the shared JobSystem
+//Memory back-pressure is applied at submission, an estimate of each model's size is reserved before its job is
+//queued and LoadFiles holds back further files while the reserved memory is over budget or a load is in flight on
+//every worker. The jobs themselves never wait, so a batch can not tie up workers other jobs need.
+//Textures are not loaded here as they need the GL context, pass the returned models to the
+//TextureManager on the main thread so that shared textures are only loaded once.
+class OBJBatchLoader
+{
+public:
+	//Called on a worker thread as each file completes, the callback takes ownership of a_result.model
+	typedef std::function<void(OBJBatchResult& a_result)> CompletionCallback;
+
+	OBJBatchLoader(size_t a_memoryBudget = 512 * 1024 * 1024);
+	~OBJBatchLoader();
+
+	//Load every file in the list and block until all have finished, the calling thread queues the loads as the budget
+	//allows so it should not be a worker
+	//Without a callback loaded models are returned in the results and count against the memory budget
+	//until the batch completes, with a callback they are released from the budget once the callback returns
+	std::vector<OBJBatchResult> LoadFiles(const std::vector<std::string>& a_filenames, CompletionCallback a_callback = nullptr);
+	//Load every .obj (and compressed .obj.gz/.obj.zst) file in a directory
+	std::vector<OBJBatchResult> LoadDirectory(const std::string& a_directory, bool a_recursive = false, CompletionCallback a_callback = nullptr);
+	//Find the OBJ files in a directory, sorted by path
+	static std::vector<std::string> FindOBJFiles(const std::string& a_directory, bool a_recursive = false);
+
+	//Estimated parse memory per byte of file, used to reserve budget before a file is loaded
+	void SetMemoryEstimateFactor(float a_factor) { m_estimateFactor = a_factor; }
+	size_t GetMemoryBudget() const { return m_memoryBudget; }
+
+private:
+	void LoadFile(OBJBatchResult& a_result, const CompletionCallback& a_callback, size_t a_estimate);
+	//Block the submitting thread until a_bytes can be reserved without exceeding the budget and fewer than
+	//a_maxLoads are in flight, always lets one load proceed
+	void ReserveMemory(size_t a_bytes, unsigned int a_maxLoads);
+
+	size_t m_memoryBudget;
+	size_t m_memoryReserved;
+	unsigned int m_activeLoads;
+	float m_estimateFactor;
+	std::mutex m_memoryMutex;
+	std::condition_variable m_memoryAvailable;
+};
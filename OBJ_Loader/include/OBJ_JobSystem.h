@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+//A work stealing job system shared by everything that runs work off the main thread
+//Each worker owns a deque it pushes and pops its own jobs from the back of, idle workers steal the oldest jobs from
+//the front of another worker's deque. Jobs submitted from outside the workers go to a shared queue. Frame jobs are
+//high priority and always run before background jobs (file loads and texture decodes) that may take many frames.
+//A thread waiting on a counter runs high priority jobs while it waits rather than blocking, so waiting inside a job
+//can not deadlock the pool.
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+
+	enum Priority
+	{
+		HighPriority = 0,	//Frame work that is waited on, run first and helped with by waiting threads
+		LowPriority,		//Background work, only run by workers with no high priority jobs
+		Priority_Count,
+	};
+
+	//Counts the unfinished jobs of a group, jobs can be held back until another counter reaches zero
+	//A counter must outlive its jobs, wait on it before destroying it. Wait for zero before reusing it as a dependency.
+	class Counter
+	{
+	public:
+		Counter() : m_count(0), m_mutex(), m_done(), m_dependents() {}
+		bool IsDone() const { return m_count.load() == 0; }
+		unsigned int GetCount() const { return (unsigned int)m_count.load(); }
+
+	private:
+		friend class JobSystem;
+		Counter(const Counter&) = delete;
+		Counter& operator = (const Counter&) = delete;
+
+		std::atomic<int> m_count;
+		std::mutex m_mutex;
+		std::condition_variable m_done;
+		std::vector<std::function<void()>> m_dependents;	//Schedules held back until the count reaches zero
+	};
+
+	//Timing of the scheduling microbenchmark for one worker count
+	typedef struct BenchmarkResult
+	{
+		unsigned int workers;
+		unsigned int threads;	//The workers plus the calling thread, which runs jobs while it waits
+		double emptyJobNs;		//Cost of submitting, running and waiting on one empty job
+		double parallelForMs;	//Time to run the fixed arithmetic workload with ParallelFor
+		double speedup;			//Time of a plain serial loop over the workload over this time
+		double functionOverhead;	//Extra fraction of the serial time taken calling the loop through std::function
+	}BenchmarkResult;
+
+	static JobSystem* CreateInstance();
+	static JobSystem* GetInstance();
+	static void DestroyInstance();
+
+	//A thread count of 0 leaves one hardware thread for the main thread, the thread creating the system is the main thread
+	JobSystem(unsigned int a_threadCount = 0);
+	~JobSystem();
+
+	//Queue a job, a_counter (if any) counts it until it has run
+	void Run(Job a_job, Counter* a_counter = nullptr, Priority a_priority = HighPriority);
+	//Queue a job that only starts once a_dependency reaches zero
+	void RunAfter(Counter& a_dependency, Job a_job, Counter* a_counter = nullptr, Priority a_priority = HighPriority);
+	//Run a_function over [a_begin, a_end) in ranges of at least a_grainSize, returns once every range has run
+	void ParallelFor(unsigned int a_begin, unsigned int a_end, unsigned int a_grainSize, const std::function<void(unsigned int a_first, unsigned int a_last)>& a_function);
+	//Block until the counter reaches zero, running high priority jobs meanwhile and sleeping when there are none
+	void Wait(Counter& a_counter);
+
+	unsigned int GetThreadCount() const { return (unsigned int)m_queues.size() - 1; }
+	//Jobs taken from another worker's deque since the system was created
+	unsigned int GetStealCount() const { return m_steals.load(); }
+
+	//Measure the per job overhead and ParallelFor scaling on private job systems of 2 up to a_maxThreads threads,
+	//counting the calling thread. Takes a few hundred milliseconds and does not touch the shared instance's workers
+	static std::vector<BenchmarkResult> RunBenchmark(unsigned int a_maxThreads = 0);
+
+private:
+	//Copying a job system makes no sense
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator = (const JobSystem&) = delete;
+
+	//A job and the counter it reports to
+	typedef struct QueuedJob
+	{
+		Job job;
+		Counter* counter;
+	}QueuedJob;
+	typedef struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<QueuedJob> jobs[Priority_Count];
+	}WorkQueue;
+
+	void WorkerThread(unsigned int a_index);
+	void Schedule(QueuedJob a_job, Priority a_priority);
+	//Take a job of at most a_lowest priority, own deque first, then the shared queue, then steal
+	bool FindJob(Priority a_lowest, QueuedJob& a_job);
+	void Execute(QueuedJob& a_job);
+	static void Finish(Counter* a_counter);
+	//Index of the calling worker in this system, or -1 for any other thread
+	int GetWorkerIndex() const;
+
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;	//One per worker, the last is shared by every other thread
+	std::atomic<unsigned int> m_queuedJobs;
+	std::atomic<unsigned int> m_steals;
+	std::atomic<unsigned int> m_sleepingWorkers;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_jobAvailable;
+	bool m_shutdown;
+
+	static JobSystem* m_instance;
+};
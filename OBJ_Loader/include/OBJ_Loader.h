@@ -3,6 +3,9 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
 
 //A basic Vertex class for an OBJ file, supports vertex position , vertex normal, vertex uv coord
 class OBJVertex
@@ -52,13 +55,13 @@ inline bool OBJVertex::operator < (const OBJVertex& a_rhs) const
 class OBJMaterial
 {
 public:
-	OBJMaterial() : name(), kA(0.f), kD(0.f), kS(0.f) {};
+	OBJMaterial() : name(), kA(0.f), kD(0.f, 0.f, 0.f, 1.f), kS(0.f), textureIDs{ 0, 0, 0 }, textureHandles{ 0, 0, 0 } {};
 	~OBJMaterial() {};
 
 	std::string		name;
 	//colour and illumination variables
 	glm::vec4		kA;		//Ambient Light Colour - alpha component stores Optical Density (Ni)(Refraction Index 0.001 - 10)
-	glm::vec4       kD;		//Diffuse Light Colour - alpha component stores dissolve (d)(0-1)
+	glm::vec4       kD;		//Diffuse Light Colour - alpha component stores dissolve (d)(0-1), opaque unless the MTL sets d or Tr
 	glm::vec4		kS;		//Specular Light Colour (exponent stored in alpha)
 
 	//enum for the texture our OBJ model will support
@@ -73,6 +76,8 @@ public:
 	//Textures will have filenames for loading, then once loaded ID's stored in ID array
 	std::string	textureFileNames[TextureTypes_Count];
 	unsigned int textureIDs[TextureTypes_Count];
+	//Bindless texture handles, only filled when the renderer uses bindless textures
+	uint64_t textureHandles[TextureTypes_Count];
 };
 
 //An OBJ Model can be composed of many meshes. Much like any 3D model.
@@ -85,27 +90,48 @@ public:
 
 	glm::vec4 calculateFaceNormal(const unsigned int& a_indexA, const unsigned int& a_indexB, const unsigned int& a_indexC) const;
 	void calculateFaceNormals();
+	//Calculate the axis aligned bounds of the mesh vertices in model space
+	void calculateBounds();
+	//Memory accounting - bytes of CPU memory held by the vertex and index arrays (includes reserved capacity)
+	size_t GetVertexBytes()		const { return m_vertices.capacity() * sizeof(OBJVertex); }
+	size_t GetIndexBytes()		const { return m_indices.capacity() * sizeof(unsigned int); }
+	size_t GetMemoryUsage()		const { return sizeof(OBJMesh) + m_name.capacity() + GetVertexBytes() + GetIndexBytes(); }
 
 	std::string					m_name;
 	std::vector<OBJVertex>		m_vertices;
 	std::vector<unsigned int>	m_indices;
 	OBJMaterial*				m_material;
+	glm::vec3					m_boundsMin;
+	glm::vec3					m_boundsMax;
 };
 //Inline constructor & destructor -- to be expanded upon as required
-inline OBJMesh::OBJMesh() {}
+inline OBJMesh::OBJMesh() : m_name(), m_vertices(), m_indices(), m_material(nullptr), m_boundsMin(0.f), m_boundsMax(0.f) {}
 inline OBJMesh::~OBJMesh() {}
 
+//Breakdown of the CPU memory used by an OBJ Model, all values are in bytes
+typedef struct OBJMemoryUsage
+{
+	size_t vertexBytes;		//Vertex arrays of all meshes
+	size_t indexBytes;		//Index arrays of all meshes
+	size_t materialBytes;	//Materials including texture filename strings
+	size_t meshBytes;		//Mesh objects and names
+	size_t parseBufferBytes;	//Peak size of the transient position/normal/uv buffers used during the last Load
+	//Total resident bytes - parse buffers are freed once Load returns so are not included
+	size_t Total() const { return vertexBytes + indexBytes + materialBytes + meshBytes; }
+}OBJMemoryUsage;
+
 class OBJModel
 {
 public:
-	OBJModel() : m_worldMatrix(glm::mat4(1.0f)), m_path(), m_meshes(), m_materials() {};
+	OBJModel() : m_materials(), m_meshes(), m_path(), m_filename(), m_worldMatrix(glm::mat4(1.0f)), m_translation(0.f), m_rotation(0.f), m_scale(1.f),
+		m_parseBufferBytes(0), m_logging(true) {};
 	~OBJModel()
 	{
 		Unload();	//function to unload any data loaded in from file
 	};
 
 	//Load from file function
-	bool Load(std::string a_filename, float a_scale = 1.0f);
+	bool Load(std::string a_filename);
 	//function to unload and free memory
 	void Unload();
 	//functions to retrieve path, number of meshes and world matrix of model
@@ -113,14 +139,32 @@ public:
 	const char*			GetFilename()		const { return m_filename.c_str(); }
 	unsigned int		GetMeshCount()		const { return m_meshes.size(); }
 	const glm::mat4&	GetWorldMatrix()	const { return m_worldMatrix; }
+	//Transform of the model - the world matrix is rebuilt as Translation * Rotation * Scale whenever one of these changes
+	//Rotation is stored as euler angles in radians, applied in the order Y (yaw), X (pitch), Z (roll)
+	void				SetTranslation(const glm::vec3& a_translation)	{ m_translation = a_translation; UpdateWorldMatrix(); }
+	void				SetRotation(const glm::vec3& a_rotation)		{ m_rotation = a_rotation; UpdateWorldMatrix(); }
+	void				SetScale(const glm::vec3& a_scale)				{ m_scale = a_scale; UpdateWorldMatrix(); }
+	void				SetTransform(const glm::vec3& a_translation, const glm::vec3& a_rotation, const glm::vec3& a_scale);
+	const glm::vec3&	GetTranslation()	const { return m_translation; }
+	const glm::vec3&	GetRotation()		const { return m_rotation; }
+	const glm::vec3&	GetScale()			const { return m_scale; }
 	unsigned int		GetMaterialCount()  const { return m_materials.size(); }
 	//Functions to retrieve mesh by name or index for models that contain multiple meshes
 	OBJMesh*			GetMeshByName(const char* a_name);
 	OBJMesh*			GetMeshByIndex(unsigned int a_index);
+	const OBJMesh*		GetMeshByIndex(unsigned int a_index) const;
 	OBJMaterial*		GetMaterialByName(const char* a_name);
 	OBJMaterial*		GetMaterialByIndex(unsigned int a_index);
+	//Memory accounting - CPU bytes currently held by this model
+	OBJMemoryUsage		GetMemoryUsage()	const;
+	//Enable or disable console output while loading, batch loads disable this to keep the console readable
+	void				SetLogging(bool a_logging) { m_logging = a_logging; }
 
 private:
+	//Stream used for console output, discards output when logging is disabled
+	std::ostream& Log() const;
+	//Rebuild the world matrix from the translation, rotation and scale
+	void UpdateWorldMatrix();
 	//Function to process line data read in from file
 	std::string lineType(const std::string& a_in);
 	std::string lineData(const std::string& a_in);
@@ -147,4 +191,10 @@ private:
 	std::string m_filename;
 	//Root Mat4 (World Matrix)
 	glm::mat4 m_worldMatrix;
+	glm::vec3 m_translation;
+	glm::vec3 m_rotation;
+	glm::vec3 m_scale;
+	//Peak bytes used by the transient parse buffers during the last Load
+	size_t m_parseBufferBytes;
+	bool m_logging;
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <istream>
+#include <fstream>
+#include <string>
+
+//Forward declare the decompression buffer as it is an implementation detail of OBJ_Stream.cpp
+class DecompressionBuffer;
+
+//An input stream for OBJ and MTL files
+//Plain text files are read directly, gzip (.gz) and zstd (.zst) compressed files are detected from their
+//header bytes and decompressed in fixed size blocks on background threads while the caller parses the text.
+//One thread reads compressed blocks from disk and another decompresses them, so I/O, decompression and
+//parsing all overlap and only a handful of blocks are ever held in memory at once.
+//The zstd decoder uses libzstd, which is not part of this repository. To read .zst files install zstd (for example
+//vcpkg install zstd:x64-windows), add its include directory and zstd.lib to both projects and define
+//OBJ_LOADER_USE_ZSTD for OBJ_Loader. Without it zstd files are still recognised and refused by open.
+//The stream never prints, the reason a file could not be opened or decompressed is returned by GetError.
+class OBJInputStream : public std::istream
+{
+public:
+	enum Compression
+	{
+		None = 0,
+		GZip,
+		ZStd,
+	};
+
+	OBJInputStream();
+	~OBJInputStream();
+
+	//Open a file for reading, returns false if the file could not be opened or uses an unsupported compression
+	bool open(const std::string& a_filename);
+	void close();
+	bool is_open() const { return m_file.is_open(); }
+	//Size of the file on disk, for compressed files this is the compressed size
+	std::streamsize GetFileSize() const { return m_fileSize; }
+	Compression GetCompression() const { return m_compression; }
+	//True if the decompressor found corrupt or truncated data
+	bool DecompressionFailed() const;
+	//Why open failed or decompression stopped, empty if neither has happened
+	std::string GetError() const;
+
+	//Size of each block read from disk and produced by the decompressor
+	static const size_t BlockSize = 64 * 1024;
+	//Number of blocks in flight between each stage of the pipeline
+	static const size_t BlockCount = 4;
+
+private:
+	std::ifstream m_file;
+	std::streamsize m_fileSize;
+	Compression m_compression;
+	DecompressionBuffer* m_decompressionBuffer;
+	std::string m_error;
+};
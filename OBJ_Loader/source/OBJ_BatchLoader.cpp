@@ -0,0 +1,160 @@
+#include "OBJ_BatchLoader.h"
+#include "OBJ_Loader.h"
+#include "OBJ_JobSystem.h"
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
+OBJBatchLoader::OBJBatchLoader(size_t a_memoryBudget) : m_memoryBudget(a_memoryBudget), m_memoryReserved(0), m_activeLoads(0),
+	m_estimateFactor(4.f)
+{
+}
+
+OBJBatchLoader::~OBJBatchLoader()
+{
+}
+
+std::vector<OBJBatchResult> OBJBatchLoader::LoadFiles(const std::vector<std::string>& a_filenames, CompletionCallback a_callback)
+{
+	std::vector<OBJBatchResult> results(a_filenames.size());
+	JobSystem* jobSystem = JobSystem::GetInstance();
+	JobSystem::Counter loads;
+	//One load per worker is enough to keep them busy, more would only hold memory while they wait to be run
+	unsigned int maxLoads = std::max(1u, jobSystem->GetThreadCount());
+	auto batchStart = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < a_filenames.size(); ++i)
+	{
+		OBJBatchResult& result = results[i];
+		result.filename = a_filenames[i];
+		result.model = nullptr;
+		result.success = false;
+		result.loadTimeMs = 0.0;
+		result.waitTimeMs = 0.0;
+		result.fileBytes = 0;
+		result.modelBytes = 0;
+		std::error_code error;
+		result.fileBytes = (size_t)std::filesystem::file_size(result.filename, error);
+		if (error)
+		{
+			result.error = "Unable to open file";
+			continue;
+		}
+		//Compressed files expand considerably when parsed so reserve proportionally more for them
+		size_t estimate = (size_t)(result.fileBytes * m_estimateFactor);
+		std::filesystem::path extension = std::filesystem::path(result.filename).extension();
+		if (extension == ".gz" || extension == ".zst")
+		{
+			estimate *= 8;
+		}
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		ReserveMemory(estimate, maxLoads);
+		result.waitTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+
+		//Each job writes only to its own result so no locking is needed on the results vector
+		//Loads are background jobs, a frame's jobs still run ahead of them while a batch is in progress
+		jobSystem->Run([this, &result, &a_callback, estimate]() { LoadFile(result, a_callback, estimate); }, &loads, JobSystem::LowPriority);
+	}
+	jobSystem->Wait(loads);
+
+	//Any models handed back in the results no longer count against the budget of the next batch
+	{
+		std::lock_guard<std::mutex> lock(m_memoryMutex);
+		m_memoryReserved = 0;
+	}
+	double batchTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - batchStart).count();
+	size_t failures = std::count_if(results.begin(), results.end(), [](const OBJBatchResult& r) { return !r.success; });
+	std::cout << "Batch loaded " << results.size() - failures << " of " << results.size() << " files in " << batchTime << " ms using "
+		<< jobSystem->GetThreadCount() << " threads" << std::endl;
+	return results;
+}
+
+std::vector<OBJBatchResult> OBJBatchLoader::LoadDirectory(const std::string& a_directory, bool a_recursive, CompletionCallback a_callback)
+{
+	return LoadFiles(FindOBJFiles(a_directory, a_recursive), a_callback);
+}
+
+std::vector<std::string> OBJBatchLoader::FindOBJFiles(const std::string& a_directory, bool a_recursive)
+{
+	std::vector<std::string> files;
+	std::error_code error;
+	auto isOBJ = [](const std::filesystem::path& a_path)
+	{
+		std::string name = a_path.filename().string();
+		std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)::tolower(c); });
+		auto endsWith = [&name](const char* a_suffix)
+		{
+			size_t length = strlen(a_suffix);
+			return name.size() >= length && name.compare(name.size() - length, length, a_suffix) == 0;
+		};
+		return endsWith(".obj") || endsWith(".obj.gz") || endsWith(".obj.zst");
+	};
+	if (a_recursive)
+	{
+		for (auto iter = std::filesystem::recursive_directory_iterator(a_directory, error); !error && iter != std::filesystem::recursive_directory_iterator(); iter.increment(error))
+		{
+			if (iter->is_regular_file(error) && isOBJ(iter->path())) { files.push_back(iter->path().string()); }
+		}
+	}
+	else
+	{
+		for (auto iter = std::filesystem::directory_iterator(a_directory, error); !error && iter != std::filesystem::directory_iterator(); iter.increment(error))
+		{
+			if (iter->is_regular_file(error) && isOBJ(iter->path())) { files.push_back(iter->path().string()); }
+		}
+	}
+	if (error)
+	{
+		std::cout << "Unable to read directory " << a_directory << ": " << error.message() << std::endl;
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+void OBJBatchLoader::LoadFile(OBJBatchResult& a_result, const CompletionCallback& a_callback, size_t a_estimate)
+{
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	OBJModel* model = new OBJModel();
+	model->SetLogging(false);
+	a_result.success = model->Load(a_result.filename);
+	a_result.loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	if (a_result.success)
+	{
+		a_result.model = model;
+		a_result.modelBytes = model->GetMemoryUsage().Total();
+		if (model->GetMeshCount() == 0)
+		{
+			a_result.error = "File contains no meshes";
+		}
+	}
+	else
+	{
+		a_result.error = "Failed to load file";
+		delete model;
+	}
+
+	//Swap the estimate for what the model actually holds, or release it all if the callback takes the model
+	size_t heldBytes = a_result.modelBytes;
+	if (a_callback)
+	{
+		a_callback(a_result);
+		a_result.model = nullptr;
+		heldBytes = 0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_memoryMutex);
+		m_memoryReserved = m_memoryReserved - a_estimate + heldBytes;
+		--m_activeLoads;
+	}
+	m_memoryAvailable.notify_all();
+}
+
+void OBJBatchLoader::ReserveMemory(size_t a_bytes, unsigned int a_maxLoads)
+{
+	std::unique_lock<std::mutex> lock(m_memoryMutex);
+	m_memoryAvailable.wait(lock, [this, a_bytes, a_maxLoads]()
+		{ return m_activeLoads == 0 || (m_activeLoads < a_maxLoads && m_memoryReserved + a_bytes <= m_memoryBudget); });
+	m_memoryReserved += a_bytes;
+	++m_activeLoads;
+}
@@ -0,0 +1,357 @@
+#include "OBJ_JobSystem.h"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	//Set by each worker as it starts so a job knows which deque is its own
+	thread_local const JobSystem* t_system = nullptr;
+	thread_local int t_workerIndex = -1;
+}
+
+//Set up static pointer for Singleton object
+JobSystem* JobSystem::m_instance = nullptr;
+
+JobSystem* JobSystem::CreateInstance()
+{
+	if (nullptr == m_instance)
+	{
+		m_instance = new JobSystem();
+	}
+	return m_instance;
+}
+
+JobSystem* JobSystem::GetInstance()
+{
+	if (nullptr == m_instance)
+	{
+		return JobSystem::CreateInstance();
+	}
+	return m_instance;
+}
+
+void JobSystem::DestroyInstance()
+{
+	if (nullptr != m_instance)
+	{
+		delete m_instance;
+		m_instance = nullptr;
+	}
+}
+
+JobSystem::JobSystem(unsigned int a_threadCount) : m_workers(), m_queues(), m_queuedJobs(0), m_steals(0), m_sleepingWorkers(0),
+	m_shutdown(false)
+{
+	if (a_threadCount == 0)
+	{
+		//hardware_concurrency may not be able to tell us, and there is always at least one worker
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		a_threadCount = (hardwareThreads > 1) ? hardwareThreads - 1 : (hardwareThreads == 0 ? 3 : 1);
+	}
+	for (unsigned int i = 0; i <= a_threadCount; ++i)
+	{
+		m_queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+	m_workers.reserve(a_threadCount);
+	for (unsigned int i = 0; i < a_threadCount; ++i)
+	{
+		m_workers.push_back(std::thread(&JobSystem::WorkerThread, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	//Let the workers drain the queues before shutting down
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_shutdown = true;
+	}
+	m_jobAvailable.notify_all();
+	for (auto iter = m_workers.begin(); iter != m_workers.end(); ++iter)
+	{
+		iter->join();
+	}
+}
+
+void JobSystem::Run(Job a_job, Counter* a_counter, Priority a_priority)
+{
+	if (a_counter != nullptr)
+	{
+		++a_counter->m_count;
+	}
+	QueuedJob queued = { std::move(a_job), a_counter };
+	Schedule(std::move(queued), a_priority);
+}
+
+void JobSystem::RunAfter(Counter& a_dependency, Job a_job, Counter* a_counter, Priority a_priority)
+{
+	if (a_counter != nullptr)
+	{
+		++a_counter->m_count;
+	}
+	QueuedJob queued = { std::move(a_job), a_counter };
+	{
+		//Checked under the dependency's lock so the last job finishing either sees this dependent or it sees zero
+		std::lock_guard<std::mutex> lock(a_dependency.m_mutex);
+		if (a_dependency.m_count.load() > 0)
+		{
+			a_dependency.m_dependents.push_back([this, queued, a_priority]() { Schedule(queued, a_priority); });
+			return;
+		}
+	}
+	Schedule(std::move(queued), a_priority);
+}
+
+void JobSystem::ParallelFor(unsigned int a_begin, unsigned int a_end, unsigned int a_grainSize, const std::function<void(unsigned int a_first, unsigned int a_last)>& a_function)
+{
+	if (a_end <= a_begin)
+	{
+		return;
+	}
+	//A few ranges per thread so stealing can even out ranges that take longer than others
+	unsigned int count = a_end - a_begin;
+	unsigned int rangeCount = (GetThreadCount() + 1) * 4;
+	unsigned int rangeSize = std::max(std::max(a_grainSize, 1u), (count + rangeCount - 1) / rangeCount);
+	if (rangeSize >= count)
+	{
+		a_function(a_begin, a_end);
+		return;
+	}
+	Counter counter;
+	for (unsigned int first = a_begin + rangeSize; first < a_end;)
+	{
+		unsigned int last = first + std::min(rangeSize, a_end - first);
+		Run([&a_function, first, last]() { a_function(first, last); }, &counter);
+		first = last;
+	}
+	//The calling thread takes the first range itself rather than sit idle
+	a_function(a_begin, a_begin + rangeSize);
+	Wait(counter);
+}
+
+void JobSystem::Wait(Counter& a_counter)
+{
+	while (true)
+	{
+		//Checked under the counter's lock, once the last job has released it the counter is free to be destroyed
+		{
+			std::lock_guard<std::mutex> lock(a_counter.m_mutex);
+			if (a_counter.m_count.load() == 0)
+			{
+				return;
+			}
+		}
+		QueuedJob job;
+		if (FindJob(HighPriority, job))
+		{
+			Execute(job);
+			continue;
+		}
+		//Nothing to help with, the jobs left are running elsewhere or are background jobs. Sleep briefly rather than
+		//until the counter is done so new high priority jobs are still picked up
+		std::unique_lock<std::mutex> lock(a_counter.m_mutex);
+		a_counter.m_done.wait_for(lock, std::chrono::milliseconds(1), [&a_counter]() { return a_counter.m_count.load() == 0; });
+	}
+}
+
+void JobSystem::WorkerThread(unsigned int a_index)
+{
+	t_system = this;
+	t_workerIndex = (int)a_index;
+	while (true)
+	{
+		QueuedJob job;
+		if (FindJob(LowPriority, job))
+		{
+			Execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		++m_sleepingWorkers;
+		m_jobAvailable.wait(lock, [this]() { return m_shutdown || m_queuedJobs.load() > 0; });
+		--m_sleepingWorkers;
+		if (m_shutdown && m_queuedJobs.load() == 0)
+		{
+			return;	//Shutdown requested and there is no work left
+		}
+	}
+}
+
+void JobSystem::Schedule(QueuedJob a_job, Priority a_priority)
+{
+	//Counted before it is pushed so a worker never sees a job it can not account for, at worst it looks again
+	++m_queuedJobs;
+	int index = GetWorkerIndex();
+	WorkQueue& queue = *m_queues[(index >= 0) ? (size_t)index : m_queues.size() - 1];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs[a_priority].push_back(std::move(a_job));
+	}
+	//A worker going to sleep counts itself before checking for jobs, so either it sees this job or it is woken
+	if (m_sleepingWorkers.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_jobAvailable.notify_one();
+	}
+}
+
+bool JobSystem::FindJob(Priority a_lowest, QueuedJob& a_job)
+{
+	//The queues are all created before the first worker starts, unlike the worker list
+	int self = GetWorkerIndex();
+	size_t workerCount = m_queues.size() - 1;
+	for (int priority = HighPriority; priority <= a_lowest; ++priority)
+	{
+		//Newest of our own jobs first, its data is most likely still in cache
+		if (self >= 0)
+		{
+			WorkQueue& own = *m_queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs[priority].empty())
+			{
+				a_job = std::move(own.jobs[priority].back());
+				own.jobs[priority].pop_back();
+				--m_queuedJobs;
+				return true;
+			}
+		}
+		//Jobs from outside the workers run in the order they were submitted
+		{
+			WorkQueue& shared = *m_queues[workerCount];
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			if (!shared.jobs[priority].empty())
+			{
+				a_job = std::move(shared.jobs[priority].front());
+				shared.jobs[priority].pop_front();
+				--m_queuedJobs;
+				return true;
+			}
+		}
+		//Steal the oldest job of another worker, starting after ourselves so thieves spread over the victims
+		for (size_t i = 1; i <= workerCount; ++i)
+		{
+			size_t victim = (self >= 0) ? (self + i) % workerCount : i - 1;
+			if ((int)victim == self)
+			{
+				continue;
+			}
+			WorkQueue& other = *m_queues[victim];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if (!other.jobs[priority].empty())
+			{
+				a_job = std::move(other.jobs[priority].front());
+				other.jobs[priority].pop_front();
+				--m_queuedJobs;
+				++m_steals;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void JobSystem::Execute(QueuedJob& a_job)
+{
+	a_job.job();
+	Finish(a_job.counter);
+}
+
+void JobSystem::Finish(Counter* a_counter)
+{
+	if (a_counter == nullptr)
+	{
+		return;
+	}
+	std::vector<std::function<void()>> released;
+	{
+		std::lock_guard<std::mutex> lock(a_counter->m_mutex);
+		if (--a_counter->m_count == 0)
+		{
+			released.swap(a_counter->m_dependents);
+			a_counter->m_done.notify_all();
+		}
+	}
+	//The counter may already be gone once its lock is released, the dependents were moved out first
+	for (auto& schedule : released)
+	{
+		schedule();
+	}
+}
+
+int JobSystem::GetWorkerIndex() const
+{
+	return (t_system == this) ? t_workerIndex : -1;
+}
+
+std::vector<JobSystem::BenchmarkResult> JobSystem::RunBenchmark(unsigned int a_maxThreads)
+{
+	const unsigned int EmptyJobs = 100000;
+	const unsigned int WorkItems = 1 << 18;
+	if (a_maxThreads == 0)
+	{
+		a_maxThreads = std::thread::hardware_concurrency();
+	}
+	//The calling thread works alongside the workers, so one worker is already two threads
+	unsigned int maxWorkers = std::max(2u, a_maxThreads) - 1;
+	//Worker counts doubling from one, always finishing on the maximum
+	std::vector<unsigned int> workerCounts;
+	for (unsigned int workers = 1; workers < maxWorkers; workers *= 2)
+	{
+		workerCounts.push_back(workers);
+	}
+	workerCounts.push_back(maxWorkers);
+
+	//Enough arithmetic per item that the loop is compute bound rather than memory bound
+	std::vector<float> output(WorkItems);
+	auto kernel = [&output](unsigned int a_first, unsigned int a_last)
+	{
+		for (unsigned int i = a_first; i < a_last; ++i)
+		{
+			float x = i * 0.001f;
+			for (int k = 0; k < 64; ++k)
+			{
+				x = x * 0.999f + 0.5f / (1.f + x * x);
+			}
+			output[i] = x;
+		}
+	};
+	const std::function<void(unsigned int, unsigned int)> workload = kernel;
+
+	//The baseline is the loop a caller would write without a job system, free to be inlined and optimised as a whole
+	auto start = std::chrono::high_resolution_clock::now();
+	kernel(0, WorkItems);
+	double serialMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	//ParallelFor's ranges go through std::function, timing the same call serially separates that cost from scheduling
+	start = std::chrono::high_resolution_clock::now();
+	workload(0, WorkItems);
+	double functionMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	double functionOverhead = (serialMs > 0.0) ? functionMs / serialMs - 1.0 : 0.0;
+	//Read the output so neither loop can be discarded
+	volatile float checksum = output[WorkItems - 1];
+	(void)checksum;
+
+	std::vector<BenchmarkResult> results;
+	for (unsigned int workers : workerCounts)
+	{
+		JobSystem system(workers);
+		BenchmarkResult result = { workers, workers + 1, 0.0, 0.0, 1.0, functionOverhead };
+
+		Counter counter;
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < EmptyJobs; ++i)
+		{
+			system.Run([]() {}, &counter);
+		}
+		system.Wait(counter);
+		result.emptyJobNs = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / EmptyJobs;
+
+		start = std::chrono::high_resolution_clock::now();
+		system.ParallelFor(0, WorkItems, 1024, workload);
+		result.parallelForMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		result.speedup = (result.parallelForMs > 0.0) ? serialMs / result.parallelForMs : 1.0;
+		results.push_back(result);
+	}
+	return results;
+}
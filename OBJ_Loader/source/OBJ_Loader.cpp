@@ -1,34 +1,71 @@
 #include "OBJ_Loader.h"
+#include "OBJ_Stream.h"
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+std::ostream& OBJModel::Log() const
+{
+	//Discard output when logging is disabled, one null stream per thread as batch loads run concurrently
+	static thread_local std::ostream s_nullStream(nullptr);
+	return m_logging ? std::cout : s_nullStream;
+}
+
+void OBJModel::SetTransform(const glm::vec3& a_translation, const glm::vec3& a_rotation, const glm::vec3& a_scale)
+{
+	m_translation = a_translation;
+	m_rotation = a_rotation;
+	m_scale = a_scale;
+	UpdateWorldMatrix();
+}
+
+void OBJModel::UpdateWorldMatrix()
+{
+	//Scale is applied first, then rotation, then translation
+	glm::mat4 world = glm::translate(glm::mat4(1.f), m_translation);
+	world = glm::rotate(world, m_rotation.y, glm::vec3(0.f, 1.f, 0.f));
+	world = glm::rotate(world, m_rotation.x, glm::vec3(1.f, 0.f, 0.f));
+	world = glm::rotate(world, m_rotation.z, glm::vec3(0.f, 0.f, 1.f));
+	m_worldMatrix = glm::scale(world, m_scale);
+}
+
 void OBJModel::Unload()
 {
+	//Meshes and materials are allocated during Load so they need to be freed here
+	for (auto iter = m_meshes.begin(); iter != m_meshes.end(); ++iter)
+	{
+		delete (*iter);
+	}
 	m_meshes.clear();
+	for (auto iter = m_materials.begin(); iter != m_materials.end(); ++iter)
+	{
+		delete (*iter);
+	}
+	m_materials.clear();
+	m_filename.clear();
+	m_parseBufferBytes = 0;
 }
 
-bool OBJModel::Load(std::string a_filename, float a_scale)
+bool OBJModel::Load(std::string a_filename)
 {
-	std::cout << "Attempting to open file: " << a_filename << std::endl;
-	//Get an fstream to read in the file data
-	std::fstream file;
-	file.open(a_filename, std::ios_base::in | std::ios_base::binary);
+	Log() << "Attempting to open file: " << a_filename << std::endl;
+	//Get an input stream to read in the file data, gzip and zstd compressed files are decompressed as they are read
+	OBJInputStream file;
+	file.open(a_filename);
 	//Test to see if the file has opened correctly
 	if(file.is_open())
 	{
-		std::cout << "File Successfully Opened" << std::endl;
+		Log() << "File Successfully Opened" << std::endl;
 		//if file opened successfully verify the contents of the file -- ie check that file does not have zero length
-		file.ignore(std::numeric_limits<std::streamsize>::max());	//Attempt to read the highest number of bytes from the file
-		std::streamsize fileSize = file.gcount();					//gCount will have reached EOF marker, letting us know the number of bytes
-		file.clear();												//Clear the EOF marker from being read
-		file.seekg(0, std::ios_base::beg);							//Seek back to the beginning of the file
+		std::streamsize fileSize = file.GetFileSize();
 		if (fileSize == 0)
 		{
-			std::cout << "File contains no data, closing file" << std::endl;
+			Log() << "File contains no data, closing file" << std::endl;
 			file.close();
+			return false;
 		}
-		std::cout << "File size: " << fileSize / 1024 << " KB" << std::endl;
+		Log() << "File size: " << fileSize / 1024 << " KB" << (file.GetCompression() != OBJInputStream::None ? " (compressed)" : "") << std::endl;
 
 		//Get the File Path information after the file contents have been verified
 		std::string filePath = a_filename;
@@ -65,19 +102,19 @@ bool OBJModel::Load(std::string a_filename, float a_scale)
 
 					if (dataType == "#") //this is a commment line
 					{
-						std::cout << data << std::endl;
+						Log() << data << std::endl;
 						continue;
 					}
 					if (dataType == "mtllib")
 					{
-						std::cout << "Material File: " << data << std::endl;
+						Log() << "Material File: " << data << std::endl;
 						//Load in Material file so that the materials can be used as required
 						LoadMaterialLibrary(data);
 						continue;
 					}
 					if (dataType == "g" || dataType == "o")
 					{
-						std::cout << "OBJ Group Found: " << data << std::endl;
+						Log() << "OBJ Group Found: " << data << std::endl;
 						//We can use group tags to split our model up into smaller mesh components
 						if (currentMesh != nullptr)
 						{
@@ -94,7 +131,6 @@ bool OBJModel::Load(std::string a_filename, float a_scale)
 					if (dataType == "v")
 					{
 						glm::vec4 vertex = processVectorString(data);
-						vertex *= a_scale;						//multiply by passed in vector to allow scalling of the model
 						vertex.w = 1.f;							//As this is positional data ensure the w component is set to 1.0
 						vertexData.push_back(vertex);
 						continue;
@@ -184,9 +220,25 @@ bool OBJModel::Load(std::string a_filename, float a_scale)
 		{
 			m_meshes.push_back(currentMesh);
 		}
+		for (auto iter = m_meshes.begin(); iter != m_meshes.end(); ++iter)
+		{
+			(*iter)->calculateBounds();
+		}
+		//Record the size of the transient parse buffers before they go out of scope
+		m_parseBufferBytes = vertexData.capacity() * sizeof(glm::vec4) + normalData.capacity() * sizeof(glm::vec4) +
+			UVData.capacity() * sizeof(glm::vec2) + fileLine.capacity();
+		if (file.DecompressionFailed())
+		{
+			//Whatever was parsed before the stream broke off is incomplete, leave the model empty
+			Log() << "Failed to decompress file: " << a_filename << " (" << file.GetError() << ")" << std::endl;
+			file.close();
+			Unload();
+			return false;
+		}
 		file.close();
 		return true;
 	}
+	Log() << "Failed to open file: " << a_filename << " (" << file.GetError() << ")" << std::endl;
 	return false;
 }
 
@@ -201,6 +253,21 @@ glm::vec4 OBJMesh::calculateFaceNormal(const unsigned int& a_indexA, const unsig
 	return glm::vec4(glm::cross(ab, ac), 0.f);
 }
 
+void OBJMesh::calculateBounds()
+{
+	if (m_vertices.empty())
+	{
+		m_boundsMin = m_boundsMax = glm::vec3(0.f);
+		return;
+	}
+	m_boundsMin = m_boundsMax = glm::vec3(m_vertices[0].position);
+	for (auto iter = m_vertices.begin(); iter != m_vertices.end(); ++iter)
+	{
+		m_boundsMin = glm::min(m_boundsMin, glm::vec3(iter->position));
+		m_boundsMax = glm::max(m_boundsMax, glm::vec3(iter->position));
+	}
+}
+
 void OBJMesh::calculateFaceNormals()
 {
 	//As our indexed triangle Array contains a tri for ech three points we can itterate through this vector and calculate a face normal
@@ -234,25 +301,28 @@ std::string OBJModel::lineType(const std::string& a_in)
 void OBJModel::LoadMaterialLibrary(std::string a_mtllib)
 {
 	std::string matFile = m_path + a_mtllib;
-	std::cout << "Attempting to load material file: " << matFile << std::endl;
-	//Get an fstream to read in the file data
-	std::fstream file;
-	file.open(matFile, std::ios_base::in | std::ios_base::binary);
+	Log() << "Attempting to load material file: " << matFile << std::endl;
+	//Get an input stream to read in the file data
+	OBJInputStream file;
+	file.open(matFile);
+	//Compressed assets keep their material libraries compressed alongside them, try those if the plain file is missing
+	if (!file.is_open() && !file.open(matFile + ".gz"))
+	{
+		file.open(matFile + ".zst");
+	}
 	//test to see if the file has opened correctly
 	if (file.is_open())
 	{
-		std::cout << "Material Library Successfully Opened" << std::endl;
+		Log() << "Material Library Successfully Opened" << std::endl;
 		//Successfully opened the file, now verify the contents of the file - ie check that file is not zero length
-		file.ignore(std::numeric_limits<std::streamsize>::max());		//attempt to read the highest number of bytes from file
-		std::streamsize fileSize = file.gcount();		//gCount will have reached EOF marker, letting us know the number of bytes
-		file.clear();							//Clear the EOF marker from being read
-		file.seekg(0, std::ios_base::beg);			//Seek back to the start of the file
+		std::streamsize fileSize = file.GetFileSize();
 		if (fileSize == 0)					//If the file has no data close the file and return early
 		{
-			std::cout << "File contains no data, closing file" << std::endl;
+			Log() << "File contains no data, closing file" << std::endl;
 			file.close();
+			return;
 		}
-		std::cout << "Material File Size: " << fileSize / 1024 << " KB" << std::endl;
+		Log() << "Material File Size: " << fileSize / 1024 << " KB" << std::endl;
 
 		//variable to store file data as it is read line by line
 		std::string fileLine;
@@ -271,12 +341,12 @@ void OBJModel::LoadMaterialLibrary(std::string a_mtllib)
 
 					if (dataType == "#") //This is a comment line
 					{
-						std::cout << data << std::endl; //Output any comments to the console
+						Log() << data << std::endl; //Output any comments to the console
 						continue;
 					}
 					if (dataType == "newmtl") //This means a new Material file has been found to be loaded in
 					{
-						std::cout << "New Material Found: " << data << std::endl;
+						Log() << "New Material Found: " << data << std::endl;
 						if (currentMaterial != nullptr)
 						{
 							m_materials.push_back(currentMaterial);
@@ -397,6 +467,10 @@ void OBJModel::LoadMaterialLibrary(std::string a_mtllib)
 
 		file.close();
 	}
+	else
+	{
+		Log() << "Failed to open material file: " << matFile << " (" << file.GetError() << ")" << std::endl;
+	}
 }
 
 std::string OBJModel::lineData(const std::string& a_in)
@@ -476,6 +550,11 @@ OBJMesh* OBJModel::GetMeshByIndex(unsigned int a_index)
 	return nullptr;
 }
 
+const OBJMesh* OBJModel::GetMeshByIndex(unsigned int a_index) const
+{
+	return a_index < m_meshes.size() ? m_meshes[a_index] : nullptr;
+}
+
 OBJMesh* OBJModel::GetMeshByName(const char* a_name)
 {
 	for (int i = 0; i < m_meshes.size(); i++)
@@ -501,6 +580,29 @@ OBJMaterial* OBJModel::GetMaterialByName(const char* a_name)
 	return nullptr;
 }
 
+OBJMemoryUsage OBJModel::GetMemoryUsage() const
+{
+	OBJMemoryUsage usage = {};
+	for (auto iter = m_meshes.begin(); iter != m_meshes.end(); ++iter)
+	{
+		const OBJMesh* mesh = (*iter);
+		usage.vertexBytes += mesh->GetVertexBytes();
+		usage.indexBytes += mesh->GetIndexBytes();
+		usage.meshBytes += sizeof(OBJMesh*) + sizeof(OBJMesh) + mesh->m_name.capacity();
+	}
+	for (auto iter = m_materials.begin(); iter != m_materials.end(); ++iter)
+	{
+		const OBJMaterial* mat = (*iter);
+		usage.materialBytes += sizeof(OBJMaterial*) + sizeof(OBJMaterial) + mat->name.capacity();
+		for (int i = 0; i < OBJMaterial::TextureTypes::TextureTypes_Count; ++i)
+		{
+			usage.materialBytes += mat->textureFileNames[i].capacity();
+		}
+	}
+	usage.parseBufferBytes = m_parseBufferBytes;
+	return usage;
+}
+
 OBJMaterial* OBJModel::GetMaterialByIndex(unsigned int a_index)
 {
 	unsigned int materialCount = m_materials.size();
@@ -0,0 +1,854 @@
+#include "OBJ_Stream.h"
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+#ifdef OBJ_LOADER_USE_ZSTD
+#include <zstd.h>
+#endif
+
+//A fixed size block of data passed between the stages of the decompression pipeline
+typedef struct StreamBlock
+{
+	std::vector<char> data;
+	size_t size;
+}StreamBlock;
+
+//A thread safe queue of blocks, Pop blocks until a block is available or the queue is closed
+class BlockQueue
+{
+public:
+	BlockQueue() : m_closed(false) {}
+
+	void Push(StreamBlock* a_block)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_blocks.push_back(a_block);
+		}
+		m_condition.notify_one();
+	}
+	//Returns false if the queue has been closed, a nullptr block marks the end of the stream
+	bool Pop(StreamBlock*& a_block)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this]() { return m_closed || !m_blocks.empty(); });
+		if (m_closed) { return false; }
+		a_block = m_blocks.front();
+		m_blocks.pop_front();
+		return true;
+	}
+	//Wake any waiting threads, used to abort the pipeline
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+		}
+		m_condition.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<StreamBlock*> m_blocks;
+	bool m_closed;
+};
+
+//Canonical huffman table used by the inflater
+//Codes of 9 bits or less are resolved with a single lookup into the fast table,
+//longer codes fall back to searching the canonical code ranges
+typedef struct HuffmanTable
+{
+	enum { FastBits = 9, FastSize = (1 << FastBits), FastMask = FastSize - 1 };
+	unsigned short fast[FastSize];
+	unsigned short firstCode[16];
+	int maxCode[17];
+	unsigned short firstSymbol[16];
+	unsigned char size[288];
+	unsigned short value[288];
+}HuffmanTable;
+
+//The decompression stream buffer
+//Owns the reader and decompressor threads, the parser reads decompressed text through the std::streambuf interface
+class DecompressionBuffer : public std::streambuf
+{
+public:
+	DecompressionBuffer(std::ifstream& a_file, OBJInputStream::Compression a_compression);
+	~DecompressionBuffer();
+
+	bool Failed() const { return m_failed; }
+	//Why decompression failed, only valid once Failed returns true
+	const std::string& GetError() const { return m_error; }
+
+protected:
+	//Called by std::istream when the current block has been consumed
+	int_type underflow();
+
+private:
+	//Record the first error found, called on the decompressor thread before it reports the failure
+	void SetError(const std::string& a_error) { if (m_error.empty()) { m_error = a_error; } }
+
+	//Pipeline stages
+	void ReadThread();
+	void DecompressThread();
+
+	//Input - pulls bytes from the compressed blocks, returns 0 past the end of the data
+	inline int NextInputByte();
+	bool InputExhausted();
+	inline void FillBits();
+	inline unsigned int GetBits(int a_count);
+	inline void AlignToByte() { GetBits(m_numBits & 7); }
+
+	//Output - writes bytes to the current output block and the sliding window
+	inline void Emit(unsigned char a_byte);
+	bool FlushOutput();
+
+	//GZip and Deflate decoding
+	bool DecodeGZip();
+	bool Inflate();
+	bool InflateStored();
+	bool InflateHuffman(const HuffmanTable& a_lengths, const HuffmanTable& a_distances);
+	bool ReadDynamicTables(HuffmanTable& a_lengths, HuffmanTable& a_distances);
+	static bool BuildHuffman(HuffmanTable& a_table, const unsigned char* a_sizes, int a_count);
+	inline int DecodeSymbol(const HuffmanTable& a_table);
+#ifdef OBJ_LOADER_USE_ZSTD
+	bool DecodeZStd();
+#endif
+
+	std::ifstream& m_file;
+	OBJInputStream::Compression m_compression;
+	std::thread m_readThread;
+	std::thread m_decompressThread;
+	std::atomic<bool> m_failed;
+	std::string m_error;
+	bool m_finished;
+
+	//Block storage and the queues connecting each stage
+	std::vector<StreamBlock> m_blocks;
+	BlockQueue m_inputFree;
+	BlockQueue m_inputFull;
+	BlockQueue m_outputFree;
+	BlockQueue m_outputFull;
+	//Block currently being read by the parser
+	StreamBlock* m_current;
+
+	//Decompressor input state
+	StreamBlock* m_inputBlock;
+	size_t m_inputPos;
+	bool m_inputEnded;
+	unsigned int m_overrunBytes;
+	unsigned int m_codeBuffer;
+	int m_numBits;
+
+	//Decompressor output state
+	StreamBlock* m_outputBlock;
+	unsigned char m_window[32768];
+	unsigned int m_windowPos;
+	const unsigned int* m_crcTable;
+	unsigned int m_crc;
+	unsigned int m_outputSize;
+};
+
+//DEFLATE constant tables (RFC 1951)
+static const unsigned short s_lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned char s_lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const unsigned short s_distanceBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned char s_distanceExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+static const unsigned char s_codeLengthOrder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+//CRC32 lookup table used to verify the gzip trailer
+static const unsigned int* CRCTable()
+{
+	static unsigned int table[256];
+	static std::once_flag once;
+	std::call_once(once, []()
+	{
+		for (unsigned int n = 0; n < 256; ++n)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+			}
+			table[n] = c;
+		}
+	});
+	return table;
+}
+
+static inline int BitReverse16(int a_value)
+{
+	a_value = ((a_value & 0xAAAA) >> 1) | ((a_value & 0x5555) << 1);
+	a_value = ((a_value & 0xCCCC) >> 2) | ((a_value & 0x3333) << 2);
+	a_value = ((a_value & 0xF0F0) >> 4) | ((a_value & 0x0F0F) << 4);
+	a_value = ((a_value & 0xFF00) >> 8) | ((a_value & 0x00FF) << 8);
+	return a_value;
+}
+
+DecompressionBuffer::DecompressionBuffer(std::ifstream& a_file, OBJInputStream::Compression a_compression) :
+	m_file(a_file), m_compression(a_compression), m_failed(false), m_error(), m_finished(false), m_blocks(OBJInputStream::BlockCount * 2),
+	m_current(nullptr), m_inputBlock(nullptr), m_inputPos(0), m_inputEnded(false), m_overrunBytes(0), m_codeBuffer(0), m_numBits(0),
+	m_outputBlock(nullptr), m_windowPos(0), m_crcTable(CRCTable()), m_crc(0), m_outputSize(0)
+{
+	//Half of the blocks feed the reader, the other half hold decompressed output
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		m_blocks[i].data.resize(OBJInputStream::BlockSize);
+		m_blocks[i].size = 0;
+		if (i < OBJInputStream::BlockCount)
+		{
+			m_inputFree.Push(&m_blocks[i]);
+		}
+		else
+		{
+			m_outputFree.Push(&m_blocks[i]);
+		}
+	}
+	setg(nullptr, nullptr, nullptr);
+	m_readThread = std::thread(&DecompressionBuffer::ReadThread, this);
+	m_decompressThread = std::thread(&DecompressionBuffer::DecompressThread, this);
+}
+
+DecompressionBuffer::~DecompressionBuffer()
+{
+	//Closing the queues wakes both threads if the parser stopped before the end of the stream
+	m_inputFree.Close();
+	m_inputFull.Close();
+	m_outputFree.Close();
+	m_outputFull.Close();
+	m_readThread.join();
+	m_decompressThread.join();
+}
+
+DecompressionBuffer::int_type DecompressionBuffer::underflow()
+{
+	if (gptr() < egptr())
+	{
+		return traits_type::to_int_type(*gptr());
+	}
+	//Hand the consumed block back to the decompressor
+	if (m_current != nullptr)
+	{
+		m_outputFree.Push(m_current);
+		m_current = nullptr;
+	}
+	StreamBlock* block = nullptr;
+	if (m_finished || !m_outputFull.Pop(block) || block == nullptr)
+	{
+		m_finished = true;
+		return traits_type::eof();
+	}
+	m_current = block;
+	setg(block->data.data(), block->data.data(), block->data.data() + block->size);
+	return traits_type::to_int_type(*gptr());
+}
+
+void DecompressionBuffer::ReadThread()
+{
+	StreamBlock* block = nullptr;
+	while (m_inputFree.Pop(block))
+	{
+		m_file.read(block->data.data(), block->data.size());
+		block->size = (size_t)m_file.gcount();
+		if (block->size == 0)
+		{
+			//End of file reached, signal the decompressor with a null block
+			m_inputFree.Push(block);
+			m_inputFull.Push(nullptr);
+			return;
+		}
+		m_inputFull.Push(block);
+	}
+}
+
+void DecompressionBuffer::DecompressThread()
+{
+	bool success = false;
+	if (m_outputFree.Pop(m_outputBlock))
+	{
+		m_outputBlock->size = 0;
+		switch (m_compression)
+		{
+		case OBJInputStream::GZip:
+			success = DecodeGZip();
+			break;
+#ifdef OBJ_LOADER_USE_ZSTD
+		case OBJInputStream::ZStd:
+			success = DecodeZStd();
+			break;
+#endif
+		default:
+			break;
+		}
+		//Push out whatever is left in the final block
+		if (m_outputBlock != nullptr && m_outputBlock->size > 0)
+		{
+			m_outputFull.Push(m_outputBlock);
+			m_outputBlock = nullptr;
+		}
+	}
+	if (!success)
+	{
+		SetError("Corrupt or truncated compressed data");
+		m_failed = true;
+	}
+	//Null block marks the end of the decompressed stream
+	m_outputFull.Push(nullptr);
+}
+
+inline int DecompressionBuffer::NextInputByte()
+{
+	while (m_inputBlock == nullptr || m_inputPos >= m_inputBlock->size)
+	{
+		if (m_inputEnded)
+		{
+			//Past the end of the data, feed zeros and count them so truncated files can be detected
+			++m_overrunBytes;
+			return 0;
+		}
+		if (m_inputBlock != nullptr)
+		{
+			m_inputFree.Push(m_inputBlock);
+			m_inputBlock = nullptr;
+		}
+		if (!m_inputFull.Pop(m_inputBlock) || m_inputBlock == nullptr)
+		{
+			m_inputBlock = nullptr;
+			m_inputEnded = true;
+			continue;
+		}
+		m_inputPos = 0;
+	}
+	return (unsigned char)m_inputBlock->data[m_inputPos++];
+}
+
+bool DecompressionBuffer::InputExhausted()
+{
+	//Any real (not overrun) bits left in the bit buffer mean there is more data
+	if (m_numBits > (int)(m_overrunBytes * 8))
+	{
+		return false;
+	}
+	//Otherwise fetch the next input block without consuming from it
+	while (m_inputBlock == nullptr || m_inputPos >= m_inputBlock->size)
+	{
+		if (m_inputEnded)
+		{
+			return true;
+		}
+		if (m_inputBlock != nullptr)
+		{
+			m_inputFree.Push(m_inputBlock);
+			m_inputBlock = nullptr;
+		}
+		if (!m_inputFull.Pop(m_inputBlock) || m_inputBlock == nullptr)
+		{
+			m_inputBlock = nullptr;
+			m_inputEnded = true;
+			return true;
+		}
+		m_inputPos = 0;
+	}
+	return false;
+}
+
+inline void DecompressionBuffer::FillBits()
+{
+	while (m_numBits <= 24)
+	{
+		m_codeBuffer |= (unsigned int)NextInputByte() << m_numBits;
+		m_numBits += 8;
+	}
+}
+
+inline unsigned int DecompressionBuffer::GetBits(int a_count)
+{
+	if (a_count == 0) { return 0; }
+	if (m_numBits < a_count) { FillBits(); }
+	unsigned int value = m_codeBuffer & ((1u << a_count) - 1);
+	m_codeBuffer >>= a_count;
+	m_numBits -= a_count;
+	return value;
+}
+
+inline void DecompressionBuffer::Emit(unsigned char a_byte)
+{
+	m_window[m_windowPos++ & 32767] = a_byte;
+	m_crc = m_crcTable[(m_crc ^ a_byte) & 0xFF] ^ (m_crc >> 8);
+	++m_outputSize;
+	m_outputBlock->data[m_outputBlock->size++] = (char)a_byte;
+	if (m_outputBlock->size == m_outputBlock->data.size())
+	{
+		FlushOutput();
+	}
+}
+
+bool DecompressionBuffer::FlushOutput()
+{
+	//Pass the full block to the parser and wait for a free one, this is where back-pressure is applied
+	m_outputFull.Push(m_outputBlock);
+	m_outputBlock = nullptr;
+	if (!m_outputFree.Pop(m_outputBlock))
+	{
+		//Pipeline aborted - keep a scratch block so decoding can unwind safely
+		m_outputBlock = &m_blocks[m_blocks.size() - 1];
+		m_inputEnded = true;
+		m_failed = true;
+	}
+	m_outputBlock->size = 0;
+	return !m_failed;
+}
+
+bool DecompressionBuffer::DecodeGZip()
+{
+	//A gzip file may contain several members one after another
+	bool firstMember = true;
+	do
+	{
+		//Member header (RFC 1952)
+		unsigned int id1 = GetBits(8), id2 = GetBits(8), method = GetBits(8), flags = GetBits(8);
+		if (id1 != 0x1F || id2 != 0x8B || method != 8)
+		{
+			//Padding after the last member is ignored, as the gzip tool does
+			if (!firstMember)
+			{
+				break;
+			}
+			SetError("Invalid gzip header");
+			return false;
+		}
+		firstMember = false;
+		GetBits(16); GetBits(16);	//Modification time
+		GetBits(8); GetBits(8);		//Extra flags and OS
+		if (flags & 4) //FEXTRA
+		{
+			unsigned int extraLength = GetBits(16);
+			for (unsigned int i = 0; i < extraLength; ++i) { GetBits(8); }
+		}
+		if (flags & 8) //FNAME
+		{
+			while (GetBits(8) != 0 && !InputExhausted()) {}
+		}
+		if (flags & 16) //FCOMMENT
+		{
+			while (GetBits(8) != 0 && !InputExhausted()) {}
+		}
+		if (flags & 2) //FHCRC
+		{
+			GetBits(16);
+		}
+
+		m_crc = 0xFFFFFFFFu;
+		m_outputSize = 0;
+		if (!Inflate())
+		{
+			return false;
+		}
+		//Trailer contains the CRC32 and size of the uncompressed data
+		AlignToByte();
+		unsigned int crc = GetBits(16);
+		crc |= GetBits(16) << 16;
+		unsigned int size = GetBits(16);
+		size |= GetBits(16) << 16;
+		if ((int)(m_overrunBytes * 8) > m_numBits)
+		{
+			SetError("Compressed file is truncated");
+			return false;
+		}
+		if (crc != (m_crc ^ 0xFFFFFFFFu) || size != m_outputSize)
+		{
+			SetError("Compressed file failed CRC check");
+			return false;
+		}
+	} while (!InputExhausted() && !m_failed);
+	return !m_failed;
+}
+
+bool DecompressionBuffer::Inflate()
+{
+	static HuffmanTable fixedLengths, fixedDistances;
+	static std::once_flag fixedOnce;
+	std::call_once(fixedOnce, []()
+	{
+		unsigned char sizes[288];
+		for (int i = 0; i < 144; ++i) { sizes[i] = 8; }
+		for (int i = 144; i < 256; ++i) { sizes[i] = 9; }
+		for (int i = 256; i < 280; ++i) { sizes[i] = 7; }
+		for (int i = 280; i < 288; ++i) { sizes[i] = 8; }
+		BuildHuffman(fixedLengths, sizes, 288);
+		for (int i = 0; i < 32; ++i) { sizes[i] = 5; }
+		BuildHuffman(fixedDistances, sizes, 32);
+	});
+
+	HuffmanTable lengths, distances;
+	unsigned int finalBlock = 0;
+	do
+	{
+		finalBlock = GetBits(1);
+		unsigned int type = GetBits(2);
+		bool result = false;
+		switch (type)
+		{
+		case 0:
+			result = InflateStored();
+			break;
+		case 1:
+			result = InflateHuffman(fixedLengths, fixedDistances);
+			break;
+		case 2:
+			result = ReadDynamicTables(lengths, distances) && InflateHuffman(lengths, distances);
+			break;
+		default:
+			break;
+		}
+		//More than a few bytes of overrun means the compressed data ended early
+		if (!result || m_failed || m_overrunBytes > 8)
+		{
+			SetError("Corrupt or truncated compressed data");
+			return false;
+		}
+	} while (finalBlock == 0);
+	return true;
+}
+
+bool DecompressionBuffer::InflateStored()
+{
+	AlignToByte();
+	unsigned int length = GetBits(16);
+	unsigned int lengthComplement = GetBits(16);
+	if ((length ^ 0xFFFF) != lengthComplement)
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < length && !m_failed && m_overrunBytes <= 8; ++i)
+	{
+		Emit((unsigned char)GetBits(8));
+	}
+	return true;
+}
+
+bool DecompressionBuffer::InflateHuffman(const HuffmanTable& a_lengths, const HuffmanTable& a_distances)
+{
+	//Stop if the data runs out mid block, otherwise the zero padding would decode forever
+	while (!m_failed && m_overrunBytes <= 8)
+	{
+		int symbol = DecodeSymbol(a_lengths);
+		if (symbol < 0)
+		{
+			return false;
+		}
+		if (symbol < 256)
+		{
+			Emit((unsigned char)symbol);
+			continue;
+		}
+		if (symbol == 256)	//End of block
+		{
+			return true;
+		}
+		symbol -= 257;
+		if (symbol >= 29)
+		{
+			return false;
+		}
+		unsigned int length = s_lengthBase[symbol] + GetBits(s_lengthExtra[symbol]);
+		int distanceSymbol = DecodeSymbol(a_distances);
+		if (distanceSymbol < 0 || distanceSymbol >= 30)
+		{
+			return false;
+		}
+		unsigned int distance = s_distanceBase[distanceSymbol] + GetBits(s_distanceExtra[distanceSymbol]);
+		if (distance > m_outputSize)
+		{
+			return false;
+		}
+		//Copy from the sliding window, byte by byte as the source may overlap the bytes being written
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			Emit(m_window[(m_windowPos - distance) & 32767]);
+		}
+	}
+	return false;
+}
+
+bool DecompressionBuffer::ReadDynamicTables(HuffmanTable& a_lengths, HuffmanTable& a_distances)
+{
+	unsigned int lengthCount = GetBits(5) + 257;
+	unsigned int distanceCount = GetBits(5) + 1;
+	unsigned int codeLengthCount = GetBits(4) + 4;
+
+	unsigned char codeLengthSizes[19] = {};
+	for (unsigned int i = 0; i < codeLengthCount; ++i)
+	{
+		codeLengthSizes[s_codeLengthOrder[i]] = (unsigned char)GetBits(3);
+	}
+	HuffmanTable codeLengths;
+	if (!BuildHuffman(codeLengths, codeLengthSizes, 19))
+	{
+		return false;
+	}
+
+	//Literal/length and distance code sizes are run length encoded as one sequence
+	unsigned char sizes[288 + 32] = {};
+	unsigned int total = lengthCount + distanceCount;
+	unsigned int n = 0;
+	while (n < total)
+	{
+		int symbol = DecodeSymbol(codeLengths);
+		if (symbol < 0 || symbol > 18)
+		{
+			return false;
+		}
+		if (symbol < 16)
+		{
+			sizes[n++] = (unsigned char)symbol;
+			continue;
+		}
+		unsigned char fill = 0;
+		unsigned int repeat = 0;
+		if (symbol == 16)
+		{
+			if (n == 0) { return false; }
+			repeat = GetBits(2) + 3;
+			fill = sizes[n - 1];
+		}
+		else if (symbol == 17)
+		{
+			repeat = GetBits(3) + 3;
+		}
+		else
+		{
+			repeat = GetBits(7) + 11;
+		}
+		if (n + repeat > total)
+		{
+			return false;
+		}
+		for (unsigned int i = 0; i < repeat; ++i)
+		{
+			sizes[n++] = fill;
+		}
+	}
+	return BuildHuffman(a_lengths, sizes, lengthCount) && BuildHuffman(a_distances, sizes + lengthCount, distanceCount);
+}
+
+bool DecompressionBuffer::BuildHuffman(HuffmanTable& a_table, const unsigned char* a_sizes, int a_count)
+{
+	int sizeCounts[17] = {};
+	int nextCode[16] = {};
+	memset(a_table.fast, 0, sizeof(a_table.fast));
+	for (int i = 0; i < a_count; ++i)
+	{
+		++sizeCounts[a_sizes[i]];
+	}
+	sizeCounts[0] = 0;
+	//Assign the first canonical code of each length
+	int code = 0;
+	int symbolIndex = 0;
+	for (int i = 1; i < 16; ++i)
+	{
+		nextCode[i] = code;
+		a_table.firstCode[i] = (unsigned short)code;
+		a_table.firstSymbol[i] = (unsigned short)symbolIndex;
+		code += sizeCounts[i];
+		if (sizeCounts[i] > 0 && code - 1 >= (1 << i))
+		{
+			return false;	//Over subscribed code lengths
+		}
+		a_table.maxCode[i] = code << (16 - i);
+		code <<= 1;
+		symbolIndex += sizeCounts[i];
+	}
+	a_table.maxCode[16] = 0x10000;
+	for (int i = 0; i < a_count; ++i)
+	{
+		int size = a_sizes[i];
+		if (size == 0) { continue; }
+		int index = nextCode[size] - a_table.firstCode[size] + a_table.firstSymbol[size];
+		a_table.size[index] = (unsigned char)size;
+		a_table.value[index] = (unsigned short)i;
+		if (size <= HuffmanTable::FastBits)
+		{
+			//Codes are stored most significant bit first but read least significant bit first
+			unsigned short fastValue = (unsigned short)((size << 9) | i);
+			int j = BitReverse16(nextCode[size]) >> (16 - size);
+			while (j < HuffmanTable::FastSize)
+			{
+				a_table.fast[j] = fastValue;
+				j += (1 << size);
+			}
+		}
+		++nextCode[size];
+	}
+	return true;
+}
+
+inline int DecompressionBuffer::DecodeSymbol(const HuffmanTable& a_table)
+{
+	if (m_numBits < 16) { FillBits(); }
+	unsigned short fastValue = a_table.fast[m_codeBuffer & HuffmanTable::FastMask];
+	if (fastValue != 0)
+	{
+		int size = fastValue >> 9;
+		m_codeBuffer >>= size;
+		m_numBits -= size;
+		return fastValue & 511;
+	}
+	//Slow path, find the code length whose range contains the next 16 bits
+	int k = BitReverse16(m_codeBuffer & 0xFFFF);
+	int size = HuffmanTable::FastBits + 1;
+	for (; size < 16; ++size)
+	{
+		if (k < a_table.maxCode[size]) { break; }
+	}
+	if (size >= 16)
+	{
+		return -1;
+	}
+	int index = (k >> (16 - size)) - a_table.firstCode[size] + a_table.firstSymbol[size];
+	if (index < 0 || index >= 288 || a_table.size[index] != size)
+	{
+		return -1;
+	}
+	m_codeBuffer >>= size;
+	m_numBits -= size;
+	return a_table.value[index];
+}
+
+#ifdef OBJ_LOADER_USE_ZSTD
+bool DecompressionBuffer::DecodeZStd()
+{
+	ZSTD_DStream* stream = ZSTD_createDStream();
+	ZSTD_initDStream(stream);
+	bool success = true;
+	size_t lastResult = 0;
+	StreamBlock* block = nullptr;
+	while (success && m_inputFull.Pop(block) && block != nullptr)
+	{
+		ZSTD_inBuffer input = { block->data.data(), block->size, 0 };
+		//Keep calling until the input block is consumed and the decoder has flushed all it can into the output
+		bool outputFull = true;
+		while (success && (input.pos < input.size || outputFull))
+		{
+			ZSTD_outBuffer output = { m_outputBlock->data.data(), m_outputBlock->data.size(), m_outputBlock->size };
+			lastResult = ZSTD_decompressStream(stream, &output, &input);
+			if (ZSTD_isError(lastResult))
+			{
+				SetError(std::string("ZStd error: ") + ZSTD_getErrorName(lastResult));
+				success = false;
+				break;
+			}
+			m_outputBlock->size = output.pos;
+			outputFull = (output.pos == output.size);
+			if (outputFull && !FlushOutput())
+			{
+				success = false;
+			}
+		}
+		m_inputFree.Push(block);
+	}
+	//A non zero result at the end of the input means the final frame was incomplete
+	if (success && lastResult != 0)
+	{
+		SetError("Compressed file is truncated");
+		success = false;
+	}
+	ZSTD_freeDStream(stream);
+	return success && !m_failed;
+}
+#endif
+
+OBJInputStream::OBJInputStream() : std::istream(nullptr), m_file(), m_fileSize(0), m_compression(None), m_decompressionBuffer(nullptr), m_error()
+{
+}
+
+OBJInputStream::~OBJInputStream()
+{
+	close();
+}
+
+bool OBJInputStream::open(const std::string& a_filename)
+{
+	close();
+	m_error.clear();
+	m_file.open(a_filename, std::ios_base::in | std::ios_base::binary);
+	if (!m_file.is_open())
+	{
+		m_error = "File could not be opened";
+		return false;
+	}
+	//Get the size of the file on disk
+	m_file.seekg(0, std::ios_base::end);
+	m_fileSize = m_file.tellg();
+	m_file.seekg(0, std::ios_base::beg);
+
+	//Identify compressed files by their magic numbers rather than the file extension
+	unsigned char magic[4] = {};
+	m_file.read((char*)magic, 4);
+	m_file.clear();
+	m_file.seekg(0, std::ios_base::beg);
+	if (m_file.gcount() >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+	{
+		m_compression = GZip;
+	}
+	else if (m_file.gcount() == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+	{
+		m_compression = ZStd;
+#ifndef OBJ_LOADER_USE_ZSTD
+		//Without the decoder the compressed bytes would be parsed as text, refuse the file instead
+		m_error = "ZStd compressed file found but OBJ_Loader was built without OBJ_LOADER_USE_ZSTD";
+		m_file.close();
+		m_compression = None;
+		return false;
+#endif
+	}
+	else
+	{
+		m_compression = None;
+	}
+
+	if (m_compression == None)
+	{
+		rdbuf(m_file.rdbuf());
+	}
+	else
+	{
+		m_decompressionBuffer = new DecompressionBuffer(m_file, m_compression);
+		rdbuf(m_decompressionBuffer);
+	}
+	clear();
+	return true;
+}
+
+void OBJInputStream::close()
+{
+	rdbuf(nullptr);
+	//Deleting the decompression buffer stops and joins its threads before the file is closed
+	if (m_decompressionBuffer != nullptr)
+	{
+		delete m_decompressionBuffer;
+		m_decompressionBuffer = nullptr;
+	}
+	if (m_file.is_open())
+	{
+		m_file.close();
+	}
+	m_fileSize = 0;
+	m_compression = None;
+}
+
+bool OBJInputStream::DecompressionFailed() const
+{
+	return m_decompressionBuffer != nullptr && m_decompressionBuffer->Failed();
+}
+
+std::string OBJInputStream::GetError() const
+{
+	return DecompressionFailed() ? m_decompressionBuffer->GetError() : m_error;
+}